@@ -0,0 +1,223 @@
+// Runs synthetic sources through a real SourceRecorder (capture thread, frame
+// queue, encode thread, FfmpegWriter with x264 and the null muxer) and fails
+// if the recorder allocates from the heap in steady state. A UYVY source takes
+// the conversion path (PicturePool pictures, sliced conversion on the
+// WorkerPool); an I420 one is handed to the encoder by reference. Allocations
+// inside FFmpeg calls, marked with AllocationTrace::ForeignScope, are left out:
+// buffer references, encoded packets and the muxer's queue are FFmpeg's own.
+// The encoder runs single-threaded so x264 works inside those calls rather
+// than on threads of its own. Audio is not covered.
+//
+// Usage: AllocationBench [width height [frames]]
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "AllocationTrace.h"
+#include "SourceRecorder.h"
+
+namespace
+{
+std::atomic<bool> g_counting{false};
+std::atomic<quint64> g_allocations{0};
+
+void noteAllocation()
+{
+    if (g_counting.load(std::memory_order_relaxed) && !AllocationTrace::inForeignCode())
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace
+
+#if defined(__GLIBC__)
+// Every allocator in the process (new, Qt, FFmpeg) ends up here.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    noteAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    noteAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    noteAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    noteAllocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    noteAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    noteAllocation();
+    return __libc_memalign(alignment, size);
+}
+}
+#else
+// Elsewhere only C++ allocations are seen; FFmpeg's are missed.
+void *operator new(std::size_t size)
+{
+    noteAllocation();
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace
+{
+constexpr int TimeoutMs = 120000;
+
+struct Counted
+{
+    quint64 frames = 0;
+    quint64 allocations = 0;
+    quint64 pictures = 0;
+};
+
+// Until the recorder has encoded `target` frames; false if it stopped or stalled.
+bool waitEncoded(const SourceRecorder &recorder, quint64 target)
+{
+    QElapsedTimer waited;
+    waited.start();
+    while (recorder.queueStats().encoded < target)
+    {
+        if (!recorder.isRunning() || waited.elapsed() > TimeoutMs)
+            return false;
+        QThread::msleep(5);
+    }
+    return true;
+}
+
+bool runRecorder(const QString &format, int width, int height, int warmup, int frames, Counted &counted)
+{
+    SourceSettings settings;
+    settings.ndiSource = QString("synthetic:?size=%1x%2&fps=30&format=%3&realtime=0").arg(width).arg(height).arg(format);
+    settings.label = "AllocationBench-" + format;
+    settings.discardOutput = true;
+    settings.audioCodec = AudioCodec::None;
+    settings.overflowPolicy = OverflowPolicy::Block;
+    settings.encoder = EncoderProfile::named("Balanced");
+    settings.encoder.threads = 1;
+
+    SourceRecorder recorder;
+    recorder.setPreviewEnabled(false);
+    recorder.applySettings(settings);
+    recorder.start();
+
+    bool ok = waitEncoded(recorder, static_cast<quint64>(warmup));
+    if (ok)
+    {
+        Logger::instance().flush();
+        const QueueStats before = recorder.queueStats();
+        g_allocations.store(0, std::memory_order_relaxed);
+        g_counting.store(true, std::memory_order_relaxed);
+        ok = waitEncoded(recorder, before.encoded + frames);
+        g_counting.store(false, std::memory_order_relaxed);
+        const QueueStats after = recorder.queueStats();
+        counted.frames = after.encoded - before.encoded;
+        counted.allocations = g_allocations.load(std::memory_order_relaxed);
+        counted.pictures = after.bufferAllocations - before.bufferAllocations;
+    }
+    recorder.stop();
+    recorder.waitFinalized();
+    return ok;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    int width = 1920, height = 1080, frames = 300;
+    if (argc >= 3)
+    {
+        width = std::atoi(argv[1]);
+        height = std::atoi(argv[2]);
+        if (argc >= 4)
+            frames = std::atoi(argv[3]);
+    }
+    if (width < 16 || height < 16 || (width | height) & 1 || frames < 1)
+    {
+        std::fprintf(stderr, "usage: %s [width height [frames]]\n", argv[0]);
+        return 2;
+    }
+    // Long enough for the encoder to fill its lookahead and reach a second GOP.
+    const int warmup = 150;
+
+    std::printf("%dx%d, %d frames after %d warm-up\n\n", width, height, frames, warmup);
+    std::printf("%-16s %8s %12s %10s %10s\n", "path", "frames", "allocations", "per frame", "pictures");
+
+    bool pass = true;
+    const struct
+    {
+        const char *name;
+        const char *format;
+    } runs[] = {{"conversion", "uyvy"}, {"pass-through", "i420"}};
+    for (const auto &run : runs)
+    {
+        Counted counted;
+        if (!runRecorder(run.format, width, height, warmup, frames, counted))
+        {
+            std::fprintf(stderr, "%s: the recorder stopped or stalled\n", run.name);
+            return 1;
+        }
+        std::printf("%-16s %8llu %12llu %10.2f %10llu\n", run.name, static_cast<unsigned long long>(counted.frames),
+                    static_cast<unsigned long long>(counted.allocations),
+                    static_cast<double>(counted.allocations) / std::max<quint64>(1, counted.frames),
+                    static_cast<unsigned long long>(counted.pictures));
+        pass = pass && counted.allocations == 0 && counted.pictures == 0;
+    }
+
+    std::printf("\n%s\n", pass ? "PASS" : "FAIL: the recorder allocated in steady state");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Compares the ColorConvert kernels per instruction set against swscale and
+// checks each SIMD variant bit-for-bit against the scalar kernels.
+//
+// Usage: ColorConvertBench [width height [iterations]]
+#include "ColorConvert.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+struct Buffers
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> u;
+    std::vector<uint8_t> v;
+
+    Buffers(int w, int h) : width(w), height(h), packed(static_cast<size_t>(w) * h * 4), luma(static_cast<size_t>(w) * h),
+                            u(static_cast<size_t>((w + 1) / 2) * ((h + 1) / 2) * 2), v(u.size())
+    {
+        std::mt19937 rng(1234);
+        for (uint8_t &b : packed)
+            b = static_cast<uint8_t>(rng());
+    }
+
+    std::vector<uint8_t> output() const
+    {
+        std::vector<uint8_t> all(luma);
+        all.insert(all.end(), u.begin(), u.end());
+        all.insert(all.end(), v.begin(), v.end());
+        return all;
+    }
+};
+
+struct Case
+{
+    const char *name;
+    AVPixelFormat srcFormat;
+    AVPixelFormat dstFormat;
+    int bytesPerPixel;
+    std::function<void(Buffers &)> run;
+    int factor = 1; // previews: packed RGBX at 1/factor size, written to the luma buffer
+};
+
+double millisPerFrame(const std::function<void()> &fn, int iterations)
+{
+    fn(); // warm caches and lazy dispatch
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        fn();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+double swscaleMillis(Buffers &buf, const Case &c, int flags, int iterations)
+{
+    const int dstWidth = buf.width / c.factor;
+    const int dstHeight = buf.height / c.factor;
+    SwsContext *sws = sws_getContext(buf.width, buf.height, c.srcFormat, dstWidth, dstHeight, c.dstFormat, flags, nullptr, nullptr, nullptr);
+    if (!sws)
+        return -1.0;
+    const int chromaStride = (buf.width + 1) / 2;
+    const uint8_t *src[4] = {buf.packed.data(), nullptr, nullptr, nullptr};
+    const int srcStride[4] = {buf.width * c.bytesPerPixel, 0, 0, 0};
+    uint8_t *dst[4] = {buf.luma.data(), buf.u.data(), buf.v.data(), nullptr};
+    int dstStride[4] = {buf.width, chromaStride, chromaStride, 0};
+    if (c.dstFormat == AV_PIX_FMT_NV12)
+        dstStride[1] = chromaStride * 2;
+    if (c.dstFormat == AV_PIX_FMT_RGB0)
+        dstStride[0] = dstWidth * 4;
+    const double ms = millisPerFrame([&]() { sws_scale(sws, src, srcStride, 0, buf.height, dst, dstStride); }, iterations);
+    sws_freeContext(sws);
+    return ms;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const int width = argc > 2 ? std::atoi(argv[1]) : 1920;
+    const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 200;
+    if (width <= 0 || height <= 0 || iterations <= 0)
+    {
+        std::fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+        return 2;
+    }
+
+    using namespace ColorConvert;
+    const Matrix matrix = height >= 720 ? Matrix::Bt709 : Matrix::Bt601;
+    // Roughly what a 320-pixel-wide tile asks of a 1080p source.
+    const int previewFactor = std::max(2, width / 320);
+    std::vector<uint16_t> previewScratch;
+    const std::vector<Case> cases = {
+        {"RGBA->I420", AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P, 4,
+         [matrix](Buffers &b) {
+             const int cs = (b.width + 1) / 2;
+             rgbaToI420(b.packed.data(), b.width * 4, b.luma.data(), b.width, b.u.data(), cs, b.v.data(), cs, b.width, b.height, matrix);
+         }},
+        {"BGRA->I420", AV_PIX_FMT_BGRA, AV_PIX_FMT_YUV420P, 4,
+         [matrix](Buffers &b) {
+             const int cs = (b.width + 1) / 2;
+             bgraToI420(b.packed.data(), b.width * 4, b.luma.data(), b.width, b.u.data(), cs, b.v.data(), cs, b.width, b.height, matrix);
+         }},
+        {"UYVY->I420", AV_PIX_FMT_UYVY422, AV_PIX_FMT_YUV420P, 2,
+         [](Buffers &b) {
+             const int cs = (b.width + 1) / 2;
+             uyvyToI420(b.packed.data(), b.width * 2, b.luma.data(), b.width, b.u.data(), cs, b.v.data(), cs, b.width, b.height);
+         }},
+        {"UYVY->NV12", AV_PIX_FMT_UYVY422, AV_PIX_FMT_NV12, 2,
+         [](Buffers &b) {
+             uyvyToNv12(b.packed.data(), b.width * 2, b.luma.data(), b.width, b.u.data(), ((b.width + 1) / 2) * 2, b.width, b.height);
+         }},
+        {"UYVY->prev", AV_PIX_FMT_UYVY422, AV_PIX_FMT_RGB0, 2,
+         [&](Buffers &b) {
+             uyvyToRgbxPreview(b.packed.data(), b.width * 2, b.luma.data(), (b.width / previewFactor) * 4, b.width, b.height,
+                               previewFactor, matrix, previewScratch);
+         },
+         previewFactor},
+        {"BGRA->prev", AV_PIX_FMT_BGRA, AV_PIX_FMT_RGB0, 4,
+         [&](Buffers &b) {
+             bgraToRgbxPreview(b.packed.data(), b.width * 4, b.luma.data(), (b.width / previewFactor) * 4, b.width, b.height,
+                               previewFactor, previewScratch);
+         },
+         previewFactor},
+    };
+
+    std::printf("%dx%d, %d iterations, CPU supports %s\n\n", width, height, iterations, isaName(detectIsa()));
+    std::printf("%-12s %-10s %10s %8s\n", "conversion", "impl", "ms/frame", "exact");
+
+    int failures = 0;
+    Buffers buf(width, height);
+    for (const Case &c : cases)
+    {
+        setIsa(Isa::Scalar);
+        c.run(buf);
+        const std::vector<uint8_t> reference = buf.output();
+
+        for (Isa isa : {Isa::Scalar, Isa::Sse2, Isa::Avx2, Isa::Avx512})
+        {
+            if (static_cast<int>(isa) > static_cast<int>(detectIsa()))
+                break;
+            setIsa(isa);
+            const double ms = millisPerFrame([&]() { c.run(buf); }, iterations);
+            const bool exact = buf.output() == reference;
+            failures += exact ? 0 : 1;
+            std::printf("%-12s %-10s %10.3f %8s\n", c.name, isaName(isa), ms, exact ? "yes" : "NO");
+        }
+        std::printf("%-12s %-10s %10.3f %8s\n", c.name, "sws-bilin", swscaleMillis(buf, c, SWS_BILINEAR, iterations), "-");
+        std::printf("%-12s %-10s %10.3f %8s\n", c.name, c.factor > 1 ? "sws-fastbl" : "sws-point",
+                    swscaleMillis(buf, c, c.factor > 1 ? SWS_FAST_BILINEAR : SWS_POINT, iterations), "-");
+    }
+
+    setIsa(detectIsa());
+    return failures == 0 ? 0 : 1;
+}
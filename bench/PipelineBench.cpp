@@ -0,0 +1,381 @@
+// Runs simulated sources through the full recorder pipeline (capture, queue,
+// convert, encode, mux) and reports sustained frame rate per source, drops,
+// per-stage latency, CPU time and peak memory. Output goes to FFmpeg's null
+// muxer by default, or to a directory (ideally tmpfs) with --output.
+//
+// Usage: PipelineBench [--scenario 1080p30,1080p60,2160p30] [--sources N | --sweep MAX]
+//                      [--seconds S] [--warmup S] [--output null|DIR] [--profile NAME]
+//                      [--format uyvy] [--cores N] [--json FILE]
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "CpuBudget.h"
+#include "SourceRecorder.h"
+#ifdef Q_OS_WIN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+struct Scenario
+{
+    QString name;
+    int width = 0;
+    int height = 0;
+    int fps = 0;
+};
+
+struct Options
+{
+    QString format = "uyvy";
+    QString output = "null";
+    QString profile = "Balanced";
+    double seconds = 10.0;
+    double warmup = 2.0;
+};
+
+struct SourceResult
+{
+    QString label;
+    double fps = 0.0;
+    quint64 encoded = 0;
+    quint64 droppedQueue = 0;
+    quint64 droppedLate = 0;
+    quint64 droppedSource = 0;
+    quint64 duplicated = 0;
+
+    quint64 dropped() const { return droppedQueue + droppedLate + droppedSource; }
+};
+
+struct RunResult
+{
+    int sources = 0;
+    double seconds = 0.0;
+    std::vector<SourceResult> perSource;
+    StageLatency stages;
+    double cpuSeconds = 0.0;
+    double peakRssMb = 0.0;
+    bool sustained = false;
+};
+
+// "<height>p<fps>" at 16:9, e.g. 1080p60.
+bool parseScenario(const QString &name, Scenario &scenario)
+{
+    const QRegularExpressionMatch match = QRegularExpression("^(\\d+)p(\\d+)$").match(name);
+    if (!match.hasMatch())
+        return false;
+    scenario.name = name;
+    scenario.height = match.captured(1).toInt();
+    scenario.width = (scenario.height * 16 / 9 + 1) & ~1;
+    scenario.fps = match.captured(2).toInt();
+    return scenario.height > 0 && scenario.fps > 0;
+}
+
+double processCpuSeconds()
+{
+#ifdef Q_OS_WIN
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0.0;
+    auto seconds = [](const FILETIME &time) {
+        return ((static_cast<quint64>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+// High-water mark for the whole process, so it only grows across runs.
+double peakRssMb()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0.0;
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+StageLatency stageDelta(const StageLatency &now, const StageLatency &before)
+{
+    StageLatency delta;
+    delta.capture = now.capture.since(before.capture);
+    delta.queue = now.queue.since(before.queue);
+    delta.convert = now.convert.since(before.convert);
+    delta.encode = now.encode.since(before.encode);
+    delta.mux = now.mux.since(before.mux);
+    return delta;
+}
+
+void mergeStages(StageLatency &into, const StageLatency &other)
+{
+    into.capture.merge(other.capture);
+    into.queue.merge(other.queue);
+    into.convert.merge(other.convert);
+    into.encode.merge(other.encode);
+    into.mux.merge(other.mux);
+}
+
+RunResult run(const Scenario &scenario, int sourceCount, const Options &options)
+{
+    std::vector<std::unique_ptr<SourceRecorder>> recorders;
+    for (int i = 0; i < sourceCount; ++i)
+    {
+        SourceSettings settings;
+        settings.ndiSource = QString("synthetic:?size=%1x%2&fps=%3&format=%4&seed=%5")
+                                 .arg(scenario.width)
+                                 .arg(scenario.height)
+                                 .arg(scenario.fps)
+                                 .arg(options.format)
+                                 .arg(i + 1);
+        settings.label = QString("bench-%1-%2").arg(scenario.name).arg(i + 1);
+        settings.discardOutput = options.output == "null";
+        settings.outputFolder = settings.discardOutput ? QString() : options.output;
+        settings.audioCodec = AudioCodec::None;
+        settings.encoder = EncoderProfile::named(options.profile);
+        auto recorder = std::make_unique<SourceRecorder>();
+        recorder->setPreviewEnabled(false);
+        recorder->applySettings(settings);
+        recorders.push_back(std::move(recorder));
+    }
+    for (auto &recorder : recorders)
+        recorder->start();
+
+    QThread::msleep(static_cast<unsigned long>(options.warmup * 1000));
+    std::vector<RecorderStats> startStats;
+    for (auto &recorder : recorders)
+        startStats.push_back(recorder->stats());
+    const double cpuStart = processCpuSeconds();
+    QElapsedTimer wall;
+    wall.start();
+
+    QThread::msleep(static_cast<unsigned long>(options.seconds * 1000));
+
+    RunResult result;
+    result.sources = sourceCount;
+    result.seconds = wall.nsecsElapsed() / 1e9;
+    result.cpuSeconds = processCpuSeconds() - cpuStart;
+    result.sustained = true;
+    for (size_t i = 0; i < recorders.size(); ++i)
+    {
+        const RecorderStats stats = recorders[i]->stats();
+        const RecorderStats &before = startStats[i];
+        SourceResult source;
+        source.label = stats.label;
+        source.encoded = stats.queue.encoded - before.queue.encoded;
+        source.fps = source.encoded / result.seconds;
+        source.droppedQueue =
+            stats.queue.droppedOldest + stats.queue.droppedNewest - before.queue.droppedOldest - before.queue.droppedNewest;
+        source.droppedLate = stats.queue.droppedLate - before.queue.droppedLate;
+        source.droppedSource = stats.source.dropped - before.source.dropped;
+        source.duplicated = stats.queue.duplicated - before.queue.duplicated;
+        if (source.dropped() > 0 || source.fps < scenario.fps * 0.98)
+            result.sustained = false;
+        result.perSource.push_back(source);
+        mergeStages(result.stages, stageDelta(stats.latency, before.latency));
+    }
+
+    for (auto &recorder : recorders)
+        recorder->stop();
+    for (auto &recorder : recorders)
+        recorder->waitFinalized();
+    result.peakRssMb = peakRssMb();
+    return result;
+}
+
+QJsonObject stageJson(const LatencyHistogram::Snapshot &stage)
+{
+    QJsonObject object;
+    object["count"] = static_cast<double>(stage.count);
+    object["meanMs"] = stage.meanNs() / 1e6;
+    object["p50Ms"] = stage.percentileNs(0.50) / 1e6;
+    object["p99Ms"] = stage.percentileNs(0.99) / 1e6;
+    object["maxMs"] = stage.maxNs / 1e6;
+    return object;
+}
+
+QJsonObject runJson(const RunResult &result)
+{
+    QJsonObject object;
+    object["sources"] = result.sources;
+    object["seconds"] = result.seconds;
+    object["sustained"] = result.sustained;
+    object["cpuSeconds"] = result.cpuSeconds;
+    object["cpuCoresUsed"] = result.cpuSeconds / result.seconds;
+    object["peakRssMb"] = result.peakRssMb;
+    QJsonArray sources;
+    for (const SourceResult &source : result.perSource)
+    {
+        QJsonObject entry;
+        entry["label"] = source.label;
+        entry["fps"] = source.fps;
+        entry["encoded"] = static_cast<double>(source.encoded);
+        entry["droppedQueue"] = static_cast<double>(source.droppedQueue);
+        entry["droppedLate"] = static_cast<double>(source.droppedLate);
+        entry["droppedSource"] = static_cast<double>(source.droppedSource);
+        entry["duplicated"] = static_cast<double>(source.duplicated);
+        sources.append(entry);
+    }
+    object["perSource"] = sources;
+    QJsonObject stages;
+    stages["capture"] = stageJson(result.stages.capture);
+    stages["queue"] = stageJson(result.stages.queue);
+    stages["convert"] = stageJson(result.stages.convert);
+    stages["encode"] = stageJson(result.stages.encode);
+    stages["mux"] = stageJson(result.stages.mux);
+    object["stages"] = stages;
+    return object;
+}
+
+void printRun(const Scenario &scenario, const RunResult &result)
+{
+    double minFps = scenario.fps;
+    quint64 dropped = 0;
+    quint64 duplicated = 0;
+    for (const SourceResult &source : result.perSource)
+    {
+        minFps = std::min(minFps, source.fps);
+        dropped += source.dropped();
+        duplicated += source.duplicated;
+    }
+    std::printf("%-8s %2d sources  min %6.2f fps  dropped %6llu  duplicated %6llu  cpu %5.2f cores  rss %7.1f MB  %s\n",
+                qPrintable(scenario.name), result.sources, minFps, static_cast<unsigned long long>(dropped),
+                static_cast<unsigned long long>(duplicated), result.cpuSeconds / result.seconds, result.peakRssMb,
+                result.sustained ? "ok" : "FAIL");
+    const struct
+    {
+        const char *name;
+        const LatencyHistogram::Snapshot &stage;
+    } stages[] = {{"capture", result.stages.capture},
+                  {"queue", result.stages.queue},
+                  {"convert", result.stages.convert},
+                  {"encode", result.stages.encode},
+                  {"mux", result.stages.mux}};
+    for (const auto &stage : stages)
+        std::printf("    %-8s p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", stage.name, stage.stage.percentileNs(0.50) / 1e6,
+                    stage.stage.percentileNs(0.99) / 1e6, stage.stage.maxNs / 1e6);
+    std::fflush(stdout);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("End-to-end recording pipeline benchmark");
+    parser.addHelpOption();
+    const QCommandLineOption scenarioOption("scenario", "Comma-separated <height>p<fps> list.", "list", "1080p30,1080p60,2160p30");
+    const QCommandLineOption sourcesOption("sources", "Simulated sources per scenario.", "n", "1");
+    const QCommandLineOption sweepOption("sweep", "Find the most sources with no drops, up to this many.", "max");
+    const QCommandLineOption secondsOption("seconds", "Measured seconds per run.", "s", "10");
+    const QCommandLineOption warmupOption("warmup", "Seconds to run before measuring.", "s", "2");
+    const QCommandLineOption outputOption("output", "\"null\" or a directory to write files into.", "dir", "null");
+    const QCommandLineOption profileOption("profile", "Encoder profile name.", "name", "Balanced");
+    const QCommandLineOption formatOption("format", "Source pixel format.", "fmt", "uyvy");
+    const QCommandLineOption coresOption("cores", "CPU budget for all recorders (0 = all cores).", "n", "0");
+    const QCommandLineOption jsonOption("json", "Write results as JSON to this file.", "file");
+    parser.addOptions({scenarioOption, sourcesOption, sweepOption, secondsOption, warmupOption, outputOption, profileOption, formatOption,
+                       coresOption, jsonOption});
+    parser.process(app);
+
+    Options options;
+    options.seconds = std::max(1.0, parser.value(secondsOption).toDouble());
+    options.warmup = std::max(0.0, parser.value(warmupOption).toDouble());
+    options.output = parser.value(outputOption);
+    options.profile = parser.value(profileOption);
+    options.format = parser.value(formatOption);
+    CpuBudget::instance().setTotalCores(parser.value(coresOption).toInt());
+
+    std::vector<Scenario> scenarios;
+    for (const QString &name : parser.value(scenarioOption).split(',', Qt::SkipEmptyParts))
+    {
+        Scenario scenario;
+        if (!parseScenario(name.trimmed(), scenario))
+        {
+            std::fprintf(stderr, "Unknown scenario \"%s\"; expected <height>p<fps>\n", qPrintable(name));
+            return 2;
+        }
+        scenarios.push_back(scenario);
+    }
+
+    const bool sweep = parser.isSet(sweepOption);
+    const int sources = std::max(1, parser.value(sourcesOption).toInt());
+    const int sweepMax = std::max(1, parser.value(sweepOption).toInt());
+    std::printf("Pipeline benchmark: %d cores, profile %s, output %s, %.0f s per run\n", QThread::idealThreadCount(),
+                qPrintable(options.profile), qPrintable(options.output), options.seconds);
+
+    QJsonArray scenarioResults;
+    for (const Scenario &scenario : scenarios)
+    {
+        QJsonArray runs;
+        int maxSustained = 0;
+        const int first = sweep ? 1 : sources;
+        const int last = sweep ? sweepMax : sources;
+        for (int count = first; count <= last; ++count)
+        {
+            const RunResult result = run(scenario, count, options);
+            printRun(scenario, result);
+            runs.append(runJson(result));
+            if (!result.sustained)
+                break;
+            maxSustained = count;
+        }
+        if (sweep)
+            std::printf("%-8s max sources at zero drops: %d\n", qPrintable(scenario.name), maxSustained);
+
+        QJsonObject object;
+        object["name"] = scenario.name;
+        object["width"] = scenario.width;
+        object["height"] = scenario.height;
+        object["fps"] = scenario.fps;
+        object["format"] = options.format;
+        object["maxSourcesAtZeroDrops"] = maxSustained;
+        object["runs"] = runs;
+        scenarioResults.append(object);
+    }
+
+    if (parser.isSet(jsonOption))
+    {
+        QJsonObject root;
+        root["cores"] = QThread::idealThreadCount();
+        root["cpuBudget"] = CpuBudget::instance().totalCores();
+        root["profile"] = options.profile;
+        root["output"] = options.output;
+        root["seconds"] = options.seconds;
+        root["warmupSeconds"] = options.warmup;
+        root["scenarios"] = scenarioResults;
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "DaemonConfig.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPair>
+
+namespace
+{
+template <typename Enum>
+bool readEnum(const QJsonObject &object, const char *key, const QVector<QPair<QString, Enum>> &names, Enum &value, QString &error)
+{
+    if (!object.contains(key))
+        return true;
+    const QString text = object.value(key).toString();
+    for (const auto &name : names)
+    {
+        if (name.first.compare(text, Qt::CaseInsensitive) == 0)
+        {
+            value = name.second;
+            return true;
+        }
+    }
+    error = QString("Unknown %1 \"%2\"").arg(key, text);
+    return false;
+}
+
+bool readEncoder(const QJsonObject &object, EncoderProfile &profile, QString &error)
+{
+    if (object.contains("profile"))
+    {
+        const QString name = object.value("profile").toString();
+        profile = EncoderProfile::named(name);
+        if (profile.name != name)
+        {
+            error = QString("Unknown encoder profile \"%1\"").arg(name);
+            return false;
+        }
+    }
+    const EncoderProfile preset = profile;
+    profile.preset = object.value("preset").toString(profile.preset);
+    profile.tune = object.value("tune").toString(profile.tune);
+    profile.crf = object.value("crf").toInt(profile.crf);
+    profile.bitrateKbps = object.value("bitrateKbps").toInt(profile.bitrateKbps);
+    profile.gopSeconds = object.value("gopSeconds").toDouble(profile.gopSeconds);
+    profile.bFrames = object.value("bFrames").toInt(profile.bFrames);
+    profile.threads = object.value("threads").toInt(profile.threads);
+    if (!readEnum(object, "rateControl", {{"crf", RateControl::Crf}, {"cbr", RateControl::Cbr}, {"vbr", RateControl::Vbr}},
+                  profile.rateControl, error) ||
+        !readEnum(object, "threading", {{"frame", EncoderThreading::Frame}, {"slice", EncoderThreading::Slice}}, profile.threading, error))
+        return false;
+    if (!profile.sameSettings(preset))
+        profile.name = "Custom";
+    return true;
+}
+
+bool readLog(const QJsonObject &object, LogOptions &options, QString &error)
+{
+    options.path = object.value("path").toString(options.path);
+    options.jsonLines = object.value("json").toBool(options.jsonLines);
+    options.maxBytes = static_cast<qint64>(object.value("maxSizeMb").toDouble(options.maxBytes / (1024.0 * 1024.0)) * 1024 * 1024);
+    options.keepFiles = object.value("keepFiles").toInt(options.keepFiles);
+    return readEnum(object, "level",
+                    {{"debug", LogLevel::Debug}, {"info", LogLevel::Info}, {"warning", LogLevel::Warning}, {"error", LogLevel::Error}},
+                    options.level, error);
+}
+
+bool readStorage(const QJsonObject &object, StorageOptions &options, QString &error)
+{
+    options.fallbackFolder = object.value("fallbackFolder").toString(options.fallbackFolder);
+    options.warnMinutes = object.value("warnMinutes").toInt(options.warnMinutes);
+    options.actMinutes = object.value("actMinutes").toInt(options.actMinutes);
+    options.minFreeBytes = static_cast<qint64>(object.value("minFreeGb").toDouble(options.minFreeBytes / (1024.0 * 1024.0 * 1024.0)) * 1024 * 1024 * 1024);
+    return readEnum(object, "policy",
+                    {{"warn", StoragePolicy::Warn},
+                     {"lowerBitrate", StoragePolicy::LowerBitrate},
+                     {"fallback", StoragePolicy::Fallback},
+                     {"stopLowest", StoragePolicy::StopLowest}},
+                    options.policy, error);
+}
+
+bool readSource(const QJsonObject &object, SourceSettings &settings, QString &error)
+{
+    settings.ndiSource = object.value("ndiSource").toString(settings.ndiSource);
+    settings.outputFolder = object.value("outputFolder").toString(settings.outputFolder);
+    settings.label = object.value("label").toString(settings.label);
+    settings.segmented = object.value("segmented").toBool(settings.segmented);
+    settings.segmentMinutes = object.value("segmentMinutes").toInt(settings.segmentMinutes);
+    settings.queueDepth = object.value("queueDepth").toInt(settings.queueDepth);
+    settings.constantFrameRate = object.value("constantFrameRate").toBool(settings.constantFrameRate);
+    settings.conversionSlices = object.value("conversionSlices").toInt(settings.conversionSlices);
+    settings.fragmentSeconds = object.value("fragmentSeconds").toInt(settings.fragmentSeconds);
+    settings.priority = object.value("priority").toInt(settings.priority);
+    settings.discardOutput = object.value("discardOutput").toBool(settings.discardOutput);
+    settings.previewFps = object.value("previewFps").toInt(settings.previewFps);
+    settings.preRollSeconds = object.value("preRollSeconds").toInt(settings.preRollSeconds);
+    settings.replaySeconds = object.value("replaySeconds").toInt(settings.replaySeconds);
+    settings.ringMaxMb = object.value("ringMaxMb").toInt(settings.ringMaxMb);
+    if (!readEnum(object, "overflowPolicy",
+                  {{"dropOldest", OverflowPolicy::DropOldest}, {"dropNewest", OverflowPolicy::DropNewest}, {"block", OverflowPolicy::Block}},
+                  settings.overflowPolicy, error) ||
+        !readEnum(object, "colorFormat",
+                  {{"uyvyBgra", NdiColorFormat::UyvyBgra}, {"fastest", NdiColorFormat::Fastest}, {"rgba", NdiColorFormat::Rgba}},
+                  settings.colorFormat, error) ||
+        !readEnum(object, "audioCodec", {{"aac", AudioCodec::Aac}, {"pcm", AudioCodec::Pcm}, {"none", AudioCodec::None}},
+                  settings.audioCodec, error) ||
+        !readEnum(object, "container",
+                  {{"mp4", ContainerMode::Mp4}, {"fragmentedMp4", ContainerMode::FragmentedMp4}, {"matroska", ContainerMode::Matroska}},
+                  settings.container, error))
+        return false;
+    if (object.contains("encoder") && !readEncoder(object.value("encoder").toObject(), settings.encoder, error))
+        return false;
+    if (object.contains("renditions"))
+        settings.renditions.clear();
+    for (const QJsonValue &value : object.value("renditions").toArray())
+    {
+        const QJsonObject rendition = value.toObject();
+        RenditionConfig config;
+        config.height = rendition.value("height").toInt(config.height);
+        config.bitrateKbps = rendition.value("bitrateKbps").toInt(config.bitrateKbps);
+        settings.renditions.append(config);
+    }
+    return true;
+}
+} // namespace
+
+bool DaemonConfig::load(const QString &path, DaemonConfig &config, QString &error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = QString("Cannot open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject())
+    {
+        error = QString("%1 is not a JSON object: %2").arg(path, parseError.errorString());
+        return false;
+    }
+
+    const QJsonObject root = document.object();
+    config = DaemonConfig();
+    config.cpuCores = root.value("cpuCores").toInt(config.cpuCores);
+    config.pinThreads = root.value("pinThreads").toBool(config.pinThreads);
+    config.discoverySeconds = root.value("discoverySeconds").toInt(config.discoverySeconds);
+    config.retrySeconds = root.value("retrySeconds").toInt(config.retrySeconds);
+    config.metrics = root.value("metrics").toString(config.metrics);
+    if (!readLog(root.value("log").toObject(), config.log, error) || !readStorage(root.value("storage").toObject(), config.storage, error))
+        return false;
+
+    SourceSettings defaults;
+    if (!readSource(root.value("defaults").toObject(), defaults, error))
+        return false;
+
+    const QJsonArray sources = root.value("sources").toArray();
+    for (int i = 0; i < sources.size(); ++i)
+    {
+        SourceSettings settings = defaults;
+        if (!readSource(sources.at(i).toObject(), settings, error))
+        {
+            error = QString("Source %1: %2").arg(i + 1).arg(error);
+            return false;
+        }
+        if (settings.ndiSource.isEmpty() || settings.outputFolder.isEmpty())
+        {
+            error = QString("Source %1 needs ndiSource and outputFolder").arg(i + 1);
+            return false;
+        }
+        config.sources.append(settings);
+    }
+    if (config.sources.isEmpty())
+    {
+        error = QString("%1 lists no sources").arg(path);
+        return false;
+    }
+    return true;
+}
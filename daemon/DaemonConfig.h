@@ -0,0 +1,38 @@
+#pragma once
+#include <QString>
+#include <QVector>
+#include "Logging.h"
+#include "SourceRecorder.h"
+#include "StorageMonitor.h"
+
+// Settings for the headless recorder, read from a JSON file:
+//
+// {
+//   "cpuCores": 0, "pinThreads": false, "discoverySeconds": 10, "retrySeconds": 10,
+//   "metrics": "127.0.0.1:9464",
+//   "log": { "path": "/var/log/ndi-recorder.log", "level": "info", "json": false, "maxSizeMb": 10, "keepFiles": 5 },
+//   "storage": { "policy": "fallback", "fallbackFolder": "/mnt/spare", "warnMinutes": 60, "actMinutes": 15, "minFreeGb": 2 },
+//   "defaults": { "outputFolder": "/srv/recordings", "segmented": true, "container": "fragmentedMp4" },
+//   "sources": [
+//     { "ndiSource": "HOST (Camera 1)", "label": "cam1",
+//       "encoder": { "profile": "Archive", "threads": 4 },
+//       "renditions": [ { "height": 540, "bitrateKbps": 0 } ] }
+//   ]
+// }
+//
+// Each source starts from "defaults"; any SourceSettings field can be given in
+// either place under its member name, with enums spelled as in the code
+// (e.g. "overflowPolicy": "dropNewest", "audioCodec": "pcm").
+struct DaemonConfig
+{
+    int cpuCores = 0;
+    bool pinThreads = false;
+    int discoverySeconds = 10; // wait for the NDI finder before the first start
+    int retrySeconds = 10;     // restart recorders whose source was missing or failed
+    QString metrics;           // MetricsServer address; empty to disable
+    LogOptions log;
+    StorageOptions storage;
+    QVector<SourceSettings> sources;
+
+    static bool load(const QString &path, DaemonConfig &config, QString &error);
+};
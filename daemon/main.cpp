@@ -0,0 +1,120 @@
+// Headless recorder: runs every source listed in a JSON config without a
+// desktop session or preview rendering, and finalizes files on SIGTERM/SIGINT.
+//
+// Usage: MultiNdiRecorderDaemon <config.json>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include "CpuBudget.h"
+#include "DaemonConfig.h"
+#include "FinalizationPool.h"
+#include "Logging.h"
+#include "MetricsServer.h"
+#include "SourceRecorder.h"
+#include "StorageMonitor.h"
+
+namespace
+{
+volatile std::sig_atomic_t g_stopRequested = 0;
+
+void requestStop(int)
+{
+    g_stopRequested = 1;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    if (args.size() != 2)
+    {
+        std::fprintf(stderr, "Usage: %s <config.json>\n", qPrintable(args.value(0)));
+        return 2;
+    }
+
+    DaemonConfig config;
+    QString error;
+    if (!DaemonConfig::load(args.at(1), config, error))
+    {
+        std::fprintf(stderr, "%s\n", qPrintable(error));
+        Logger::instance().log(LogLevel::Error, "Daemon config rejected: " + error);
+        return 1;
+    }
+    Logger::instance().configure(config.log);
+    Logger::instance().log(QString("Daemon started with %1 sources from %2").arg(config.sources.size()).arg(args.at(1)));
+
+    CpuBudget::instance().setTotalCores(config.cpuCores);
+    CpuBudget::instance().setPinning(config.pinThreads);
+    StorageMonitor::instance().setOptions(config.storage);
+
+    QVector<SourceRecorder *> recorders;
+    for (const SourceSettings &settings : config.sources)
+    {
+        SourceRecorder *recorder = new SourceRecorder(&app);
+        recorder->setPreviewEnabled(false);
+        recorder->applySettings(settings);
+        QObject::connect(recorder, &SourceRecorder::errorOccurred, &app,
+                         [label = recorder->settings().label](const QString &err) { Logger::instance().log(LogLevel::Warning, label + ": " + err); });
+        recorders.append(recorder);
+    }
+
+    MetricsServer metrics;
+    if (!config.metrics.isEmpty())
+    {
+        for (SourceRecorder *recorder : recorders)
+            metrics.addRecorder(recorder);
+        if (!metrics.start(config.metrics))
+            std::fprintf(stderr, "Cannot serve metrics on %s\n", qPrintable(config.metrics));
+    }
+
+    // The NDI finder needs a moment to see senders; start each source as soon
+    // as it shows up, then keep retrying ones that are missing or have failed.
+    QElapsedTimer sinceStart;
+    sinceStart.start();
+    QTimer startTimer;
+    auto startMissing = [&]() {
+        bool waiting = false;
+        for (SourceRecorder *recorder : recorders)
+        {
+            // One stopped for disk space or by a failed write would only
+            // leave another short file; it waits for an operator.
+            if (recorder->isRunning() || recorder->isFinalizing() || recorder->stoppedForStorage())
+                continue;
+            if (!FrameSource::isAvailable(recorder->settings().ndiSource) && sinceStart.elapsed() < config.discoverySeconds * 1000)
+            {
+                waiting = true;
+                continue;
+            }
+            recorder->stop();
+            recorder->start();
+        }
+        startTimer.setInterval(waiting ? 500 : std::max(1, config.retrySeconds) * 1000);
+    };
+    QObject::connect(&startTimer, &QTimer::timeout, &app, startMissing);
+    startTimer.start(0);
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    QTimer signalPoll;
+    QObject::connect(&signalPoll, &QTimer::timeout, &app, [&]() {
+        if (!g_stopRequested)
+            return;
+        signalPoll.stop();
+        startTimer.stop();
+        Logger::instance().log("Daemon stopping; finalizing recordings");
+        for (SourceRecorder *recorder : recorders)
+            recorder->stop();
+        FinalizationPool::instance().waitForAll();
+        app.quit();
+    });
+    signalPoll.start(100);
+
+    const int ret = app.exec();
+    metrics.stop();
+    Logger::instance().log("Daemon exit");
+    return ret;
+}
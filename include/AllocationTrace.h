@@ -0,0 +1,25 @@
+#pragma once
+
+// Marks calls into FFmpeg on the per-frame video path. Their heap use is
+// FFmpeg's own (every AVBufferRef, the encoder's packets, the muxer's
+// interleaving queue) and cannot be avoided through its API; AllocationBench
+// counts every allocation outside these scopes and expects none in steady
+// state. A thread-local depth, so a scope costs two increments.
+namespace AllocationTrace
+{
+inline thread_local int t_foreignDepth = 0;
+
+class ForeignScope
+{
+public:
+    ForeignScope() { ++t_foreignDepth; }
+    ~ForeignScope() { --t_foreignDepth; }
+    ForeignScope(const ForeignScope &) = delete;
+    ForeignScope &operator=(const ForeignScope &) = delete;
+};
+
+inline bool inForeignCode()
+{
+    return t_foreignDepth > 0;
+}
+} // namespace AllocationTrace
@@ -0,0 +1,137 @@
+#pragma once
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include "BoundedQueue.h"
+#include "LatencyHistogram.h"
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+class QThread;
+
+// Disk activity summed over every file of a recording.
+struct DiskWriteStats
+{
+    quint64 bytes = 0;  // reached the file
+    quint64 writes = 0; // write calls issued by the I/O thread
+    quint64 stalls = 0; // times the muxer had to wait for a free buffer
+    qint64 stallNs = 0;
+    LatencyHistogram::Snapshot writeTime; // per write call
+};
+
+class DiskWriteCounters
+{
+public:
+    void reset()
+    {
+        m_bytes = 0;
+        m_writes = 0;
+        m_stalls = 0;
+        m_stallNs = 0;
+        m_writeTime.reset();
+    }
+
+    DiskWriteStats snapshot() const
+    {
+        DiskWriteStats stats;
+        stats.bytes = m_bytes.load(std::memory_order_relaxed);
+        stats.writes = m_writes.load(std::memory_order_relaxed);
+        stats.stalls = m_stalls.load(std::memory_order_relaxed);
+        stats.stallNs = m_stallNs.load(std::memory_order_relaxed);
+        stats.writeTime = m_writeTime.snapshot();
+        return stats;
+    }
+
+private:
+    friend class AsyncFileWriter;
+    std::atomic<quint64> m_bytes{0};
+    std::atomic<quint64> m_writes{0};
+    std::atomic<quint64> m_stalls{0};
+    std::atomic<qint64> m_stallNs{0};
+    LatencyHistogram m_writeTime;
+};
+
+// Output file behind a custom AVIOContext. The muxer's writes are copied
+// into a ring of large buffers and a dedicated thread writes each full buffer
+// with one call, so the encode thread never waits on the disk unless the whole
+// ring is in flight. Each buffer carries its file offset, which lets the MP4
+// trailer seek back and patch the header without draining the ring first.
+// Space is reserved ahead of the write position and released again at close.
+class AsyncFileWriter
+{
+public:
+    struct Options
+    {
+        int bufferBytes = 8 * 1024 * 1024; // whole ring
+        int chunkBytes = 1024 * 1024;      // one write call
+        // Reserved beyond the write position whenever it runs out; 0 disables.
+        qint64 preallocateBytes = 0;
+        // A partly filled buffer older than this is written anyway, so
+        // fragments reach the OS at about the rate the muxer produces them.
+        int maxHoldMs = 1000;
+    };
+
+    explicit AsyncFileWriter(DiskWriteCounters *counters = nullptr);
+    ~AsyncFileWriter();
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    bool open(const QString &path, const Options &options);
+    // Valid between open() and close(); the muxer's pb.
+    AVIOContext *avio() const { return m_avio; }
+    // Flushes the AVIO buffer and the ring, waits for the I/O thread and
+    // trims the reservation. Returns false if any write failed.
+    bool close();
+    bool failed() const { return m_failed.load(std::memory_order_acquire); }
+
+private:
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    using AvioWriteBuffer = const uint8_t *;
+#else
+    using AvioWriteBuffer = uint8_t *;
+#endif
+    struct Chunk
+    {
+        uint8_t *data = nullptr;
+        int used = 0;
+        qint64 offset = 0;
+    };
+    static constexpr int AvioBufferSize = 256 * 1024;
+
+    static int writeCallback(void *opaque, AvioWriteBuffer buf, int size);
+    static int64_t seekCallback(void *opaque, int64_t offset, int whence);
+    int write(const uint8_t *data, int size);
+    int64_t seek(int64_t offset, int whence);
+    bool acquireChunk();
+    void submitChunk();
+    void ioThreadFunc();
+    bool writeChunk(const Chunk &chunk);
+    void reserve(qint64 end);
+    void releaseBuffers();
+
+    DiskWriteCounters *m_counters;
+    QFile m_file;
+    AVIOContext *m_avio = nullptr;
+    Options m_options;
+    QVector<Chunk> m_chunks;
+    BoundedQueue<int> m_filled;
+    BoundedQueue<int> m_empty;
+    QThread *m_ioThread = nullptr;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<bool> m_failed{false};
+    // Muxer side.
+    int m_current = -1;
+    qint64 m_currentStartNs = 0;
+    qint64 m_position = 0;
+    qint64 m_size = 0;
+    // I/O thread side.
+    qint64 m_reservedEnd = 0;
+    bool m_reserveFailed = false;
+    // This file only, for the summary logged at close.
+    std::atomic<quint64> m_fileBytes{0};
+    std::atomic<quint64> m_fileWrites{0};
+    quint64 m_fileStalls = 0;
+    LatencyHistogram m_fileWriteTime;
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+enum class OverflowPolicy
+{
+    DropOldest,
+    DropNewest,
+    Block
+};
+
+// Bounded lock-free ring with per-cell sequence numbers. Frame queues use it
+// with a single producer and a single consumer, but pushes and pops are both
+// safe from any thread: the producer can evict the oldest entry itself when
+// the ring is full, and the logger queues from every thread.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity = 8) { reset(capacity); }
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // Only call while no other thread touches the queue.
+    void reset(size_t capacity)
+    {
+        m_capacity = capacity < 2 ? 2 : capacity;
+        m_cells.reset(new Cell[m_capacity]);
+        for (size_t i = 0; i < m_capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_accepted.store(0, std::memory_order_relaxed);
+        m_droppedOldest.store(0, std::memory_order_relaxed);
+        m_droppedNewest.store(0, std::memory_order_relaxed);
+        m_blockedPushes.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    bool tryPush(T &item)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = m_cells[pos % m_capacity];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    m_pushEvents.fetch_add(1, std::memory_order_release);
+                    m_pushEvents.notify_one();
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T &item)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = m_cells[pos % m_capacity];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.value);
+                    cell.sequence.store(pos + m_capacity, std::memory_order_release);
+                    m_popEvents.fetch_add(1, std::memory_order_release);
+                    m_popEvents.notify_one();
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Applies the overflow policy. Items evicted or rejected are handed to
+    // discard(); Block keeps retrying while keepWaiting() returns true.
+    template <typename Discard, typename KeepWaiting>
+    bool push(T &item, OverflowPolicy policy, Discard &&discard, KeepWaiting &&keepWaiting)
+    {
+        if (tryPush(item))
+        {
+            m_accepted.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        switch (policy)
+        {
+        case OverflowPolicy::DropNewest:
+            m_droppedNewest.fetch_add(1, std::memory_order_relaxed);
+            discard(item);
+            return false;
+        case OverflowPolicy::DropOldest:
+            for (;;)
+            {
+                T oldest;
+                if (tryPop(oldest))
+                {
+                    m_droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                    discard(oldest);
+                }
+                if (tryPush(item))
+                {
+                    m_accepted.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        case OverflowPolicy::Block:
+            m_blockedPushes.fetch_add(1, std::memory_order_relaxed);
+            for (;;)
+            {
+                const uint32_t seen = popEvents();
+                if (tryPush(item))
+                {
+                    m_accepted.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                if (!keepWaiting())
+                {
+                    m_droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                    discard(item);
+                    return false;
+                }
+                waitPopEvent(seen);
+            }
+        }
+        return false;
+    }
+
+    // Blocking helpers: read the event counter, retry the operation, then wait
+    // on the value read so a concurrent push/pop or wake() is never missed.
+    uint32_t pushEvents() const { return m_pushEvents.load(std::memory_order_acquire); }
+    uint32_t popEvents() const { return m_popEvents.load(std::memory_order_acquire); }
+    void waitPushEvent(uint32_t seen) const { m_pushEvents.wait(seen, std::memory_order_acquire); }
+    void waitPopEvent(uint32_t seen) const { m_popEvents.wait(seen, std::memory_order_acquire); }
+
+    void wakeAll()
+    {
+        m_pushEvents.fetch_add(1, std::memory_order_release);
+        m_pushEvents.notify_all();
+        m_popEvents.fetch_add(1, std::memory_order_release);
+        m_popEvents.notify_all();
+    }
+
+    uint64_t accepted() const { return m_accepted.load(std::memory_order_relaxed); }
+    uint64_t droppedOldest() const { return m_droppedOldest.load(std::memory_order_relaxed); }
+    uint64_t droppedNewest() const { return m_droppedNewest.load(std::memory_order_relaxed); }
+    uint64_t blockedPushes() const { return m_blockedPushes.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_capacity = 0;
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) std::atomic<uint32_t> m_pushEvents{0};
+    std::atomic<uint32_t> m_popEvents{0};
+    std::atomic<uint64_t> m_accepted{0};
+    std::atomic<uint64_t> m_droppedOldest{0};
+    std::atomic<uint64_t> m_droppedNewest{0};
+    std::atomic<uint64_t> m_blockedPushes{0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Colour conversion kernels for the encoder input path. Every SIMD variant is
+// bit-exact with the scalar code; the widest one the CPU supports is picked on
+// first use.
+namespace ColorConvert
+{
+enum class Matrix
+{
+    Bt601,
+    Bt709
+};
+
+enum class Isa
+{
+    Scalar,
+    Sse2,
+    Avx2,
+    Avx512
+};
+
+Isa detectIsa();
+Isa activeIsa();
+// Caps the kernels at the given level (benchmarks, reference checks); returns
+// the level actually in use, which never exceeds detectIsa().
+Isa setIsa(Isa isa);
+const char *isaName(Isa isa);
+
+// Limited-range 4:2:0 from 8-bit packed RGB. The fourth byte is ignored, so
+// RGBX/BGRX work as well.
+void rgbaToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV,
+                int strideV, int width, int height, Matrix matrix);
+void bgraToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV,
+                int strideV, int width, int height, Matrix matrix);
+
+// 4:2:2 to 4:2:0 by averaging vertically adjacent chroma samples.
+void uyvyToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV,
+                int strideV, int width, int height);
+void uyvyToNv12(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstUV, int strideUV, int width,
+                int height);
+
+// Box-filter downscale by an integer factor (1..MaxPreviewFactor) to 8-bit
+// RGBX (QImage::Format_RGBX8888), for previews. The output is width / factor
+// by height / factor; leftover source columns and rows are ignored. scratch is
+// grown as needed and can be kept between calls.
+constexpr int MaxPreviewFactor = 64;
+void uyvyToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       Matrix matrix, std::vector<uint16_t> &scratch);
+void rgbaToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       std::vector<uint16_t> &scratch);
+void bgraToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       std::vector<uint16_t> &scratch);
+} // namespace ColorConvert
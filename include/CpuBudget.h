@@ -0,0 +1,52 @@
+#pragma once
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Process-wide split of CPU cores between running recorders. A few cores are
+// set aside for capture and the rest are shared out as encoder thread budgets;
+// with pinning on, capture and encode threads are confined to those disjoint
+// core sets. Every source start or stop rebalances the split.
+class CpuBudget
+{
+public:
+    struct Allocation
+    {
+        QString label;
+        int encoderThreads = 1;
+        quint64 captureCores = 0; // affinity masks, zero when pinning is off
+        quint64 encoderCores = 0;
+    };
+
+    static CpuBudget &instance();
+
+    // Zero uses every core the machine reports.
+    void setTotalCores(int cores);
+    int totalCores() const;
+    void setPinning(bool enabled);
+    bool pinning() const;
+
+    int acquire(const QString &label);
+    void release(int id);
+    Allocation allocation(int id) const;
+    QString summary() const;
+    // Bumped on every rebalance so threads can re-pin without taking the lock.
+    quint32 generation() const { return m_generation.load(std::memory_order_acquire); }
+
+    static bool pinCurrentThread(quint64 cores);
+
+private:
+    CpuBudget() = default;
+    int usableCores() const;
+    void rebalance();
+
+    mutable QMutex m_mutex;
+    QMap<int, Allocation> m_allocations;
+    int m_nextId = 1;
+    int m_totalCores = 0;
+    bool m_pinning = false;
+    int m_captureCoreCount = 0;
+    std::atomic<quint32> m_generation{0};
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+enum class RateControl
+{
+    Crf,
+    Cbr,
+    Vbr // average bitrate with a 1.5x peak cap
+};
+
+enum class EncoderThreading
+{
+    Frame, // higher throughput, adds a frame of latency per thread
+    Slice
+};
+
+// H.264 encoder settings for one source. The named presets cover the common
+// cases; anything edited by hand is reported as "Custom".
+struct EncoderProfile
+{
+    QString name = "Balanced";
+    QString preset = "veryfast";
+    QString tune; // empty for none
+    RateControl rateControl = RateControl::Crf;
+    int crf = 21;
+    int bitrateKbps = 12000;
+    double gopSeconds = 2.0;
+    int bFrames = 2;
+    int threads = 0; // 0 lets the encoder decide
+    EncoderThreading threading = EncoderThreading::Frame;
+
+    bool sameSettings(const EncoderProfile &other) const;
+
+    static QVector<EncoderProfile> presets();
+    static EncoderProfile named(const QString &name);
+    static QStringList x264Presets();
+    static QStringList x264Tunes();
+};
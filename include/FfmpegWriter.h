@@ -2,13 +2,50 @@
 #include <QString>
 #include <QMutex>
 #include <QDateTime>
+#include <QAtomicInteger>
+#include <QThread>
+#include <QVector>
+#include <atomic>
 #include <functional>
+#include "AsyncFileWriter.h"
+#include "ColorConvert.h"
+#include "EncoderProfile.h"
+#include "LatencyHistogram.h"
+#include "Logging.h"
+#include "PacketRing.h"
+#include "PicturePool.h"
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+#include <libavutil/audio_fifo.h>
 }
 
+enum class AudioCodec
+{
+    Aac,
+    Pcm, // 16-bit PCM in a MOV container
+    None
+};
+
+// Plain MP4 (MOV with PCM audio) only becomes playable once the trailer is
+// written. Fragmented MP4 and Matroska write self-contained fragments or
+// clusters as they go, so a crash loses at most the one being built.
+enum class ContainerMode
+{
+    Mp4,
+    FragmentedMp4,
+    Matroska
+};
+
+// A lower-resolution encode of the same frames, e.g. an editing proxy.
+struct RenditionConfig
+{
+    int height = 540;
+    int bitrateKbps = 0; // 0 scales the master's bitrate by the pixel count
+};
+
 struct RecordingConfig
 {
     QString outputFolder;
@@ -22,6 +59,74 @@ struct RecordingConfig
     int fpsDen = 1;
     AVPixelFormat inputPixFmt = AV_PIX_FMT_RGBA;
     AVPixelFormat outputPixFmt = AV_PIX_FMT_YUV420P;
+    // CFR places frames on the nominal frame grid by timestamp, repeating or
+    // dropping pictures as needed; otherwise timestamps are written as-is.
+    bool constantFrameRate = true;
+    // Horizontal slices converted in parallel per frame; 0 picks from resolution.
+    int conversionSlices = 0;
+    EncoderProfile encoder;
+    // NDI audio is resampled and remixed to this format before encoding.
+    AudioCodec audioCodec = AudioCodec::Aac;
+    int audioSampleRate = 48000;
+    int audioChannels = 2;
+    ContainerMode container = ContainerMode::Mp4;
+    // Fragment (fMP4) or cluster (MKV) length; 0 cuts fMP4 at every keyframe
+    // and leaves MKV at the muxer's default.
+    int fragmentSeconds = 2;
+    // Output goes through a ring of this many MB drained by an I/O thread.
+    int writeBufferMb = 8;
+    // Reserve disk space ahead of the writes, sized from the bitrate setting.
+    bool preallocate = true;
+    // Muxes into FFmpeg's null format instead of files, for benchmarking.
+    bool discardOutput = false;
+    // Above 0 the writer starts armed: it encodes into an in-memory ring of at
+    // least this many seconds and opens no file until commitPreRoll().
+    int preRollSeconds = 0;
+    // Seconds kept in the ring while recording, for copyRecent(); 0 drops it.
+    int replaySeconds = 0;
+    int ringMaxMb = 256; // ring cap; older GOPs are dropped to stay under it
+    // Each is encoded from the master's converted picture, scaled down from
+    // the next larger rendition, into its own files named with a _<height>p
+    // suffix. They start with the first file (after the pre-roll when armed)
+    // and share the master's audio packets and segment boundaries.
+    QVector<RenditionConfig> renditions;
+};
+
+// Encoded packets held in memory for the pre-roll or replay clips.
+struct PacketRingStats
+{
+    qint64 bytes = 0;
+    qint64 maxBytes = 0;
+    qint64 durationMs = 0;
+};
+
+// Packets cut from the ring with their own copy of the stream parameters, so
+// they stay valid after the writer moves on or stops.
+struct ClipPackets
+{
+    ClipPackets() = default;
+    ~ClipPackets();
+    ClipPackets(const ClipPackets &) = delete;
+    ClipPackets &operator=(const ClipPackets &) = delete;
+
+    const char *format = "mp4";
+    AVCodecParameters *videoPar = nullptr;
+    AVRational videoTimeBase{1, 1};
+    AVRational frameRate{30, 1};
+    AVCodecParameters *audioPar = nullptr;
+    AVRational audioTimeBase{1, 1};
+    QVector<AVPacket *> video;
+    QVector<AVPacket *> audio;
+    int64_t startPts = AV_NOPTS_VALUE; // the first video keyframe
+    qint64 durationMs = 0;
+};
+
+// Per-frame time spent in each writer stage.
+struct WriterLatency
+{
+    LatencyHistogram::Snapshot convert; // conversion into the encoder format
+    LatencyHistogram::Snapshot encode;  // avcodec_send_frame and receive_packet
+    LatencyHistogram::Snapshot mux;     // per video packet
 };
 
 class FfmpegWriter
@@ -30,32 +135,212 @@ public:
     FfmpegWriter();
     ~FfmpegWriter();
 
+    // Input frame pts are in 100 ns units, the NDI timestamp clock.
+    static constexpr AVRational InputTimeBase = {1, 10000000};
+
     bool start(const RecordingConfig &cfg);
     void stop();
+    // Segments roll over inside writeVideoFrame on the encoder clock.
     bool writeVideoFrame(AVFrame *frame);
-    bool needsRollover();
-    void rollover();
+    // True if a frame of this layout is encoded straight from its own buffer,
+    // which then needs frame->buf[0] set; any other frame is converted before
+    // writeVideoFrame returns and needs no buffer reference. Same thread as
+    // writeVideoFrame.
+    bool passesThrough(AVPixelFormat format, int width, int height) const;
+    // Planar float samples stamped on the same 100 ns clock as video; may be
+    // called from a different thread than writeVideoFrame.
+    bool writeAudio(const uint8_t *const *planes, int channels, int samples, int sampleRate, int64_t timestamp);
 
-    QString currentFile() const { return m_currentFile; }
+    QString currentFile() const;
     AVRational videoTimeBase() const;
+    quint64 duplicatedFrames() const { return m_duplicatedFrames; }
+    quint64 droppedFrames() const { return m_droppedFrames; }
+    // Encoder pictures allocated since start; flat once recording reaches steady state.
+    quint64 bufferAllocations() const { return m_pictures.allocations(); }
+    quint64 audioResyncs() const { return m_audioResyncs; }
+    // Packet payload handed to the muxer, all streams and segments.
+    quint64 bytesWritten() const { return m_bytesWritten; }
+    WriterLatency latency() const;
+    DiskWriteStats diskStats() const { return m_diskCounters.snapshot(); }
+    // True once a write to the current file has failed, e.g. on a full disk.
+    bool outputFailed() const;
+    // Multiplies the profile's bitrate (CBR/VBR) or raises CRF to match; takes
+    // effect from the next frame and lasts until changed or restarted.
+    void setBitrateScale(double scale) { m_bitrateScale.store(scale, std::memory_order_relaxed); }
+    // Continues the recording in another folder from the next frame: the
+    // current file ends on a forced IDR and the same segment name carries on
+    // there. Safe from any thread.
+    void setOutputFolder(const QString &folder);
+    bool isArmed() const { return m_armed.load(std::memory_order_acquire); }
+    // Opens the first file at the oldest buffered keyframe on the next video
+    // frame, writes the ring into it and carries on live. Safe from any
+    // thread, also before start(); waits for a keyframe if none is buffered.
+    void commitPreRoll() { m_commitRequested.store(true, std::memory_order_release); }
+    PacketRingStats ringStats() const;
+    // Copies references to the last `seconds` of packets, from the keyframe at
+    // or before that point, taking the mux lock once per packet. False if
+    // nothing is buffered or replay is off.
+    bool copyRecent(int seconds, ClipPackets &clip) const;
+    // Remuxes a clip into a new file without decoding; any thread. Consumes
+    // the packets.
+    static bool writeClip(ClipPackets &clip, const QString &path);
 
 private:
-    bool openContext(const QString &path);
-    void closeContext();
-    QString nextFileName();
-    bool ensureConvertedFrame();
+    struct MuxerSetup
+    {
+        const char *format = "mp4";
+        const AVCodecParameters *videoPar = nullptr;
+        AVRational videoTimeBase{1, 1};
+        AVRational frameRate{30, 1};
+        const AVCodecParameters *audioPar = nullptr;
+        AVRational audioTimeBase{1, 1};
+        ContainerMode container = ContainerMode::Mp4;
+        int fragmentSeconds = 0;
+        AsyncFileWriter::Options file;
+        DiskWriteCounters *diskCounters = nullptr;
+    };
+
+    // One output file. startPts/endPts bound its segment on the video encoder clock.
+    struct Muxer
+    {
+        AVFormatContext *fmtCtx = nullptr;
+        AVStream *videoStream = nullptr;
+        AVStream *audioStream = nullptr;
+        AsyncFileWriter *file = nullptr;
+        QString path;
+        bool headerWritten = false;
+        int64_t startPts = 0;
+        int64_t endPts = AV_NOPTS_VALUE;
+    };
+
+    static constexpr int MaxPooledFrames = 16;
+    static constexpr int MaxHeldAudioPackets = 256;
+    static constexpr int MaxFillSeconds = 5; // CFR repeats per input gap
+
+    bool openEncoder();
+    void closeEncoder();
+    void flushEncoder();
+    bool openAudioEncoder();
+    void closeAudioEncoder();
+    void flushAudio();
+    bool encodeAudioFrame(int samples);
+    bool encodeAudio(AVFrame *frame);
+    void writeAudioPacket(AVPacket *pkt);
+    const char *containerName() const;
+    const char *fileExtension() const;
+    bool containerNeedsGlobalHeader() const;
+    static bool openMuxer(Muxer &muxer, const QString &path, const MuxerSetup &setup);
+    // False if any write to the file failed.
+    static bool closeMuxer(Muxer &muxer);
+    bool writePacket(Muxer &muxer, AVStream *stream, AVPacket *pkt, AVRational timeBase, int64_t startPts);
+    static bool muxPacket(Muxer &muxer, AVStream *stream, AVPacket *pkt, AVRational timeBase, int64_t startPts);
+    // Hands both lists to the writers merged by decode time, so the muxer
+    // need not queue a whole stream.
+    static bool interleave(const QVector<AVPacket *> &video, AVRational videoTimeBase, const QVector<AVPacket *> &audio,
+                           AVRational audioTimeBase, const std::function<bool(AVPacket *)> &writeVideo,
+                           const std::function<bool(AVPacket *)> &writeAudio);
+    void prepareNextMuxer();
+    void discardPreparedMuxer();
+    bool switchMuxer(int64_t boundaryPts, bool sameSegment);
+    void retireMuxer(Muxer &muxer);
+    void reapRetiredMuxers(bool wait);
+    QString fileNameForSegment(int index) const;
+    bool createFramePool();
+    bool acquireConvertedFrame();
+    static bool canConvertDirect(AVPixelFormat srcFormat, AVPixelFormat dstFormat);
+    static void offsetPlanes(AVPixelFormat format, uint8_t *const data[4], const int linesize[4], int row, uint8_t *out[4]);
+    void sliceRows(int slice, int height, int &first, int &last) const;
+    SwsContext *createScaler(const AVFrame *src, int srcHeight, int dstHeight) const;
+    void releaseScalers();
+    bool convertFrame(const AVFrame *frame);
+    bool convertDirect(const AVFrame *src, AVFrame *dst, int firstRow, int lastRow);
+    void applyBitrateScale(double scale);
+    // repeat: the same picture as the previous call, re-sent for CFR.
+    bool encodeFrame(AVFrame *frame, bool repeat = false);
+    void startRenditions(int64_t firstPts);
+    void stopRendition(FfmpegWriter *rendition);
+    bool startRendition(FfmpegWriter &master, const RenditionConfig &rendition, int64_t firstPts);
+    bool encodeRendition(const AVFrame *source, int64_t pts, bool repeat);
+    void writeRenditionAudio(const AVPacket *pkt);
+    bool drainPackets(qint64 *muxNs = nullptr);
+    bool flushPreRoll(int64_t currentPts);
+    void keepRecent(const AVPacket *pkt, bool video);
+    void updateRingStats();
 
     RecordingConfig m_cfg;
-    AVFormatContext *m_fmtCtx;
-    AVStream *m_videoStream;
     AVCodecContext *m_videoCodecCtx;
+    AVCodecParameters *m_codecPar;
+    MuxerSetup m_muxerSetup;
+    Muxer m_muxer;
+    Muxer m_nextMuxer;
+    Muxer m_retiringMuxer;
+    QVector<AVPacket *> m_heldAudio;
+    QThread *m_prepareThread;
+    QVector<QThread *> m_retiringThreads;
     SwsContext *m_sws;
-    AVFrame *m_convertedFrame;
-    qint64 m_startMs;
+    QVector<SwsContext *> m_sliceSws;
+    PicturePool m_pictures;
+    AVFrame *m_passThroughFrame; // references the last source frame encoded as-is
+    AVFrame *m_convertedFrame;   // the picture last sent to the encoder; not owned
+    QDateTime m_recordingStart;
     QString m_currentFile;
+    QString m_pendingFolder;
+    mutable QMutex m_fileMutex; // only guards m_currentFile and m_pendingFolder, for other threads
     QMutex m_mutex;
+    QMutex m_audioMutex;
+    mutable QMutex m_muxMutex;
     int m_segmentIndex;
     int m_inputWidth;
     int m_inputHeight;
     AVPixelFormat m_inputFormat;
+    ColorConvert::Matrix m_colorMatrix;
+    int m_slices;
+    std::atomic<int64_t> m_firstInputPts;
+    int64_t m_nextPts;
+    int64_t m_frameDuration;
+    int64_t m_segmentLength;
+    int64_t m_segmentOrigin = 0; // pts the first file starts at; later than 0 after a pre-roll
+    int64_t m_nextBoundaryPts;
+    int64_t m_pendingBoundaryPts;
+    bool m_pendingFolderSwitch = false;
+    std::atomic<double> m_bitrateScale{1.0};
+    double m_appliedBitrateScale = 1.0;
+    // Recent packets: the pre-roll while armed, the replay window after.
+    // Guarded by m_muxMutex, like m_keepRecent.
+    PacketRing m_recent;
+    bool m_keepRecent = false;
+    std::atomic<bool> m_armed{false};
+    std::atomic<bool> m_commitRequested{false};
+    std::atomic<qint64> m_ringBytes{0};
+    std::atomic<qint64> m_ringMs{0};
+    std::atomic<qint64> m_ringMaxBytes{0};
+    // Largest first. Changed on the video thread under m_muxMutex, which the
+    // audio thread holds to pass them its packets.
+    QVector<FfmpegWriter *> m_renditions;
+    // Set on a rendition: the writer that feeds it and counts its bytes.
+    FfmpegWriter *m_master = nullptr;
+    QString m_fileSuffix;
+    int64_t m_firstPts = 0;
+    AVCodecContext *m_audioCodecCtx;
+    AVCodecParameters *m_audioPar;
+    SwrContext *m_swr;
+    AVAudioFifo *m_audioFifo;
+    AVFrame *m_audioFrame;
+    AVPacket *m_audioPacket;
+    uint8_t **m_audioData;
+    int m_audioDataSamples;
+    int m_audioInChannels;
+    int m_audioInRate;
+    int m_audioFrameSize;
+    int64_t m_audioFifoPts;
+    QAtomicInteger<quint64> m_duplicatedFrames;
+    QAtomicInteger<quint64> m_droppedFrames;
+    QAtomicInteger<quint64> m_audioResyncs;
+    QAtomicInteger<quint64> m_bytesWritten;
+    LogThrottle m_fillLog{10000};
+    LogThrottle m_heldAudioLog{10000};
+    LatencyHistogram m_convertTime;
+    LatencyHistogram m_encodeTime;
+    LatencyHistogram m_muxTime;
+    DiskWriteCounters m_diskCounters;
 };
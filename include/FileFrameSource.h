@@ -0,0 +1,35 @@
+#pragma once
+#include <QFile>
+#include "PacedFrameSource.h"
+
+// Replays a Y4M file, or a headerless raw file whose format comes from the
+// options, optionally looping.
+class FileFrameSource : public PacedFrameSource
+{
+public:
+    struct Options
+    {
+        QString path;
+        Format format{AV_PIX_FMT_UYVY422, 1920, 1080, 60, 1}; // raw files only
+        bool loop = true;
+        bool realtime = true;
+    };
+
+    explicit FileFrameSource(const Options &options);
+
+    bool open() override;
+
+protected:
+    bool renderFrame(qint64 index, VideoFrame &frame) override;
+
+private:
+    bool readY4mHeader(Format &format);
+    bool readFrame(uint8_t *buffer);
+
+    Options m_options;
+    QFile m_file;
+    bool m_y4m = false;
+    qint64 m_dataStart = 0;
+    int m_frameSize = 0;
+    qint64 m_framesInPass = 0;
+};
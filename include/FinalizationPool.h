@@ -0,0 +1,28 @@
+#pragma once
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+
+// Finishes stopped recordings off the caller's thread: draining the frame
+// queue, flushing the encoders and writing trailers. At most maxConcurrent()
+// recordings finalize at once and the rest wait their turn, so a Stop All
+// neither blocks the GUI nor starts every encoder flush at the same moment.
+// Replay clip exports queue here too.
+class FinalizationPool
+{
+public:
+    static FinalizationPool &instance();
+
+    void setMaxConcurrent(int count);
+    int maxConcurrent() const;
+    void submit(std::function<void()> job);
+    // Jobs queued or running.
+    int pending() const { return m_pending.load(std::memory_order_relaxed); }
+    void waitForAll();
+
+private:
+    FinalizationPool();
+
+    QThreadPool m_pool;
+    std::atomic<int> m_pending{0};
+};
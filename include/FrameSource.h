@@ -0,0 +1,83 @@
+#pragma once
+#include <QString>
+#include <memory>
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+enum class NdiColorFormat
+{
+    UyvyBgra, // UYVY, or BGRA when the source carries alpha
+    Fastest,
+    Rgba
+};
+
+enum class FrameType
+{
+    None, // nothing arrived within the timeout
+    Video,
+    Audio,
+    EndOfStream
+};
+
+// A picture owned by its FrameSource until releaseVideo(). `buffer` spans
+// every plane so the frame can be handed to the encoder by reference.
+struct VideoFrame
+{
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    int width = 0;
+    int height = 0;
+    uint8_t *data[4] = {};
+    int linesize[4] = {};
+    uint8_t *buffer = nullptr;
+    int bufferSize = 0;
+    int frameRateNum = 0;
+    int frameRateDen = 0;
+    qint64 timestamp = 0; // media time in 100 ns units
+    quintptr handle = 0;  // source-specific, for release
+};
+
+// Planar float audio, one plane every channelStride bytes.
+struct AudioFrame
+{
+    uint8_t *data = nullptr;
+    int channels = 0;
+    int samples = 0;
+    int sampleRate = 0;
+    int channelStride = 0;
+    qint64 timestamp = 0;
+    quintptr handle = 0;
+};
+
+// Counters kept by the source itself, e.g. the NDI receiver's own.
+struct SourceStats
+{
+    quint64 received = 0;
+    quint64 dropped = 0; // lost before capture() could deliver them
+    int queuedVideo = 0;
+    int queuedAudio = 0;
+};
+
+// Where a SourceRecorder gets its frames. capture() is called from the
+// capture thread only; the release calls may come from any thread, and the
+// source must outlive every frame it handed out.
+//
+// Plain names are NDI senders. Other sources are picked by URI:
+//   synthetic:?size=1920x1080&fps=60000/1001&format=uyvy&jitter=2&drop=0.01&realtime=1
+//   file:///data/clip.y4m?loop=1&realtime=0
+//   file:///data/clip.yuv?size=1920x1080&fps=50&format=uyvy
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+    virtual FrameType capture(VideoFrame &video, AudioFrame &audio, int timeoutMs) = 0;
+    virtual void releaseVideo(VideoFrame &video) = 0;
+    virtual void releaseAudio(AudioFrame &audio) = 0;
+    // Safe to call from any thread while the source exists.
+    virtual SourceStats stats() const { return SourceStats(); }
+
+    static std::unique_ptr<FrameSource> create(const QString &uri, NdiColorFormat colorFormat);
+    static bool isAvailable(const QString &uri);
+};
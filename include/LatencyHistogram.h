@@ -0,0 +1,136 @@
+#pragma once
+#include <QtGlobal>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+
+// Fixed-bucket histogram of durations in nanoseconds. Buckets are eight per
+// power of two (12.5% resolution) from 1 ns up to about 68 s. record() is a
+// few relaxed atomic adds and safe from any thread; readers take snapshots.
+class LatencyHistogram
+{
+public:
+    static constexpr int BucketCount = 272;
+
+    struct Snapshot
+    {
+        quint64 count = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        std::array<quint64, BucketCount> buckets{};
+
+        // Upper edge of the bucket holding the given fraction (0..1) of samples.
+        qint64 percentileNs(double fraction) const
+        {
+            if (!count)
+                return 0;
+            const quint64 target = static_cast<quint64>(fraction * (count - 1)) + 1;
+            quint64 seen = 0;
+            for (int i = 0; i < BucketCount; ++i)
+            {
+                seen += buckets[i];
+                if (seen >= target)
+                    return std::min(maxNs, bucketLowerBound(i + 1) - 1);
+            }
+            return maxNs;
+        }
+
+        // Samples in buckets that end at or below `ns`.
+        quint64 countAtMost(qint64 ns) const
+        {
+            quint64 total = 0;
+            for (int i = 0; i < BucketCount && bucketLowerBound(i + 1) - 1 <= ns; ++i)
+                total += buckets[i];
+            return total;
+        }
+
+        double meanNs() const { return count ? static_cast<double>(totalNs) / count : 0.0; }
+
+        // Samples recorded after `earlier` was taken; the maximum stays overall.
+        Snapshot since(const Snapshot &earlier) const
+        {
+            Snapshot delta = *this;
+            delta.count -= earlier.count;
+            delta.totalNs -= earlier.totalNs;
+            for (int i = 0; i < BucketCount; ++i)
+                delta.buckets[i] -= earlier.buckets[i];
+            return delta;
+        }
+
+        void merge(const Snapshot &other)
+        {
+            count += other.count;
+            totalNs += other.totalNs;
+            maxNs = std::max(maxNs, other.maxNs);
+            for (int i = 0; i < BucketCount; ++i)
+                buckets[i] += other.buckets[i];
+        }
+    };
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(qint64 ns)
+    {
+        if (ns < 0)
+            ns = 0;
+        m_buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_totalNs.fetch_add(ns, std::memory_order_relaxed);
+        qint64 max = m_maxNs.load(std::memory_order_relaxed);
+        while (ns > max && !m_maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Records the time since `startNs`, a value from now().
+    void recordSince(qint64 startNs) { record(now() - startNs); }
+
+    Snapshot snapshot() const
+    {
+        Snapshot snap;
+        snap.count = m_count.load(std::memory_order_relaxed);
+        snap.totalNs = m_totalNs.load(std::memory_order_relaxed);
+        snap.maxNs = m_maxNs.load(std::memory_order_relaxed);
+        for (int i = 0; i < BucketCount; ++i)
+            snap.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    // Only call while nothing records.
+    void reset()
+    {
+        for (auto &bucket : m_buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_totalNs.store(0, std::memory_order_relaxed);
+        m_maxNs.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static int bucketFor(qint64 ns)
+    {
+        if (ns < 8)
+            return static_cast<int>(ns);
+        const int octave = std::bit_width(static_cast<quint64>(ns)) - 1;
+        const int index = (octave - 2) * 8 + static_cast<int>((ns >> (octave - 3)) & 7);
+        return std::min(index, BucketCount - 1);
+    }
+
+    static qint64 bucketLowerBound(int index)
+    {
+        if (index < 8)
+            return index;
+        const int octave = index / 8 + 2;
+        return static_cast<qint64>(8 + index % 8) << (octave - 3);
+    }
+
+    std::array<std::atomic<quint64>, BucketCount> m_buckets{};
+    std::atomic<quint64> m_count{0};
+    std::atomic<qint64> m_totalNs{0};
+    std::atomic<qint64> m_maxNs{0};
+};
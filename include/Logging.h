@@ -4,17 +4,92 @@
 #include <QTextStream>
 #include <QMutex>
 #include <QDateTime>
+#include <atomic>
+#include "BoundedQueue.h"
 
+class QThread;
+
+enum class LogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+// Folds repeats of one message site: the first message of each interval is
+// written and later ones are only counted, then reported with the next one
+// that gets through. Keep one per site (and per source where it matters).
+class LogThrottle
+{
+public:
+    explicit LogThrottle(int intervalMs = 60000) : m_intervalNs(static_cast<qint64>(intervalMs) * 1000000) {}
+
+    // Messages the current one stands for (itself plus those suppressed
+    // since the last one written), or 0 if it should be skipped.
+    // sinceMs receives the time since the last written one, 0 for the first.
+    quint64 admit(qint64 &sinceMs);
+
+private:
+    const qint64 m_intervalNs;
+    std::atomic<qint64> m_lastNs{0};
+    std::atomic<quint64> m_suppressed{0};
+};
+
+struct LogOptions
+{
+    QString path = "logs/app.log";
+    LogLevel level = LogLevel::Info;
+    bool jsonLines = false;                 // one JSON object per line instead of text
+    qint64 maxBytes = 10 * 1024 * 1024;     // rotate when the file reaches this; 0 never
+    int keepFiles = 5;                      // rotated files kept as app.log.1 .. app.log.N
+};
+
+// Messages are queued lock-free and written by a background thread that
+// flushes once per batch, so log() never waits on the disk or on another
+// thread. If the queue is full the message is dropped and counted.
 class Logger
 {
 public:
     static Logger &instance();
-    void log(const QString &message);
+    ~Logger();
+
+    void log(const QString &message) { log(LogLevel::Info, message); }
+    void log(LogLevel level, const QString &message);
+    void log(LogThrottle &throttle, LogLevel level, const QString &message);
+
+    void configure(const LogOptions &options);
+    // Waits until everything logged so far is written.
+    void flush();
     QString logFilePath() const;
 
 private:
+    struct Entry
+    {
+        qint64 timeMs = 0;
+        LogLevel level = LogLevel::Info;
+        quintptr thread = 0;
+        QString message;
+    };
+    static constexpr int QueueDepth = 4096;
+
     Logger();
+    void writerThreadFunc();
+    bool openFile();
+    void rotateIfNeeded();
+    void writeEntry(const Entry &entry);
+
+    BoundedQueue<Entry> m_queue;
+    QThread *m_writer = nullptr;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<int> m_level{static_cast<int>(LogLevel::Info)};
+    std::atomic<quint64> m_enqueued{0};
+    std::atomic<quint64> m_written{0};
+    std::atomic<quint64> m_dropped{0};
+    quint64 m_droppedReported = 0;
+    // Writer-side state; configure() takes the lock too, producers never do.
+    mutable QMutex m_fileMutex;
+    LogOptions m_options;
     QFile m_file;
     QTextStream m_stream;
-    mutable QMutex m_mutex;
 };
@@ -5,6 +5,7 @@
 #include "SourceTile.h"
 #include "SourceSettingsDialog.h"
 #include "RecordingLibraryModel.h"
+#include "MetricsServer.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -17,11 +18,17 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    bool serveMetrics(const QString &address);
+
 private slots:
     void on_sourceCountSpin_valueChanged(int value);
     void on_startAllButton_clicked();
     void on_stopAllButton_clicked();
     void on_pauseAllButton_clicked();
+    void on_cpuCoresSpin_valueChanged(int value);
+    void on_pinThreadsCheck_toggled(bool checked);
+    void on_storagePolicyCombo_currentIndexChanged(int index);
+    void on_fallbackFolderButton_clicked();
     void handleSettings(SourceRecorder *recorder);
     void updateMasterTimer();
     void openRecording();
@@ -35,4 +42,5 @@ private:
     QVector<SourceTile *> m_tiles;
     QTimer m_masterTimer;
     RecordingLibraryModel *m_libraryModel;
+    MetricsServer m_metrics;
 };
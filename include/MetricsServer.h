@@ -0,0 +1,43 @@
+#pragma once
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+class QIODevice;
+class QObject;
+class SourceRecorder;
+
+// Serves Prometheus text-format metrics for a set of recorders at
+// GET /metrics. Requests are answered on the server's own thread from
+// SourceRecorder::stats() snapshots, so a scrape never waits on an encoder.
+//
+// Addresses: "127.0.0.1:9464", ":9464" (loopback), or "unix:/run/ndi-recorder.sock".
+class MetricsServer
+{
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    bool start(const QString &address);
+    void stop();
+    bool isRunning() const { return m_listener != nullptr; }
+
+    // A recorder must be removed before it is destroyed.
+    void addRecorder(SourceRecorder *recorder);
+    void removeRecorder(SourceRecorder *recorder);
+
+    QByteArray render() const;
+
+private:
+    static constexpr int MaxRequestBytes = 8192;
+
+    bool listen(const QString &address);
+    void handleReadyRead(QIODevice *socket);
+
+    QThread m_thread;
+    QObject *m_listener = nullptr; // lives on m_thread and owns the server and its sockets
+    mutable QMutex m_recordersMutex;
+    QVector<SourceRecorder *> m_recorders;
+};
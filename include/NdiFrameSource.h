@@ -0,0 +1,34 @@
+#pragma once
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include "FrameSource.h"
+#include "NdiManager.h"
+
+class NdiFrameSource : public FrameSource
+{
+public:
+    NdiFrameSource(const QString &name, NdiColorFormat colorFormat);
+    ~NdiFrameSource() override;
+
+    bool open() override;
+    FrameType capture(VideoFrame &video, AudioFrame &audio, int timeoutMs) override;
+    void releaseVideo(VideoFrame &video) override;
+    void releaseAudio(AudioFrame &audio) override;
+    SourceStats stats() const override;
+
+private:
+    void sampleReceiverStats();
+
+    QByteArray m_name;
+    NdiColorFormat m_colorFormat;
+    NDIlib_recv_instance_t m_recv = nullptr;
+    QElapsedTimer m_clock;
+    // The receiver's counters, read on the capture thread so other threads
+    // never touch m_recv.
+    QElapsedTimer m_statsThrottle;
+    QAtomicInteger<quint64> m_received{0};
+    QAtomicInteger<quint64> m_dropped{0};
+    QAtomicInteger<int> m_queuedVideo{0};
+    QAtomicInteger<int> m_queuedAudio{0};
+};
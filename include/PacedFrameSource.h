@@ -0,0 +1,58 @@
+#pragma once
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QVector>
+#include "BoundedQueue.h"
+#include "FrameSource.h"
+
+// Base for sources that produce pictures themselves. Frames are rendered into
+// a fixed set of buffers that come back as the encoder releases them, and are
+// delivered on the nominal frame clock, or as fast as the buffers return when
+// running unthrottled. Timestamps count frames from zero.
+class PacedFrameSource : public FrameSource
+{
+public:
+    struct Format
+    {
+        AVPixelFormat format = AV_PIX_FMT_NONE;
+        int width = 0;
+        int height = 0;
+        int fpsNum = 0;
+        int fpsDen = 1;
+    };
+
+    ~PacedFrameSource() override;
+
+    FrameType capture(VideoFrame &video, AudioFrame &audio, int timeoutMs) override;
+    void releaseVideo(VideoFrame &video) override;
+    void releaseAudio(AudioFrame &) override {}
+
+    SourceStats stats() const override;
+
+protected:
+    bool allocateFrames(const Format &format, int align);
+    // Fills `frame` with picture `index`; returns false when there are no more.
+    virtual bool renderFrame(qint64 index, VideoFrame &frame) = 0;
+    // Frames to leave out, as if the sender had lost them.
+    virtual bool dropFrame(qint64) { return false; }
+    // Offset of a frame's timestamp and delivery time from the frame clock.
+    virtual qint64 jitterTicks(qint64) { return 0; }
+
+    bool m_realtime = true;
+
+private:
+    static constexpr int FrameCount = 12;
+
+    qint64 frameTicks(qint64 index) const;
+
+    Format m_format;
+    QVector<uint8_t *> m_buffers;
+    int m_bufferSize = 0;
+    int m_align = 1;
+    BoundedQueue<int> m_freeBuffers;
+    QElapsedTimer m_clock;
+    qint64 m_nextIndex = 0;
+    bool m_ended = false;
+    QAtomicInteger<quint64> m_framesDelivered{0};
+    QAtomicInteger<quint64> m_framesDropped{0};
+};
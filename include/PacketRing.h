@@ -0,0 +1,83 @@
+#pragma once
+#include <QVector>
+#include <deque>
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// The most recent encoded packets of one recording, held by reference to the
+// encoders' buffers. Video is trimmed a whole GOP at a time from the front, so
+// the oldest video packet is always a keyframe, and audio older than that
+// keyframe goes with it. Every packet is appended and removed once, which
+// keeps the cost per packet constant however long the window is. Not
+// thread-safe.
+class PacketRing
+{
+public:
+    PacketRing() = default;
+    ~PacketRing() { clear(); }
+    PacketRing(const PacketRing &) = delete;
+    PacketRing &operator=(const PacketRing &) = delete;
+
+    // Keeps at least duration (video time base) when the byte cap allows.
+    // A single GOP larger than maxBytes empties the ring until the next keyframe.
+    void configure(AVRational videoTimeBase, AVRational audioTimeBase, int64_t duration, qint64 maxBytes);
+    void setDuration(int64_t duration);
+    // Takes ownership of pkt.
+    void pushVideo(AVPacket *pkt);
+    void pushAudio(AVPacket *pkt);
+    // Appends new references to the packets from the last keyframe at or
+    // before fromPts (the oldest one if there is none) and the audio from that
+    // keyframe on, and returns the keyframe's pts, or AV_NOPTS_VALUE if the
+    // ring holds no video. The caller frees the copies.
+    int64_t copyFrom(int64_t fromPts, QVector<AVPacket *> &video, QVector<AVPacket *> &audio) const;
+
+    // The same selection as copyFrom() as ranges of sequence numbers, so a
+    // caller can clone one packet at a time and release its lock in between.
+    struct Span
+    {
+        int64_t keyframePts = AV_NOPTS_VALUE;
+        quint64 videoBegin = 0;
+        quint64 videoEnd = 0;
+        quint64 audioBegin = 0;
+        quint64 audioEnd = 0;
+    };
+    // False if the ring holds no video.
+    bool span(int64_t fromPts, Span &span) const;
+    // A new reference to the packet, or null once it has been trimmed.
+    AVPacket *cloneVideo(quint64 sequence) const;
+    AVPacket *cloneAudio(quint64 sequence) const;
+    void clear();
+
+    bool hasKeyframe() const { return !m_keyframes.empty(); }
+    qint64 bytes() const { return m_bytes; }
+    qint64 maxBytes() const { return m_maxBytes; }
+    int64_t newestPts() const { return m_newestPts; }
+    // From the oldest keyframe to the newest video packet, in video time base.
+    int64_t duration() const;
+
+private:
+    struct Keyframe
+    {
+        quint64 sequence;
+        int64_t pts;
+    };
+
+    void trim();
+    void dropOldestGop();
+    void dropAudioBefore(int64_t videoPts);
+    static void freePacket(AVPacket *pkt);
+
+    AVRational m_videoTimeBase{1, 1};
+    AVRational m_audioTimeBase{1, 1};
+    int64_t m_duration = 0;
+    qint64 m_maxBytes = 0;
+    std::deque<AVPacket *> m_video;
+    std::deque<AVPacket *> m_audio;
+    // Positions of the keyframes in m_video, counted over every packet pushed.
+    std::deque<Keyframe> m_keyframes;
+    quint64 m_frontSequence = 0;
+    quint64 m_audioFrontSequence = 0; // the same count for m_audio
+    int64_t m_newestPts = AV_NOPTS_VALUE;
+    qint64 m_bytes = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <QAtomicInteger>
+#include <QVector>
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Encoder input pictures allocated up front and reused for the whole
+// recording. A picture is free again once the encoder has dropped its
+// references, i.e. every buffer is back to a single reference held here, so
+// handing one out costs no allocation. Only when all of them are still in
+// flight is another one added. Not thread-safe.
+class PicturePool
+{
+public:
+    PicturePool() = default;
+    ~PicturePool() { clear(); }
+    PicturePool(const PicturePool &) = delete;
+    PicturePool &operator=(const PicturePool &) = delete;
+
+    // Rows are padded to Align bytes so every plane suits the SIMD kernels.
+    static constexpr int Align = 64;
+
+    bool init(AVPixelFormat format, int width, int height, int count);
+    void clear();
+    // Owned by the pool; valid until clear(). Null if a new picture was
+    // needed and could not be allocated.
+    AVFrame *acquire();
+    // Pictures allocated since init(), including the initial ones.
+    quint64 allocations() const { return m_allocations; }
+
+private:
+    AVFrame *allocPicture();
+    static bool isFree(const AVFrame *frame);
+
+    QVector<AVFrame *> m_pictures;
+    AVPixelFormat m_format = AV_PIX_FMT_NONE;
+    int m_width = 0;
+    int m_height = 0;
+    int m_next = 0;
+    QAtomicInteger<quint64> m_allocations{0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <utility>
+
+// Hands preview images from the capture thread to the GUI without copying
+// pixels. The producer draws into its back image and publish() swaps it to the
+// front; take() swaps the front out to the consumer, whose previous image
+// becomes the producer's next back buffer. Once sizes settle no image is
+// allocated, as long as the consumer lets go of the pixels before the next take.
+class PreviewSlot
+{
+public:
+    // Producer only.
+    QImage &backBuffer(int width, int height)
+    {
+        if (m_back.width() != width || m_back.height() != height || m_back.format() != QImage::Format_RGBX8888)
+            m_back = QImage(width, height, QImage::Format_RGBX8888);
+        return m_back;
+    }
+
+    void publish()
+    {
+        QMutexLocker locker(&m_mutex);
+        std::swap(m_back, m_front);
+        ++m_sequence;
+    }
+
+    // Makes the next take() return a null image.
+    void clear()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_front = QImage();
+        ++m_sequence;
+    }
+
+    // Single consumer. Returns false if nothing was published since the
+    // sequence it last saw.
+    bool take(QImage &image, quint64 &sequence)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_sequence == sequence)
+            return false;
+        sequence = m_sequence;
+        std::swap(image, m_front);
+        return true;
+    }
+
+private:
+    QMutex m_mutex;
+    QImage m_front;
+    QImage m_back;
+    quint64 m_sequence = 0;
+};
@@ -10,6 +10,7 @@ struct RecordingEntry
     QString fullPath;
     QDateTime timestamp;
     qint64 size;
+    int finalizePercent = 100; // -1 while recording, 0..99 while the file is being closed
 };
 
 class RecordingLibraryModel : public QAbstractTableModel
@@ -23,6 +24,8 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
 
     void addEntry(const RecordingEntry &entry);
+    // Takes SourceRecorder::finalizationProgress; refreshes the size at 100.
+    void setFinalizeProgress(const QString &fullPath, int percent);
     void scanFolders(const QStringList &folders);
 
 private:
@@ -5,16 +5,96 @@
 #include <QAtomicInteger>
 #include <QElapsedTimer>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include "BoundedQueue.h"
 #include "FfmpegWriter.h"
-#include "NdiManager.h"
+#include "FrameSource.h"
+#include "Logging.h"
+#include "PreviewSlot.h"
+#include "StorageMonitor.h"
 
 struct SourceSettings
 {
-    QString ndiSource;
+    QString ndiSource; // NDI sender name, or a synthetic:/file: URI (see FrameSource)
     QString outputFolder;
     QString label;
     bool segmented = false;
     int segmentMinutes = 20;
+    int queueDepth = 8;
+    OverflowPolicy overflowPolicy = OverflowPolicy::DropOldest;
+    bool constantFrameRate = true;
+    NdiColorFormat colorFormat = NdiColorFormat::UyvyBgra;
+    int conversionSlices = 0;
+    AudioCodec audioCodec = AudioCodec::Aac;
+    ContainerMode container = ContainerMode::Mp4;
+    int fragmentSeconds = 2;
+    EncoderProfile encoder;
+    bool discardOutput = false; // encode and mux without writing files
+    int previewFps = 5;         // tile preview updates per second; 0 turns them off
+    int priority = 0;           // higher keeps recording longer under StoragePolicy::StopLowest
+    int preRollSeconds = 0;     // kept in memory while armed and written ahead of Start; 0 disables arming
+    int replaySeconds = 0;      // kept in memory while recording for exportClip(); 0 turns clips off
+    int ringMaxMb = 256;        // memory cap for the pre-roll and replay packets
+    QVector<RenditionConfig> renditions; // proxies encoded alongside the master
+};
+
+struct QueueStats
+{
+    quint64 captured = 0;
+    quint64 encoded = 0;
+    quint64 droppedOldest = 0;
+    quint64 droppedNewest = 0;
+    quint64 blockedPushes = 0;
+    quint64 duplicated = 0;
+    quint64 droppedLate = 0;
+    // From the source timestamps: jumps of more than 1.5 frame intervals, the
+    // frames those jumps imply, and frames that repeated the previous timestamp.
+    quint64 timestampGaps = 0;
+    quint64 framesMissing = 0;
+    quint64 repeatedTimestamps = 0;
+    quint64 bufferAllocations = 0;
+    int queued = 0;
+    int depth = 0;
+};
+
+// Per-frame time in each pipeline stage, from when the capture thread asks
+// the source for a frame to when its packet has been muxed.
+struct StageLatency
+{
+    LatencyHistogram::Snapshot capture; // waiting for and receiving a frame
+    LatencyHistogram::Snapshot queue;   // between capture and encode threads
+    LatencyHistogram::Snapshot convert;
+    LatencyHistogram::Snapshot encode;
+    LatencyHistogram::Snapshot mux;
+};
+
+// Everything a recorder measures, taken at one moment.
+struct RecorderStats
+{
+    QString label;
+    QString status;
+    bool running = false;
+    bool paused = false;
+    bool finalizing = false; // stopped, files still being closed
+    bool armed = false;      // encoding into the pre-roll ring, no file yet
+    int finalizePercent = 0;
+    qint64 elapsedMs = 0;
+    qint64 sinceLastFrameMs = -1; // -1 before the first frame
+    // Frames captured and encoded per second over the last second or so.
+    double fpsIn = 0.0;
+    double fpsOut = 0.0;
+    QString outputFolder;
+    QString currentFile;
+    quint64 bytesWritten = 0;
+    DiskWriteStats disk;
+    QueueStats queue;
+    SourceStats source;
+    StageLatency latency;
+    StorageStatus storage;
+    PacketRingStats ring;
+
+    quint64 droppedTotal() const { return queue.droppedOldest + queue.droppedNewest + queue.droppedLate + source.dropped; }
 };
 
 class SourceRecorder : public QObject
@@ -27,44 +107,170 @@ public:
     void applySettings(const SourceSettings &settings);
     SourceSettings settings() const { return m_settings; }
 
+    // Called while the previous recording is still finalizing, starts once
+    // that is done.
+    // Commits the pre-roll when armed.
     void start();
+    // Captures and encodes without writing, keeping the last preRollSeconds
+    // in memory so that start() begins the file that far back. Does nothing
+    // unless preRollSeconds is set.
+    void arm();
+    // Returns once capture has halted; draining the queue, flushing the
+    // encoders and closing the files continue on the FinalizationPool.
     void stop();
+    void waitFinalized();
     void pause();
     void resume();
+    bool isRunning() const { return m_running; }
+    bool isFinalizing() const { return m_finalizing; }
+    bool isArmed() const { return m_armed; }
+    // Writes the last `seconds` of the recording, from the keyframe at or
+    // before that point, to a new file next to it. The packets are copied
+    // from the replay ring here and remuxed on the FinalizationPool;
+    // clipExported reports the outcome. Returns the path, or an empty string
+    // if there is nothing to export.
+    QString exportClip(int seconds);
+    // Headless recorders skip building preview images.
+    void setPreviewEnabled(bool enabled) { m_previewEnabled = enabled; }
+    // Previews are the largest integer fraction of the frame that fits.
+    void setPreviewSize(int width, int height);
+    // Swaps in the newest preview if there is one since sequence (a null
+    // image once stopped); see PreviewSlot. One caller per recorder.
+    bool takePreview(QImage &image, quint64 &sequence);
 
-    QImage lastFrame() const;
     QString status() const { return m_status; }
+    // The last run was stopped for disk space or by a failed write.
+    bool stoppedForStorage() const { return m_stoppedForStorage; }
     qint64 elapsedMs() const;
     QString currentFile() const { return m_writer.currentFile(); }
+    QueueStats queueStats() const;
+    StageLatency stageLatency() const;
+    RecorderStats stats() const;
+    QString cpuAllocation() const;
 
 signals:
     void previewUpdated();
     void errorOccurred(const QString &err);
     void recordingStarted(const QString &file);
+    // From the finalization pool; 100 once the file is closed.
+    void finalizationProgress(const QString &file, int percent);
+    // Emitted once finalization is complete.
     void recordingStopped();
+    // From the finalization pool.
+    void clipExported(const QString &file, bool ok);
 
 private:
-    void videoThreadFunc();
-    void reconnect();
+    struct CapturedFrame
+    {
+        VideoFrame video;
+        // Media time in 100 ns units with paused time already removed.
+        qint64 timestamp = 0;
+        qint64 queuedNs = 0; // LatencyHistogram::now() at push
+    };
+
+    struct CapturedAudio
+    {
+        AudioFrame audio;
+        qint64 timestamp = 0;
+    };
+    static constexpr int AudioQueueDepth = 64;
+
+    // Keeps what the source needs to release a frame the encoder still
+    // references; slots are preallocated and recycled lock-free.
+    struct FrameRef
+    {
+        SourceRecorder *owner = nullptr;
+        FrameSource *source = nullptr;
+        VideoFrame video;
+        int index = 0;
+    };
+    static constexpr int FrameRefSlots = 16;
+    // Forward timestamp jumps above this are clock steps, not lost frames.
+    static constexpr qint64 MaxTimestampGapTicks = 5LL * 10000000;
+
+    void startPipeline(bool armed);
+    // Encode thread: picks up the writer leaving armed mode.
+    void followPreRoll(qint64 bufferedMs);
+    void captureThreadFunc();
+    void encodeThreadFunc();
+    void audioThreadFunc();
+    bool startWriter(const VideoFrame &videoFrame);
+    void updatePreview(const VideoFrame &videoFrame);
+    void finalize(const QString &file);
+    void reportFinalizeProgress(const QString &file, int percent);
+    void releaseFrame(CapturedFrame &frame);
+    AVBufferRef *wrapFrame(CapturedFrame &captured);
+    static void freeWrappedFrame(void *opaque, uint8_t *data);
+    bool openSource();
+    void followCpuBudget(quint32 &generation, bool capture);
+    void followStorage(quint32 &generation);
+    // From the pipeline threads: stop as if the user had, keeping the reason as status.
+    void haltWithReason(const QString &status, const QString &error, bool storage = false);
 
     mutable QMutex m_mutex;
     mutable QMutex m_stateMutex;
     SourceSettings m_settings;
     FfmpegWriter m_writer;
-    QThread m_videoThread;
+    QThread m_captureThread;
+    QThread m_encodeThread;
+    QThread m_audioThread;
+    BoundedQueue<CapturedFrame> m_frameQueue;
+    BoundedQueue<CapturedAudio> m_audioQueue;
+    QVector<FrameRef> m_frameRefs;
+    BoundedQueue<int> m_freeFrameRefs;
+    // Threads started and not yet handed to finalization.
+    QAtomicInteger<bool> m_active;
     QAtomicInteger<bool> m_running;
+    QAtomicInteger<bool> m_encoding;
     QAtomicInteger<bool> m_paused;
     QAtomicInteger<bool> m_recordingStarted;
-    qint64 m_videoPts = 0;
-    qint64 m_expectedFrameTicks10ns = 0;
-    qint64 m_expectedPtsStep = 1;
-    int m_sourceFpsNum = 60;
-    int m_sourceFpsDen = 1;
-    QImage m_preview;
+    QAtomicInteger<bool> m_armed;
+    QAtomicInteger<bool> m_commitRequested;
+    QAtomicInteger<bool> m_previewEnabled;
+    QAtomicInteger<bool> m_finalizing;
+    QAtomicInteger<bool> m_stoppedForStorage;
+    QAtomicInteger<int> m_finalizePercent;
+    QMutex m_finalizeMutex;
+    QWaitCondition m_finalized;
+    bool m_startPending = false; // start() called while finalizing; guarded by m_finalizeMutex
+    bool m_armPending = false;   // the same for arm()
+    int m_clipExports = 0;       // clip jobs still running; guarded by m_finalizeMutex
+    QAtomicInteger<int> m_previewWidth;
+    QAtomicInteger<int> m_previewHeight;
+    QAtomicInteger<quint64> m_framesCaptured;
+    QAtomicInteger<quint64> m_framesEncoded;
+    QAtomicInteger<quint64> m_timestampGaps;
+    QAtomicInteger<quint64> m_framesMissing;
+    QAtomicInteger<quint64> m_repeatedTimestamps;
+    LatencyHistogram m_captureTime;
+    LatencyHistogram m_queueTime;
+    int m_cpuLease = 0;
+    int m_storageLease = 0;
+    // Encode thread only while running; may move to the fallback folder.
+    QString m_outputFolder;
+    QString m_stopReason;
+    // Fixed when the encoder opens; later rebalances apply from the next start.
+    QAtomicInteger<int> m_encoderThreads;
+    PreviewSlot m_previewSlot;
+    std::vector<uint16_t> m_previewScratch;
+    SwsContext *m_previewSws = nullptr;
     QString m_status;
     QElapsedTimer m_timer;
     QElapsedTimer m_previewThrottle;
-    NDIlib_recv_instance_t m_recv;
+    QAtomicInteger<qint64> m_lastFrameNs;
+    LogThrottle m_timeoutLog;
+    LogThrottle m_gapLog{10000};
+    LogThrottle m_clockStepLog{10000};
+    mutable QMutex m_rateMutex;
+    mutable QElapsedTimer m_rateTimer;
+    mutable quint64 m_rateCaptured = 0;
+    mutable quint64 m_rateEncoded = 0;
+    mutable double m_fpsIn = 0.0;
+    mutable double m_fpsOut = 0.0;
+    // Held while m_source is replaced so stats() can read it from any thread.
+    mutable QMutex m_sourceMutex;
+    std::unique_ptr<FrameSource> m_source;
     qint64 m_pausedDurationMs;
     qint64 m_pauseStartMs;
+    qint64 m_preRollMs = 0; // buffered ahead of the start, counted as recorded time
 };
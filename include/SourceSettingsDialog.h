@@ -18,8 +18,13 @@ public:
 private slots:
     void refreshNdi();
     void on_buttonBox_accepted();
+    void updateRateControlFields();
+    void updateContainerFields();
 
 private:
+    void showEncoderProfile(const EncoderProfile &profile);
+    EncoderProfile encoderProfile() const;
+
     Ui::SourceSettingsDialog *ui;
     NdiManager m_ndi;
     SourceSettings m_settings;
@@ -18,15 +18,26 @@ public:
 signals:
     void settingsRequested(SourceRecorder *recorder);
 
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+
 private slots:
     void updatePreview();
+    void updateStatus();
+    void on_armButton_clicked();
     void on_startButton_clicked();
     void on_stopButton_clicked();
     void on_pauseButton_clicked();
+    void on_clipButton_clicked();
     void on_settingsButton_clicked();
 
 private:
+    void updateStats(const RecorderStats &stats);
+    void updateStorage(const StorageStatus &storage);
+
     Ui::SourceTile *ui;
     SourceRecorder *m_recorder;
     QTimer m_timer;
+    QImage m_previewImage;
+    quint64 m_previewSequence = 0;
 };
@@ -0,0 +1,137 @@
+#pragma once
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include "AsyncFileWriter.h"
+#include "Logging.h"
+
+class QThread;
+
+// What to do once a volume is about to fill up or cannot keep up with the
+// writes. Every policy also logs; Warn does nothing else.
+enum class StoragePolicy
+{
+    Warn,
+    LowerBitrate, // step the encoders on the volume down, back up once it recovers
+    Fallback,     // continue every recording on the volume in the fallback folder
+    StopLowest    // stop the lowest-priority recording on the volume, one at a time
+};
+
+struct StorageOptions
+{
+    StoragePolicy policy = StoragePolicy::Warn;
+    QString fallbackFolder;
+    int warnMinutes = 60; // predicted time to full that counts as low
+    int actMinutes = 15;  // predicted time to full that applies the policy
+    qint64 minFreeBytes = 2LL * 1024 * 1024 * 1024; // treated as full below this
+};
+
+enum class StorageLevel
+{
+    Ok,
+    Low,
+    Critical // about to fill up, already below the minimum, or writes are stalling
+};
+
+// One recorder's view of the volume it writes to, as of the last check.
+struct StorageStatus
+{
+    QString volume;
+    QString folder; // where the recorder writes now
+    StorageLevel level = StorageLevel::Ok;
+    qint64 freeBytes = -1;
+    double incomingBytesPerSec = 0.0; // all recorders on the volume
+    double diskBytesPerSec = 0.0;     // throughput of the write calls themselves
+    qint64 secondsToFull = -1;        // -1 while nothing is being written
+    double bitrateScale = 1.0;
+    QString action; // last policy step taken for this recorder
+};
+
+// Process-wide watch over the volumes recordings go to. A background thread
+// samples free space and every recorder's disk counters each couple of
+// seconds, predicts time to full from the aggregate write rate and applies the
+// policy before writes start failing. Recorders poll generation() and pick up
+// their directive, the same way they follow CpuBudget.
+class StorageMonitor
+{
+public:
+    struct Directive
+    {
+        double bitrateScale = 1.0;
+        QString folder; // empty keeps the configured one
+        bool stop = false;
+    };
+
+    static StorageMonitor &instance();
+    ~StorageMonitor();
+
+    void setOptions(const StorageOptions &options);
+    StorageOptions options() const;
+
+    // probe is called from the monitor thread until release() returns.
+    int acquire(const QString &label, const QString &folder, int priority, std::function<DiskWriteStats()> probe);
+    void release(int id);
+    Directive directive(int id) const;
+    StorageStatus status(int id) const;
+    // Bumped whenever a directive changes.
+    quint32 generation() const { return m_generation.load(std::memory_order_acquire); }
+    // False if the folder's volume is below the minimum, or, with StopLowest,
+    // not yet back to normal; reason says why. A volume's level outlives its
+    // last recording, so one stopped for space stays refused.
+    bool canStart(const QString &folder, QString &reason) const;
+
+    static QString levelName(StorageLevel level);
+
+private:
+    struct Lease
+    {
+        QString label;
+        QString folder;
+        int priority = 0;
+        std::function<DiskWriteStats()> probe;
+        Directive directive;
+        QString action;
+        QString volume;
+        quint64 lastBytes = 0;
+        qint64 lastWriteNs = 0;
+        quint64 lastStalls = 0;
+        qint64 lastSampleNs = 0;
+        bool sampled = false;
+    };
+
+    struct Volume
+    {
+        StorageLevel level = StorageLevel::Ok;
+        qint64 freeBytes = -1;
+        double incomingBytesPerSec = 0.0;
+        double diskBytesPerSec = 0.0;
+        qint64 secondsToFull = -1;
+        qint64 lastActionNs = 0;
+    };
+
+    static constexpr int IntervalMs = 2000;
+    static constexpr int ActionHoldMs = 10000; // let rates settle before the next step
+    static constexpr double BitrateStep = 0.75;
+    static constexpr double MinBitrateScale = 0.25;
+
+    StorageMonitor() = default;
+    void threadFunc();
+    void check();
+    void applyPolicy(const QString &volume, Volume &state, const StorageOptions &options, const QMap<QString, qint64> &freeByFolder,
+                     const QMap<QString, QString> &volumeByFolder);
+    QString currentFolder(const Lease &lease) const;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QThread *m_thread = nullptr;
+    bool m_stopping = false;
+    StorageOptions m_options;
+    QMap<int, Lease> m_leases;
+    QMap<QString, Volume> m_volumes;
+    int m_nextId = 1;
+    std::atomic<quint32> m_generation{0};
+    LogThrottle m_fallbackLog;
+};
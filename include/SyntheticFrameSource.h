@@ -0,0 +1,41 @@
+#pragma once
+#include <random>
+#include "PacedFrameSource.h"
+
+// Colour bars with a moving box, for running the pipeline without a sender.
+// Jitter moves each frame's timestamp and delivery time by up to +/- jitterMs;
+// dropRate is the share of frames that never arrive.
+class SyntheticFrameSource : public PacedFrameSource
+{
+public:
+    struct Options
+    {
+        Format format{AV_PIX_FMT_UYVY422, 1920, 1080, 60, 1};
+        double jitterMs = 0.0;
+        double dropRate = 0.0;
+        bool realtime = true;
+        unsigned seed = 1;
+    };
+
+    explicit SyntheticFrameSource(const Options &options);
+    ~SyntheticFrameSource() override;
+
+    bool open() override;
+
+protected:
+    bool renderFrame(qint64 index, VideoFrame &frame) override;
+    bool dropFrame(qint64 index) override;
+    qint64 jitterTicks(qint64 index) override;
+
+private:
+    void decide(qint64 index);
+    void fillRect(uint8_t *const data[4], const int linesize[4], int x, int y, int w, int h, int r, int g, int b) const;
+
+    Options m_options;
+    uint8_t *m_background[4] = {};
+    int m_backgroundLinesize[4] = {};
+    std::mt19937 m_random;
+    qint64 m_decidedIndex = -1;
+    bool m_drop = false;
+    qint64 m_jitter = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <type_traits>
+
+// Process-wide pool for data-parallel work such as sliced colour conversion.
+// run() blocks until every index has been processed; the calling thread works
+// on the batch too, and no allocation happens per call.
+class WorkerPool
+{
+public:
+    static WorkerPool &instance();
+
+    int threadCount() const { return m_workers.size() + 1; }
+
+    template <typename Fn>
+    void run(int count, Fn &&fn)
+    {
+        using Callable = std::remove_reference_t<Fn>;
+        if (count <= 1 || m_workers.isEmpty())
+        {
+            for (int i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+        Batch batch;
+        batch.count = count;
+        batch.remaining.store(count, std::memory_order_relaxed);
+        batch.context = const_cast<void *>(static_cast<const void *>(&fn));
+        batch.invoke = [](void *context, int index) { (*static_cast<Callable *>(context))(index); };
+        execute(batch);
+    }
+
+private:
+    struct Batch
+    {
+        int count = 0;
+        void *context = nullptr;
+        void (*invoke)(void *, int) = nullptr;
+        std::atomic<int> next{0};
+        std::atomic<int> remaining{0};
+        int users = 0;
+        Batch *nextBatch = nullptr;
+    };
+
+    WorkerPool();
+    ~WorkerPool();
+    void execute(Batch &batch);
+    void work(Batch &batch);
+    void workerLoop();
+
+    QMutex m_mutex;
+    QWaitCondition m_workAvailable;
+    QWaitCondition m_batchDone;
+    Batch *m_batches = nullptr;
+    bool m_stopping = false;
+    QVector<QThread *> m_workers;
+};
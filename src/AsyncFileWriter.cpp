@@ -0,0 +1,304 @@
+#include "AsyncFileWriter.h"
+#include "Logging.h"
+#include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#if defined(Q_OS_WIN)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <fcntl.h>
+#endif
+
+AsyncFileWriter::AsyncFileWriter(DiskWriteCounters *counters)
+    : m_counters(counters)
+{
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    close();
+}
+
+bool AsyncFileWriter::open(const QString &path, const Options &options)
+{
+    close();
+    m_options = options;
+    m_options.chunkBytes = std::max(64 * 1024, m_options.chunkBytes);
+    const int chunkCount = std::max(2, m_options.bufferBytes / m_options.chunkBytes);
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        Logger::instance().log(LogLevel::Error, QString("Failed to open %1: %2").arg(path, m_file.errorString()));
+        return false;
+    }
+
+    m_chunks.resize(chunkCount);
+    m_filled.reset(chunkCount);
+    m_empty.reset(chunkCount);
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        m_chunks[i].data = static_cast<uint8_t *>(av_malloc(m_options.chunkBytes));
+        if (!m_chunks[i].data)
+        {
+            Logger::instance().log(LogLevel::Error, "Failed to allocate write buffers");
+            releaseBuffers();
+            m_file.close();
+            return false;
+        }
+        int index = i;
+        m_empty.tryPush(index);
+    }
+
+    uint8_t *avioBuffer = static_cast<uint8_t *>(av_malloc(AvioBufferSize));
+    m_avio = avioBuffer ? avio_alloc_context(avioBuffer, AvioBufferSize, 1, this, nullptr, writeCallback, seekCallback) : nullptr;
+    if (!m_avio)
+    {
+        av_free(avioBuffer);
+        Logger::instance().log(LogLevel::Error, "Failed to allocate output context");
+        releaseBuffers();
+        m_file.close();
+        return false;
+    }
+
+    m_stopping = false;
+    m_failed = false;
+    m_current = -1;
+    m_position = 0;
+    m_size = 0;
+    m_reservedEnd = 0;
+    m_reserveFailed = false;
+    m_fileBytes = 0;
+    m_fileWrites = 0;
+    m_fileStalls = 0;
+    m_fileWriteTime.reset();
+    m_ioThread = QThread::create([this]() { ioThreadFunc(); });
+    m_ioThread->start(QThread::HighPriority);
+    return true;
+}
+
+bool AsyncFileWriter::close()
+{
+    if (!m_ioThread)
+        return !m_failed;
+    avio_flush(m_avio);
+    submitChunk();
+    m_stopping = true;
+    m_filled.wakeAll();
+    m_ioThread->wait();
+    delete m_ioThread;
+    m_ioThread = nullptr;
+
+    // Give back whatever was reserved past the end.
+    if (m_reservedEnd > m_size && !m_failed)
+        m_file.resize(m_size);
+    const QString path = m_file.fileName();
+    m_file.close();
+    av_freep(&m_avio->buffer);
+    avio_context_free(&m_avio);
+    releaseBuffers();
+
+    const LatencyHistogram::Snapshot writeTime = m_fileWriteTime.snapshot();
+    Logger::instance().log(LogLevel::Debug, QString("Wrote %1 MB to %2 in %3 writes (p99 %4 ms, max %5 ms), %6 buffer stalls")
+                                                .arg(m_fileBytes / 1e6, 0, 'f', 1)
+                                                .arg(QFileInfo(path).fileName())
+                                                .arg(m_fileWrites.load())
+                                                .arg(writeTime.percentileNs(0.99) / 1e6, 0, 'f', 2)
+                                                .arg(writeTime.maxNs / 1e6, 0, 'f', 2)
+                                                .arg(m_fileStalls));
+    return !m_failed;
+}
+
+void AsyncFileWriter::releaseBuffers()
+{
+    for (Chunk &chunk : m_chunks)
+        av_freep(&chunk.data);
+    m_chunks.clear();
+}
+
+int AsyncFileWriter::writeCallback(void *opaque, AvioWriteBuffer buf, int size)
+{
+    return static_cast<AsyncFileWriter *>(opaque)->write(buf, size);
+}
+
+int64_t AsyncFileWriter::seekCallback(void *opaque, int64_t offset, int whence)
+{
+    return static_cast<AsyncFileWriter *>(opaque)->seek(offset, whence);
+}
+
+int AsyncFileWriter::write(const uint8_t *data, int size)
+{
+    if (m_failed.load(std::memory_order_acquire))
+        return AVERROR(EIO);
+    int remaining = size;
+    while (remaining > 0)
+    {
+        if (m_current < 0 && !acquireChunk())
+            return AVERROR(EIO);
+        Chunk &chunk = m_chunks[m_current];
+        const int count = std::min(remaining, m_options.chunkBytes - chunk.used);
+        std::memcpy(chunk.data + chunk.used, data, count);
+        chunk.used += count;
+        data += count;
+        remaining -= count;
+        m_position += count;
+        m_size = std::max(m_size, m_position);
+        if (chunk.used == m_options.chunkBytes)
+            submitChunk();
+    }
+    if (m_current >= 0 && LatencyHistogram::now() - m_currentStartNs >= static_cast<qint64>(m_options.maxHoldMs) * 1000000)
+        submitChunk();
+    return size;
+}
+
+int64_t AsyncFileWriter::seek(int64_t offset, int whence)
+{
+    if (whence & AVSEEK_SIZE)
+        return m_size;
+    qint64 target = offset;
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        target = m_position + offset;
+        break;
+    case SEEK_END:
+        target = m_size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (target < 0)
+        return AVERROR(EINVAL);
+    // Whatever was buffered belongs at the old position; the next write
+    // starts a fresh buffer at the new one.
+    if (target != m_position)
+        submitChunk();
+    m_position = target;
+    return target;
+}
+
+bool AsyncFileWriter::acquireChunk()
+{
+    int index = -1;
+    if (!m_empty.tryPop(index))
+    {
+        const qint64 waitStart = LatencyHistogram::now();
+        for (;;)
+        {
+            const quint32 seen = m_empty.pushEvents();
+            if (m_empty.tryPop(index))
+                break;
+            if (m_failed.load(std::memory_order_acquire))
+                return false;
+            m_empty.waitPushEvent(seen);
+        }
+        ++m_fileStalls;
+        if (m_counters)
+        {
+            m_counters->m_stalls.fetch_add(1, std::memory_order_relaxed);
+            m_counters->m_stallNs.fetch_add(LatencyHistogram::now() - waitStart, std::memory_order_relaxed);
+        }
+    }
+    m_current = index;
+    m_chunks[index].used = 0;
+    m_chunks[index].offset = m_position;
+    m_currentStartNs = LatencyHistogram::now();
+    return true;
+}
+
+void AsyncFileWriter::submitChunk()
+{
+    if (m_current < 0)
+        return;
+    int index = m_current;
+    m_current = -1;
+    if (m_chunks[index].used == 0)
+    {
+        m_empty.tryPush(index);
+        return;
+    }
+    // Every chunk is either empty, filled or current, so there is always room.
+    m_filled.tryPush(index);
+}
+
+void AsyncFileWriter::ioThreadFunc()
+{
+    for (;;)
+    {
+        const quint32 seen = m_filled.pushEvents();
+        int index = -1;
+        if (m_filled.tryPop(index))
+        {
+            const Chunk &chunk = m_chunks[index];
+            if (!m_failed.load(std::memory_order_relaxed) && !writeChunk(chunk))
+            {
+                Logger::instance().log(LogLevel::Error,
+                                       QString("Write to %1 failed: %2").arg(m_file.fileName(), m_file.errorString()));
+                m_failed.store(true, std::memory_order_release);
+            }
+            m_empty.tryPush(index);
+            continue;
+        }
+        if (m_stopping)
+            break;
+        m_filled.waitPushEvent(seen);
+    }
+}
+
+bool AsyncFileWriter::writeChunk(const Chunk &chunk)
+{
+    const qint64 end = chunk.offset + chunk.used;
+    if (m_options.preallocateBytes > 0 && end > m_reservedEnd && !m_reserveFailed)
+        reserve(end + m_options.preallocateBytes);
+    if (m_file.pos() != chunk.offset && !m_file.seek(chunk.offset))
+        return false;
+    const qint64 start = LatencyHistogram::now();
+    const qint64 written = m_file.write(reinterpret_cast<const char *>(chunk.data), chunk.used);
+    const qint64 elapsed = LatencyHistogram::now() - start;
+    if (written != chunk.used)
+        return false;
+    m_fileBytes.fetch_add(written, std::memory_order_relaxed);
+    m_fileWrites.fetch_add(1, std::memory_order_relaxed);
+    m_fileWriteTime.record(elapsed);
+    if (m_counters)
+    {
+        m_counters->m_bytes.fetch_add(written, std::memory_order_relaxed);
+        m_counters->m_writes.fetch_add(1, std::memory_order_relaxed);
+        m_counters->m_writeTime.record(elapsed);
+    }
+    return true;
+}
+
+void AsyncFileWriter::reserve(qint64 end)
+{
+    // Allocates blocks without moving the end of file, so a crash leaves no
+    // zero padding after the last fragment.
+    bool ok = true;
+#if defined(Q_OS_WIN)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = end;
+    const HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(m_file.handle()));
+    ok = SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info)) != 0;
+#elif defined(Q_OS_LINUX)
+    ok = fallocate(m_file.handle(), FALLOC_FL_KEEP_SIZE, m_reservedEnd, end - m_reservedEnd) == 0;
+#endif
+    if (!ok)
+    {
+        // Not fatal: the writes themselves still go ahead.
+        m_reserveFailed = true;
+        Logger::instance().log(LogLevel::Warning, QString("Could not reserve space for %1").arg(m_file.fileName()));
+        return;
+    }
+    m_reservedEnd = end;
+}
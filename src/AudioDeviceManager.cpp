@@ -10,7 +10,7 @@ AudioDeviceManager::AudioDeviceManager(QObject *parent)
     HRESULT hr = m_enum.CoCreateInstance(__uuidof(MMDeviceEnumerator));
     if (FAILED(hr))
     {
-        Logger::instance().log("Failed to create MMDeviceEnumerator: " + QString::number(hr, 16));
+        Logger::instance().log(LogLevel::Error, "Failed to create MMDeviceEnumerator: " + QString::number(hr, 16));
     }
     enumerate();
 }
@@ -30,14 +30,14 @@ void AudioDeviceManager::enumerate()
     HRESULT hr = m_enum->EnumAudioEndpoints(eCapture, DEVICE_STATE_ACTIVE, &collection);
     if (FAILED(hr))
     {
-        Logger::instance().log("Failed to enumerate audio endpoints: " + QString::number(hr, 16));
+        Logger::instance().log(LogLevel::Error, "Failed to enumerate audio endpoints: " + QString::number(hr, 16));
         return;
     }
     UINT count = 0;
     hr = collection->GetCount(&count);
     if (FAILED(hr))
     {
-        Logger::instance().log("Failed to get audio endpoint count: " + QString::number(hr, 16));
+        Logger::instance().log(LogLevel::Error, "Failed to get audio endpoint count: " + QString::number(hr, 16));
         return;
     }
     for (UINT i = 0; i < count; ++i)
@@ -49,7 +49,7 @@ void AudioDeviceManager::enumerate()
             hr = device->OpenPropertyStore(STGM_READ, &props);
             if (FAILED(hr) || !props)
             {
-                Logger::instance().log("Failed to open property store for device " + QString::number(i) + ": " + QString::number(hr, 16));
+                Logger::instance().log(LogLevel::Error, "Failed to open property store for device " + QString::number(i) + ": " + QString::number(hr, 16));
                 continue;
             }
             PROPVARIANT varName;
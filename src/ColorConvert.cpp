@@ -0,0 +1,419 @@
+#include "ColorConvert.h"
+#include "ColorConvertKernels.h"
+#include <algorithm>
+#include <atomic>
+
+#if defined(COLORCONVERT_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace ColorConvert
+{
+namespace
+{
+// BT.601 / BT.709 limited range, scaled by 256. Chroma rows sum to zero so
+// greys map exactly to 128.
+constexpr RgbCoefficients Bt601Rgb = {{66, 129, 25}, {-38, -74, 112}, {112, -94, -18}};
+constexpr RgbCoefficients Bt709Rgb = {{47, 157, 16}, {-26, -86, 112}, {112, -102, -10}};
+
+// Limited-range YCbCr to RGB, scaled by 256.
+struct YuvCoefficients
+{
+    int y, rv, gu, gv, bu;
+};
+constexpr YuvCoefficients Bt601Yuv = {298, 409, -100, -208, 516};
+constexpr YuvCoefficients Bt709Yuv = {298, 459, -55, -136, 541};
+
+RgbCoefficients swapRedBlue(const RgbCoefficients &c)
+{
+    return {{c.y[2], c.y[1], c.y[0]}, {c.u[2], c.u[1], c.u[0]}, {c.v[2], c.v[1], c.v[0]}};
+}
+
+inline uint8_t lumaFromRgb(const uint8_t *p, const RgbCoefficients &c)
+{
+    return static_cast<uint8_t>(((c.y[0] * p[0] + c.y[1] * p[1] + c.y[2] * p[2] + 128) >> 8) + 16);
+}
+
+inline uint8_t chromaFromRgb(const int16_t *k, int c0, int c1, int c2)
+{
+    return static_cast<uint8_t>(((k[0] * c0 + k[1] * c1 + k[2] * c2 + 128) >> 8) + 128);
+}
+
+// Scalar kernels. They define the exact output every SIMD variant must match
+// and finish the columns the wider kernels leave over.
+int rgbRowsScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                  const RgbCoefficients &coeffs)
+{
+    for (int x = 0; x < width; x += 2)
+    {
+        const bool pair = x + 1 < width;
+        const uint8_t *a0 = row0 + x * 4;
+        const uint8_t *a1 = pair ? a0 + 4 : a0;
+        const uint8_t *b0 = row1 + x * 4;
+        const uint8_t *b1 = pair ? b0 + 4 : b0;
+        luma0[x] = lumaFromRgb(a0, coeffs);
+        luma1[x] = lumaFromRgb(b0, coeffs);
+        if (pair)
+        {
+            luma0[x + 1] = lumaFromRgb(a1, coeffs);
+            luma1[x + 1] = lumaFromRgb(b1, coeffs);
+        }
+        const int c0 = (a0[0] + a1[0] + b0[0] + b1[0] + 2) >> 2;
+        const int c1 = (a0[1] + a1[1] + b0[1] + b1[1] + 2) >> 2;
+        const int c2 = (a0[2] + a1[2] + b0[2] + b1[2] + 2) >> 2;
+        u[x / 2] = chromaFromRgb(coeffs.u, c0, c1, c2);
+        v[x / 2] = chromaFromRgb(coeffs.v, c0, c1, c2);
+    }
+    return width;
+}
+
+int uyvyI420RowsScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width)
+{
+    for (int x = 0; x < width; x += 2)
+    {
+        const int i = x * 2;
+        luma0[x] = row0[i + 1];
+        luma1[x] = row1[i + 1];
+        if (x + 1 < width)
+        {
+            luma0[x + 1] = row0[i + 3];
+            luma1[x + 1] = row1[i + 3];
+        }
+        u[x / 2] = static_cast<uint8_t>((row0[i] + row1[i] + 1) >> 1);
+        v[x / 2] = static_cast<uint8_t>((row0[i + 2] + row1[i + 2] + 1) >> 1);
+    }
+    return width;
+}
+
+int uyvyNv12RowsScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width)
+{
+    for (int x = 0; x < width; x += 2)
+    {
+        const int i = x * 2;
+        luma0[x] = row0[i + 1];
+        luma1[x] = row1[i + 1];
+        if (x + 1 < width)
+        {
+            luma0[x + 1] = row0[i + 3];
+            luma1[x + 1] = row1[i + 3];
+        }
+        uv[x] = static_cast<uint8_t>((row0[i] + row1[i] + 1) >> 1);
+        uv[x + 1] = static_cast<uint8_t>((row0[i + 2] + row1[i + 2] + 1) >> 1);
+    }
+    return width;
+}
+
+int accumulateRowScalar(const uint8_t *row, uint16_t *sums, int count)
+{
+    for (int i = 0; i < count; ++i)
+        sums[i] = static_cast<uint16_t>(sums[i] + row[i]);
+    return count;
+}
+
+constexpr KernelTable ScalarKernels = {rgbRowsScalar, uyvyI420RowsScalar, uyvyNv12RowsScalar, accumulateRowScalar};
+#if defined(COLORCONVERT_X86)
+constexpr KernelTable Sse2Kernels = {rgbRowsSse2, uyvyI420RowsSse2, uyvyNv12RowsSse2, accumulateRowSse2};
+constexpr KernelTable Avx2Kernels = {rgbRowsAvx2, uyvyI420RowsAvx2, uyvyNv12RowsAvx2, accumulateRowAvx2};
+constexpr KernelTable Avx512Kernels = {rgbRowsAvx512, uyvyI420RowsAvx512, uyvyNv12RowsAvx512, accumulateRowAvx512};
+
+void cpuid(int leaf, int subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<unsigned>(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax = 0;
+    unsigned edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+Isa probeIsa()
+{
+#if defined(COLORCONVERT_X86)
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    const unsigned maxLeaf = regs[0];
+    cpuid(1, 0, regs);
+    const bool osxsave = regs[2] & (1u << 27);
+    const bool avx = regs[2] & (1u << 28);
+    if (!osxsave || !avx || maxLeaf < 7)
+        return Isa::Sse2;
+
+    // The OS must save YMM (and for AVX-512, opmask and ZMM) state.
+    const unsigned long long xcr0 = xgetbv0();
+    cpuid(7, 0, regs);
+    const bool avx2 = regs[1] & (1u << 5);
+    const bool avx512f = regs[1] & (1u << 16);
+    const bool avx512bw = regs[1] & (1u << 30);
+    if (avx512f && avx512bw && (xcr0 & 0xE6) == 0xE6)
+        return Isa::Avx512;
+    if (avx2 && (xcr0 & 0x6) == 0x6)
+        return Isa::Avx2;
+    return Isa::Sse2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+const KernelTable *tableFor(Isa isa)
+{
+    switch (isa)
+    {
+#if defined(COLORCONVERT_X86)
+    case Isa::Avx512:
+        return &Avx512Kernels;
+    case Isa::Avx2:
+        return &Avx2Kernels;
+    case Isa::Sse2:
+        return &Sse2Kernels;
+#endif
+    default:
+        return &ScalarKernels;
+    }
+}
+
+std::atomic<int> s_activeIsa{-1};
+
+const KernelTable &kernels()
+{
+    int isa = s_activeIsa.load(std::memory_order_relaxed);
+    if (isa < 0)
+    {
+        isa = static_cast<int>(detectIsa());
+        s_activeIsa.store(isa, std::memory_order_relaxed);
+    }
+    return *tableFor(static_cast<Isa>(isa));
+}
+
+void rgbToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV, int strideV,
+               int width, int height, const RgbCoefficients &coeffs)
+{
+    const KernelTable &k = kernels();
+    for (int y = 0; y < height; y += 2)
+    {
+        const bool pair = y + 1 < height;
+        const uint8_t *row0 = src + static_cast<ptrdiff_t>(y) * srcStride;
+        const uint8_t *row1 = pair ? row0 + srcStride : row0;
+        uint8_t *luma0 = dstY + static_cast<ptrdiff_t>(y) * strideY;
+        uint8_t *luma1 = pair ? luma0 + strideY : luma0;
+        uint8_t *u = dstU + static_cast<ptrdiff_t>(y / 2) * strideU;
+        uint8_t *v = dstV + static_cast<ptrdiff_t>(y / 2) * strideV;
+        const int done = k.rgbRows(row0, row1, luma0, luma1, u, v, width, coeffs);
+        if (done < width)
+            rgbRowsScalar(row0 + done * 4, row1 + done * 4, luma0 + done, luma1 + done, u + done / 2, v + done / 2, width - done, coeffs);
+    }
+}
+
+// Vertical half of the box filter: the byte-wise sum of `factor` rows. This
+// reads the whole source and is what the SIMD kernels speed up; the
+// horizontal half only touches one sum per source byte of an output row.
+void sumRows(const uint8_t *src, int srcStride, int factor, uint16_t *sums, int count)
+{
+    const KernelTable &k = kernels();
+    std::fill(sums, sums + count, uint16_t(0));
+    for (int r = 0; r < factor; ++r)
+    {
+        const uint8_t *row = src + static_cast<ptrdiff_t>(r) * srcStride;
+        const int done = k.accumulateRow(row, sums, count);
+        if (done < count)
+            accumulateRowScalar(row + done, sums + done, count - done);
+    }
+}
+
+inline uint8_t clampByte(int value)
+{
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+// Four-byte pixels; rgbOrder lists the source byte offsets of R, G and B.
+void rgbToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                      const int rgbOrder[3], std::vector<uint16_t> &scratch)
+{
+    factor = std::clamp(factor, 1, MaxPreviewFactor);
+    const int outWidth = width / factor;
+    const int outHeight = height / factor;
+    const int count = outWidth * factor * 4;
+    if (scratch.size() < static_cast<size_t>(count))
+        scratch.resize(count);
+    const int area = factor * factor;
+    for (int oy = 0; oy < outHeight; ++oy)
+    {
+        sumRows(src + static_cast<ptrdiff_t>(oy) * factor * srcStride, srcStride, factor, scratch.data(), count);
+        uint8_t *out = dst + static_cast<ptrdiff_t>(oy) * dstStride;
+        const uint16_t *sums = scratch.data();
+        for (int ox = 0; ox < outWidth; ++ox, out += 4, sums += factor * 4)
+        {
+            int total[3] = {0, 0, 0};
+            for (int i = 0; i < factor; ++i)
+            {
+                total[0] += sums[i * 4 + rgbOrder[0]];
+                total[1] += sums[i * 4 + rgbOrder[1]];
+                total[2] += sums[i * 4 + rgbOrder[2]];
+            }
+            out[0] = static_cast<uint8_t>((total[0] + area / 2) / area);
+            out[1] = static_cast<uint8_t>((total[1] + area / 2) / area);
+            out[2] = static_cast<uint8_t>((total[2] + area / 2) / area);
+            out[3] = 255;
+        }
+    }
+}
+} // namespace
+
+Isa detectIsa()
+{
+    static const Isa detected = probeIsa();
+    return detected;
+}
+
+Isa activeIsa()
+{
+    kernels();
+    return static_cast<Isa>(s_activeIsa.load(std::memory_order_relaxed));
+}
+
+Isa setIsa(Isa isa)
+{
+    const Isa capped = static_cast<int>(isa) > static_cast<int>(detectIsa()) ? detectIsa() : isa;
+    s_activeIsa.store(static_cast<int>(capped), std::memory_order_relaxed);
+    return capped;
+}
+
+const char *isaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::Sse2:
+        return "SSE2";
+    case Isa::Avx2:
+        return "AVX2";
+    case Isa::Avx512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+void rgbaToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV, int strideV,
+                int width, int height, Matrix matrix)
+{
+    rgbToI420(src, srcStride, dstY, strideY, dstU, strideU, dstV, strideV, width, height,
+              matrix == Matrix::Bt709 ? Bt709Rgb : Bt601Rgb);
+}
+
+void bgraToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV, int strideV,
+                int width, int height, Matrix matrix)
+{
+    rgbToI420(src, srcStride, dstY, strideY, dstU, strideU, dstV, strideV, width, height,
+              swapRedBlue(matrix == Matrix::Bt709 ? Bt709Rgb : Bt601Rgb));
+}
+
+void uyvyToI420(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstU, int strideU, uint8_t *dstV, int strideV,
+                int width, int height)
+{
+    const KernelTable &k = kernels();
+    for (int y = 0; y < height; y += 2)
+    {
+        const bool pair = y + 1 < height;
+        const uint8_t *row0 = src + static_cast<ptrdiff_t>(y) * srcStride;
+        const uint8_t *row1 = pair ? row0 + srcStride : row0;
+        uint8_t *luma0 = dstY + static_cast<ptrdiff_t>(y) * strideY;
+        uint8_t *luma1 = pair ? luma0 + strideY : luma0;
+        uint8_t *u = dstU + static_cast<ptrdiff_t>(y / 2) * strideU;
+        uint8_t *v = dstV + static_cast<ptrdiff_t>(y / 2) * strideV;
+        const int done = k.uyvyI420Rows(row0, row1, luma0, luma1, u, v, width);
+        if (done < width)
+            uyvyI420RowsScalar(row0 + done * 2, row1 + done * 2, luma0 + done, luma1 + done, u + done / 2, v + done / 2, width - done);
+    }
+}
+
+void uyvyToNv12(const uint8_t *src, int srcStride, uint8_t *dstY, int strideY, uint8_t *dstUV, int strideUV, int width, int height)
+{
+    const KernelTable &k = kernels();
+    for (int y = 0; y < height; y += 2)
+    {
+        const bool pair = y + 1 < height;
+        const uint8_t *row0 = src + static_cast<ptrdiff_t>(y) * srcStride;
+        const uint8_t *row1 = pair ? row0 + srcStride : row0;
+        uint8_t *luma0 = dstY + static_cast<ptrdiff_t>(y) * strideY;
+        uint8_t *luma1 = pair ? luma0 + strideY : luma0;
+        uint8_t *uv = dstUV + static_cast<ptrdiff_t>(y / 2) * strideUV;
+        const int done = k.uyvyNv12Rows(row0, row1, luma0, luma1, uv, width);
+        if (done < width)
+            uyvyNv12RowsScalar(row0 + done * 2, row1 + done * 2, luma0 + done, luma1 + done, uv + done, width - done);
+    }
+}
+
+void uyvyToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       Matrix matrix, std::vector<uint16_t> &scratch)
+{
+    factor = std::clamp(factor, 1, MaxPreviewFactor);
+    const YuvCoefficients &k = matrix == Matrix::Bt709 ? Bt709Yuv : Bt601Yuv;
+    const int outWidth = width / factor;
+    const int outHeight = height / factor;
+    // Whole macropixels, so an odd last pixel still has its chroma.
+    const int count = ((outWidth * factor + 1) & ~1) * 2;
+    if (scratch.size() < static_cast<size_t>(count))
+        scratch.resize(count);
+    const int area = factor * factor;
+    for (int oy = 0; oy < outHeight; ++oy)
+    {
+        sumRows(src + static_cast<ptrdiff_t>(oy) * factor * srcStride, srcStride, factor, scratch.data(), count);
+        uint8_t *out = dst + static_cast<ptrdiff_t>(oy) * dstStride;
+        const uint16_t *sums = scratch.data();
+        for (int ox = 0; ox < outWidth; ++ox, out += 4)
+        {
+            // Each pixel contributes its own luma and its macropixel's chroma,
+            // which keeps odd factors exact.
+            int ySum = 0;
+            int uSum = 0;
+            int vSum = 0;
+            for (int x = ox * factor; x < (ox + 1) * factor; ++x)
+            {
+                const int pair = (x & ~1) * 2;
+                ySum += sums[x * 2 + 1];
+                uSum += sums[pair];
+                vSum += sums[pair + 2];
+            }
+            const int c = (ySum + area / 2) / area - 16;
+            const int d = (uSum + area / 2) / area - 128;
+            const int e = (vSum + area / 2) / area - 128;
+            out[0] = clampByte((k.y * c + k.rv * e + 128) >> 8);
+            out[1] = clampByte((k.y * c + k.gu * d + k.gv * e + 128) >> 8);
+            out[2] = clampByte((k.y * c + k.bu * d + 128) >> 8);
+            out[3] = 255;
+        }
+    }
+}
+
+void rgbaToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       std::vector<uint16_t> &scratch)
+{
+    static constexpr int order[3] = {0, 1, 2};
+    rgbToRgbxPreview(src, srcStride, dst, dstStride, width, height, factor, order, scratch);
+}
+
+void bgraToRgbxPreview(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, int factor,
+                       std::vector<uint16_t> &scratch)
+{
+    static constexpr int order[3] = {2, 1, 0};
+    rgbToRgbxPreview(src, srcStride, dst, dstStride, width, height, factor, order, scratch);
+}
+} // namespace ColorConvert
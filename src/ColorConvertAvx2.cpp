@@ -0,0 +1,159 @@
+#include "ColorConvertKernels.h"
+
+#if defined(COLORCONVERT_X86)
+#include <immintrin.h>
+
+namespace ColorConvert
+{
+namespace
+{
+// Packs and unpacks work per 128-bit lane, so intermediate vectors hold pixels
+// in lane-interleaved order; each store below undoes that with one permute.
+template <int Shift>
+inline __m256i channel16(__m256i a, __m256i b)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    return _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, Shift), mask), _mm256_and_si256(_mm256_srli_epi32(b, Shift), mask));
+}
+
+struct Channels
+{
+    __m256i c0, c1, c2;
+};
+
+inline Channels loadChannels(const uint8_t *p)
+{
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    return {channel16<0>(a, b), channel16<8>(a, b), channel16<16>(a, b)};
+}
+
+inline __m256i luma16(const Channels &ch, __m256i k0, __m256i k1, __m256i k2)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(ch.c0, k0), _mm256_mullo_epi16(ch.c1, k1));
+    sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(ch.c2, k2));
+    sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(sum, _mm256_set1_epi16(16));
+}
+
+inline __m256i average2x2(__m256i top0, __m256i bottom0, __m256i top1, __m256i bottom1)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i sum0 = _mm256_madd_epi16(_mm256_add_epi16(top0, bottom0), ones);
+    const __m256i sum1 = _mm256_madd_epi16(_mm256_add_epi16(top1, bottom1), ones);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_packs_epi32(sum0, sum1), _mm256_set1_epi16(2)), 2);
+}
+
+inline __m256i chroma16(__m256i c0, __m256i c1, __m256i c2, const int16_t *k)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(c0, _mm256_set1_epi16(k[0])), _mm256_mullo_epi16(c1, _mm256_set1_epi16(k[1])));
+    sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(c2, _mm256_set1_epi16(k[2])));
+    sum = _mm256_srai_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(sum, _mm256_set1_epi16(128));
+}
+
+// Splits packed U/V words (lane 0 holding even pairs, lane 1 odd pairs) into
+// 16 U and 16 V bytes.
+inline void storeChroma(__m256i packedUv, uint8_t *u, uint8_t *v)
+{
+    const __m128i lo = _mm256_castsi256_si128(packedUv);
+    const __m128i hi = _mm256_extracti128_si256(packedUv, 1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(u), _mm_unpacklo_epi16(lo, hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(v), _mm_unpackhi_epi16(lo, hi));
+}
+} // namespace
+
+int rgbRowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                const RgbCoefficients &coeffs)
+{
+    const __m256i k0 = _mm256_set1_epi16(coeffs.y[0]);
+    const __m256i k1 = _mm256_set1_epi16(coeffs.y[1]);
+    const __m256i k2 = _mm256_set1_epi16(coeffs.y[2]);
+    const __m256i lumaOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const Channels a0 = loadChannels(row0 + x * 4);
+        const Channels a1 = loadChannels(row0 + x * 4 + 64);
+        const Channels b0 = loadChannels(row1 + x * 4);
+        const Channels b1 = loadChannels(row1 + x * 4 + 64);
+
+        const __m256i top = _mm256_packus_epi16(luma16(a0, k0, k1, k2), luma16(a1, k0, k1, k2));
+        const __m256i bottom = _mm256_packus_epi16(luma16(b0, k0, k1, k2), luma16(b1, k0, k1, k2));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma0 + x), _mm256_permutevar8x32_epi32(top, lumaOrder));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma1 + x), _mm256_permutevar8x32_epi32(bottom, lumaOrder));
+
+        const __m256i c0 = average2x2(a0.c0, b0.c0, a1.c0, b1.c0);
+        const __m256i c1 = average2x2(a0.c1, b0.c1, a1.c1, b1.c1);
+        const __m256i c2 = average2x2(a0.c2, b0.c2, a1.c2, b1.c2);
+        storeChroma(_mm256_packus_epi16(chroma16(c0, c1, c2, coeffs.u), chroma16(c0, c1, c2, coeffs.v)), u + x / 2, v + x / 2);
+    }
+    return x;
+}
+
+int uyvyI420RowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0 + x * 2));
+        const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0 + x * 2 + 32));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + x * 2));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + x * 2 + 32));
+
+        const __m256i top = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8));
+        const __m256i bottom = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma0 + x), _mm256_permute4x64_epi64(top, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma1 + x), _mm256_permute4x64_epi64(bottom, 0xD8));
+
+        __m256i uv = _mm256_packus_epi16(_mm256_and_si256(_mm256_avg_epu8(a0, b0), lowBytes),
+                                         _mm256_and_si256(_mm256_avg_epu8(a1, b1), lowBytes));
+        uv = _mm256_permute4x64_epi64(uv, 0xD8);
+        const __m256i planar = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_and_si256(uv, lowBytes), _mm256_srli_epi16(uv, 8)), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(u + x / 2), _mm256_castsi256_si128(planar));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(v + x / 2), _mm256_extracti128_si256(planar, 1));
+    }
+    return x;
+}
+
+int uyvyNv12RowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0 + x * 2));
+        const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0 + x * 2 + 32));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + x * 2));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + x * 2 + 32));
+
+        const __m256i top = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8));
+        const __m256i bottom = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma0 + x), _mm256_permute4x64_epi64(top, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(luma1 + x), _mm256_permute4x64_epi64(bottom, 0xD8));
+
+        const __m256i chroma = _mm256_packus_epi16(_mm256_and_si256(_mm256_avg_epu8(a0, b0), lowBytes),
+                                                   _mm256_and_si256(_mm256_avg_epu8(a1, b1), lowBytes));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(uv + x), _mm256_permute4x64_epi64(chroma, 0xD8));
+    }
+    return x;
+}
+
+int accumulateRowAvx2(const uint8_t *row, uint16_t *sums, int count)
+{
+    int i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i *lo = reinterpret_cast<__m256i *>(sums + i);
+        __m256i *hi = reinterpret_cast<__m256i *>(sums + i + 16);
+        const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+        const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i + 16)));
+        _mm256_storeu_si256(lo, _mm256_add_epi16(_mm256_loadu_si256(lo), a));
+        _mm256_storeu_si256(hi, _mm256_add_epi16(_mm256_loadu_si256(hi), b));
+    }
+    return i;
+}
+} // namespace ColorConvert
+#endif
@@ -0,0 +1,158 @@
+#include "ColorConvertKernels.h"
+
+#if defined(COLORCONVERT_X86)
+#include <immintrin.h>
+
+namespace ColorConvert
+{
+namespace
+{
+// Same scheme as the AVX2 kernels across four 128-bit lanes (needs AVX-512BW).
+template <int Shift>
+inline __m512i channel16(__m512i a, __m512i b)
+{
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+    return _mm512_packs_epi32(_mm512_and_si512(_mm512_srli_epi32(a, Shift), mask), _mm512_and_si512(_mm512_srli_epi32(b, Shift), mask));
+}
+
+struct Channels
+{
+    __m512i c0, c1, c2;
+};
+
+inline Channels loadChannels(const uint8_t *p)
+{
+    const __m512i a = _mm512_loadu_si512(p);
+    const __m512i b = _mm512_loadu_si512(p + 64);
+    return {channel16<0>(a, b), channel16<8>(a, b), channel16<16>(a, b)};
+}
+
+inline __m512i luma16(const Channels &ch, __m512i k0, __m512i k1, __m512i k2)
+{
+    __m512i sum = _mm512_add_epi16(_mm512_mullo_epi16(ch.c0, k0), _mm512_mullo_epi16(ch.c1, k1));
+    sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(ch.c2, k2));
+    sum = _mm512_srli_epi16(_mm512_add_epi16(sum, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(sum, _mm512_set1_epi16(16));
+}
+
+inline __m512i average2x2(__m512i top0, __m512i bottom0, __m512i top1, __m512i bottom1)
+{
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i sum0 = _mm512_madd_epi16(_mm512_add_epi16(top0, bottom0), ones);
+    const __m512i sum1 = _mm512_madd_epi16(_mm512_add_epi16(top1, bottom1), ones);
+    return _mm512_srli_epi16(_mm512_add_epi16(_mm512_packs_epi32(sum0, sum1), _mm512_set1_epi16(2)), 2);
+}
+
+inline __m512i chroma16(__m512i c0, __m512i c1, __m512i c2, const int16_t *k)
+{
+    __m512i sum = _mm512_add_epi16(_mm512_mullo_epi16(c0, _mm512_set1_epi16(k[0])), _mm512_mullo_epi16(c1, _mm512_set1_epi16(k[1])));
+    sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(c2, _mm512_set1_epi16(k[2])));
+    sum = _mm512_srai_epi16(_mm512_add_epi16(sum, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(sum, _mm512_set1_epi16(128));
+}
+
+inline __m512i qwordOrder()
+{
+    return _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+}
+} // namespace
+
+int rgbRowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                  const RgbCoefficients &coeffs)
+{
+    const __m512i k0 = _mm512_set1_epi16(coeffs.y[0]);
+    const __m512i k1 = _mm512_set1_epi16(coeffs.y[1]);
+    const __m512i k2 = _mm512_set1_epi16(coeffs.y[2]);
+    const __m512i lumaOrder = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m512i chromaOrder = _mm512_set_epi16(31, 23, 15, 7, 30, 22, 14, 6, 29, 21, 13, 5, 28, 20, 12, 4,
+                                                 27, 19, 11, 3, 26, 18, 10, 2, 25, 17, 9, 1, 24, 16, 8, 0);
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        const Channels a0 = loadChannels(row0 + x * 4);
+        const Channels a1 = loadChannels(row0 + x * 4 + 128);
+        const Channels b0 = loadChannels(row1 + x * 4);
+        const Channels b1 = loadChannels(row1 + x * 4 + 128);
+
+        const __m512i top = _mm512_packus_epi16(luma16(a0, k0, k1, k2), luma16(a1, k0, k1, k2));
+        const __m512i bottom = _mm512_packus_epi16(luma16(b0, k0, k1, k2), luma16(b1, k0, k1, k2));
+        _mm512_storeu_si512(luma0 + x, _mm512_permutexvar_epi32(lumaOrder, top));
+        _mm512_storeu_si512(luma1 + x, _mm512_permutexvar_epi32(lumaOrder, bottom));
+
+        const __m512i c0 = average2x2(a0.c0, b0.c0, a1.c0, b1.c0);
+        const __m512i c1 = average2x2(a0.c1, b0.c1, a1.c1, b1.c1);
+        const __m512i c2 = average2x2(a0.c2, b0.c2, a1.c2, b1.c2);
+        const __m512i planar = _mm512_permutexvar_epi16(
+            chromaOrder, _mm512_packus_epi16(chroma16(c0, c1, c2, coeffs.u), chroma16(c0, c1, c2, coeffs.v)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + x / 2), _mm512_castsi512_si256(planar));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + x / 2), _mm512_extracti64x4_epi64(planar, 1));
+    }
+    return x;
+}
+
+int uyvyI420RowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width)
+{
+    const __m512i lowBytes = _mm512_set1_epi16(0xFF);
+    const __m512i order = qwordOrder();
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        const __m512i a0 = _mm512_loadu_si512(row0 + x * 2);
+        const __m512i a1 = _mm512_loadu_si512(row0 + x * 2 + 64);
+        const __m512i b0 = _mm512_loadu_si512(row1 + x * 2);
+        const __m512i b1 = _mm512_loadu_si512(row1 + x * 2 + 64);
+
+        const __m512i top = _mm512_packus_epi16(_mm512_srli_epi16(a0, 8), _mm512_srli_epi16(a1, 8));
+        const __m512i bottom = _mm512_packus_epi16(_mm512_srli_epi16(b0, 8), _mm512_srli_epi16(b1, 8));
+        _mm512_storeu_si512(luma0 + x, _mm512_permutexvar_epi64(order, top));
+        _mm512_storeu_si512(luma1 + x, _mm512_permutexvar_epi64(order, bottom));
+
+        __m512i uv = _mm512_packus_epi16(_mm512_and_si512(_mm512_avg_epu8(a0, b0), lowBytes),
+                                         _mm512_and_si512(_mm512_avg_epu8(a1, b1), lowBytes));
+        uv = _mm512_permutexvar_epi64(order, uv);
+        const __m512i planar =
+            _mm512_permutexvar_epi64(order, _mm512_packus_epi16(_mm512_and_si512(uv, lowBytes), _mm512_srli_epi16(uv, 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + x / 2), _mm512_castsi512_si256(planar));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + x / 2), _mm512_extracti64x4_epi64(planar, 1));
+    }
+    return x;
+}
+
+int uyvyNv12RowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width)
+{
+    const __m512i lowBytes = _mm512_set1_epi16(0xFF);
+    const __m512i order = qwordOrder();
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        const __m512i a0 = _mm512_loadu_si512(row0 + x * 2);
+        const __m512i a1 = _mm512_loadu_si512(row0 + x * 2 + 64);
+        const __m512i b0 = _mm512_loadu_si512(row1 + x * 2);
+        const __m512i b1 = _mm512_loadu_si512(row1 + x * 2 + 64);
+
+        const __m512i top = _mm512_packus_epi16(_mm512_srli_epi16(a0, 8), _mm512_srli_epi16(a1, 8));
+        const __m512i bottom = _mm512_packus_epi16(_mm512_srli_epi16(b0, 8), _mm512_srli_epi16(b1, 8));
+        _mm512_storeu_si512(luma0 + x, _mm512_permutexvar_epi64(order, top));
+        _mm512_storeu_si512(luma1 + x, _mm512_permutexvar_epi64(order, bottom));
+
+        const __m512i chroma = _mm512_packus_epi16(_mm512_and_si512(_mm512_avg_epu8(a0, b0), lowBytes),
+                                                   _mm512_and_si512(_mm512_avg_epu8(a1, b1), lowBytes));
+        _mm512_storeu_si512(uv + x, _mm512_permutexvar_epi64(order, chroma));
+    }
+    return x;
+}
+
+int accumulateRowAvx512(const uint8_t *row, uint16_t *sums, int count)
+{
+    int i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        const __m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i)));
+        const __m512i b = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i + 32)));
+        _mm512_storeu_si512(sums + i, _mm512_add_epi16(_mm512_loadu_si512(sums + i), a));
+        _mm512_storeu_si512(sums + i + 32, _mm512_add_epi16(_mm512_loadu_si512(sums + i + 32), b));
+    }
+    return i;
+}
+} // namespace ColorConvert
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+// Interface between the ColorConvert dispatcher and the per-ISA kernel files.
+// Those files are built with ISA-specific compiler flags, so this header must
+// stay free of inline code that could be shared with the rest of the program.
+namespace ColorConvert
+{
+// Fixed-point (x256) coefficients in source byte order.
+struct RgbCoefficients
+{
+    int16_t y[3];
+    int16_t u[3];
+    int16_t v[3];
+};
+
+// Row kernels convert a pair of source rows (the same row twice for an odd
+// last line) and return how many leading pixels they handled, always a
+// multiple of their block width. The dispatcher finishes the remainder.
+using RgbRowsFn = int (*)(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v,
+                          int width, const RgbCoefficients &coeffs);
+using UyvyI420RowsFn = int (*)(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v,
+                               int width);
+using UyvyNv12RowsFn = int (*)(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width);
+// Adds count bytes of one source row to 16-bit running sums (previews).
+using AccumulateRowFn = int (*)(const uint8_t *row, uint16_t *sums, int count);
+
+struct KernelTable
+{
+    RgbRowsFn rgbRows;
+    UyvyI420RowsFn uyvyI420Rows;
+    UyvyNv12RowsFn uyvyNv12Rows;
+    AccumulateRowFn accumulateRow;
+};
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define COLORCONVERT_X86 1
+int rgbRowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                const RgbCoefficients &coeffs);
+int uyvyI420RowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width);
+int uyvyNv12RowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width);
+int accumulateRowSse2(const uint8_t *row, uint16_t *sums, int count);
+
+int rgbRowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                const RgbCoefficients &coeffs);
+int uyvyI420RowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width);
+int uyvyNv12RowsAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width);
+int accumulateRowAvx2(const uint8_t *row, uint16_t *sums, int count);
+
+int rgbRowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                  const RgbCoefficients &coeffs);
+int uyvyI420RowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width);
+int uyvyNv12RowsAvx512(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width);
+int accumulateRowAvx512(const uint8_t *row, uint16_t *sums, int count);
+#endif
+} // namespace ColorConvert
@@ -0,0 +1,140 @@
+#include "ColorConvertKernels.h"
+
+#if defined(COLORCONVERT_X86)
+#include <emmintrin.h>
+
+namespace ColorConvert
+{
+namespace
+{
+// One byte channel of eight packed 32-bit pixels as 16-bit lanes.
+template <int Shift>
+inline __m128i channel16(__m128i a, __m128i b)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    return _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, Shift), mask), _mm_and_si128(_mm_srli_epi32(b, Shift), mask));
+}
+
+struct Channels
+{
+    __m128i c0, c1, c2;
+};
+
+inline Channels loadChannels(const uint8_t *p)
+{
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+    return {channel16<0>(a, b), channel16<8>(a, b), channel16<16>(a, b)};
+}
+
+inline __m128i luma16(const Channels &ch, __m128i k0, __m128i k1, __m128i k2)
+{
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(ch.c0, k0), _mm_mullo_epi16(ch.c1, k1));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(ch.c2, k2));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(sum, _mm_set1_epi16(16));
+}
+
+// Rounded 2x2 average: rows are summed, then horizontal pairs.
+inline __m128i average2x2(__m128i top0, __m128i bottom0, __m128i top1, __m128i bottom1)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i sum0 = _mm_madd_epi16(_mm_add_epi16(top0, bottom0), ones);
+    const __m128i sum1 = _mm_madd_epi16(_mm_add_epi16(top1, bottom1), ones);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(sum0, sum1), _mm_set1_epi16(2)), 2);
+}
+
+inline __m128i chroma16(__m128i c0, __m128i c1, __m128i c2, const int16_t *k)
+{
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(c0, _mm_set1_epi16(k[0])), _mm_mullo_epi16(c1, _mm_set1_epi16(k[1])));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(c2, _mm_set1_epi16(k[2])));
+    sum = _mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(sum, _mm_set1_epi16(128));
+}
+} // namespace
+
+int rgbRowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width,
+                const RgbCoefficients &coeffs)
+{
+    const __m128i k0 = _mm_set1_epi16(coeffs.y[0]);
+    const __m128i k1 = _mm_set1_epi16(coeffs.y[1]);
+    const __m128i k2 = _mm_set1_epi16(coeffs.y[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const Channels a0 = loadChannels(row0 + x * 4);
+        const Channels a1 = loadChannels(row0 + x * 4 + 32);
+        const Channels b0 = loadChannels(row1 + x * 4);
+        const Channels b1 = loadChannels(row1 + x * 4 + 32);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma0 + x), _mm_packus_epi16(luma16(a0, k0, k1, k2), luma16(a1, k0, k1, k2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma1 + x), _mm_packus_epi16(luma16(b0, k0, k1, k2), luma16(b1, k0, k1, k2)));
+
+        const __m128i c0 = average2x2(a0.c0, b0.c0, a1.c0, b1.c0);
+        const __m128i c1 = average2x2(a0.c1, b0.c1, a1.c1, b1.c1);
+        const __m128i c2 = average2x2(a0.c2, b0.c2, a1.c2, b1.c2);
+        const __m128i zero = _mm_setzero_si128();
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(u + x / 2), _mm_packus_epi16(chroma16(c0, c1, c2, coeffs.u), zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(v + x / 2), _mm_packus_epi16(chroma16(c0, c1, c2, coeffs.v), zero));
+    }
+    return x;
+}
+
+int uyvyI420RowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *u, uint8_t *v, int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2 + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2 + 16));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma0 + x), _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma1 + x), _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8)));
+
+        // Averaging whole registers also averages luma, which is discarded.
+        const __m128i uv = _mm_packus_epi16(_mm_and_si128(_mm_avg_epu8(a0, b0), lowBytes), _mm_and_si128(_mm_avg_epu8(a1, b1), lowBytes));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(u + x / 2), _mm_packus_epi16(_mm_and_si128(uv, lowBytes), zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+    return x;
+}
+
+int uyvyNv12RowsSse2(const uint8_t *row0, const uint8_t *row1, uint8_t *luma0, uint8_t *luma1, uint8_t *uv, int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2 + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2 + 16));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma0 + x), _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma1 + x), _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(uv + x),
+                         _mm_packus_epi16(_mm_and_si128(_mm_avg_epu8(a0, b0), lowBytes), _mm_and_si128(_mm_avg_epu8(a1, b1), lowBytes)));
+    }
+    return x;
+}
+
+int accumulateRowSse2(const uint8_t *row, uint16_t *sums, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        __m128i *lo = reinterpret_cast<__m128i *>(sums + i);
+        __m128i *hi = reinterpret_cast<__m128i *>(sums + i + 8);
+        _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(bytes, zero)));
+    }
+    return i;
+}
+} // namespace ColorConvert
+#endif
@@ -0,0 +1,175 @@
+#include "CpuBudget.h"
+#include "Logging.h"
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#if defined(Q_OS_WIN)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+quint64 coreRange(int first, int count)
+{
+    quint64 mask = 0;
+    for (int i = first; i < first + count && i < 64; ++i)
+        mask |= quint64(1) << i;
+    return mask;
+}
+
+QString describeCores(quint64 mask)
+{
+    if (!mask)
+        return "any";
+    QStringList ranges;
+    for (int i = 0; i < 64; ++i)
+    {
+        if (!(mask & (quint64(1) << i)))
+            continue;
+        int last = i;
+        while (last + 1 < 64 && (mask & (quint64(1) << (last + 1))))
+            ++last;
+        ranges.append(last == i ? QString::number(i) : QString("%1-%2").arg(i).arg(last));
+        i = last;
+    }
+    return ranges.join(',');
+}
+} // namespace
+
+CpuBudget &CpuBudget::instance()
+{
+    static CpuBudget inst;
+    return inst;
+}
+
+void CpuBudget::setTotalCores(int cores)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_totalCores == cores)
+        return;
+    m_totalCores = std::max(0, cores);
+    rebalance();
+}
+
+int CpuBudget::totalCores() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalCores;
+}
+
+void CpuBudget::setPinning(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_pinning == enabled)
+        return;
+    m_pinning = enabled;
+    rebalance();
+}
+
+bool CpuBudget::pinning() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pinning;
+}
+
+int CpuBudget::acquire(const QString &label)
+{
+    QMutexLocker locker(&m_mutex);
+    const int id = m_nextId++;
+    Allocation allocation;
+    allocation.label = label;
+    m_allocations.insert(id, allocation);
+    rebalance();
+    return id;
+}
+
+void CpuBudget::release(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_allocations.remove(id))
+        rebalance();
+}
+
+CpuBudget::Allocation CpuBudget::allocation(int id) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_allocations.value(id);
+}
+
+QString CpuBudget::summary() const
+{
+    QMutexLocker locker(&m_mutex);
+    const int cores = usableCores();
+    if (m_allocations.isEmpty())
+        return QString("CPU: %1 cores idle").arg(cores);
+    const Allocation &first = m_allocations.first();
+    return QString("CPU: %1 cores, capture %2, %3 encoder threads per source%4")
+        .arg(cores)
+        .arg(m_captureCoreCount)
+        .arg(first.encoderThreads)
+        .arg(m_pinning ? QString(" (pinned %1 / %2)").arg(describeCores(first.captureCores), describeCores(first.encoderCores))
+                       : QString());
+}
+
+int CpuBudget::usableCores() const
+{
+    const int available = std::clamp(QThread::idealThreadCount(), 1, 64);
+    return m_totalCores > 0 ? std::min(m_totalCores, available) : available;
+}
+
+void CpuBudget::rebalance()
+{
+    const int cores = usableCores();
+    const int sources = m_allocations.size();
+    // Capture threads mostly wait on the network; one core per four sources,
+    // never more than a quarter of the budget.
+    m_captureCoreCount = cores > 1 && sources > 0 ? std::clamp((sources + 3) / 4, 1, std::max(1, cores / 4)) : 0;
+    const int encoderCores = std::max(1, cores - m_captureCoreCount);
+    const int threads = sources > 0 ? std::max(1, encoderCores / sources) : encoderCores;
+    const quint64 captureMask = m_pinning && m_captureCoreCount > 0 ? coreRange(0, m_captureCoreCount) : 0;
+    const quint64 encoderMask = m_pinning && m_captureCoreCount > 0 ? coreRange(m_captureCoreCount, encoderCores) : 0;
+
+    for (Allocation &allocation : m_allocations)
+    {
+        allocation.encoderThreads = threads;
+        allocation.captureCores = captureMask;
+        allocation.encoderCores = encoderMask;
+    }
+    m_generation.fetch_add(1, std::memory_order_release);
+
+    if (sources > 0)
+        Logger::instance().log(QString("CPU budget: %1 sources on %2 cores, capture cores %3, encoder cores %4, %5 encoder threads each")
+                                   .arg(sources)
+                                   .arg(cores)
+                                   .arg(m_pinning ? describeCores(captureMask) : QString::number(m_captureCoreCount))
+                                   .arg(m_pinning ? describeCores(encoderMask) : QString::number(encoderCores))
+                                   .arg(threads));
+}
+
+bool CpuBudget::pinCurrentThread(quint64 cores)
+{
+    // An empty mask lifts any earlier pinning.
+    if (!cores)
+        cores = coreRange(0, std::clamp(QThread::idealThreadCount(), 1, 64));
+#if defined(Q_OS_WIN)
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(cores)) != 0;
+#elif defined(Q_OS_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64; ++i)
+    {
+        if (cores & (quint64(1) << i))
+            CPU_SET(i, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,75 @@
+#include "EncoderProfile.h"
+
+bool EncoderProfile::sameSettings(const EncoderProfile &other) const
+{
+    return preset == other.preset && tune == other.tune && rateControl == other.rateControl && crf == other.crf &&
+           bitrateKbps == other.bitrateKbps && qFuzzyCompare(gopSeconds, other.gopSeconds) && bFrames == other.bFrames &&
+           threads == other.threads && threading == other.threading;
+}
+
+QVector<EncoderProfile> EncoderProfile::presets()
+{
+    QVector<EncoderProfile> list;
+
+    EncoderProfile balanced;
+    list.append(balanced);
+
+    EncoderProfile archive;
+    archive.name = "Archive";
+    archive.preset = "faster";
+    archive.crf = 18;
+    archive.bFrames = 3;
+    list.append(archive);
+
+    // Cheapest per frame; suits many sources on one machine.
+    EncoderProfile lowCpu;
+    lowCpu.name = "Low CPU";
+    lowCpu.preset = "ultrafast";
+    lowCpu.crf = 23;
+    lowCpu.gopSeconds = 4.0;
+    lowCpu.bFrames = 0;
+    list.append(lowCpu);
+
+    // Short closed GOPs without B-frames scrub and cut cleanly in editors.
+    EncoderProfile editFriendly;
+    editFriendly.name = "Edit-friendly";
+    editFriendly.preset = "veryfast";
+    editFriendly.tune = "fastdecode";
+    editFriendly.crf = 18;
+    editFriendly.gopSeconds = 0.5;
+    editFriendly.bFrames = 0;
+    list.append(editFriendly);
+
+    // The previous fixed settings: no lookahead or frame threading.
+    EncoderProfile lowLatency;
+    lowLatency.name = "Low latency";
+    lowLatency.preset = "ultrafast";
+    lowLatency.tune = "zerolatency";
+    lowLatency.crf = 23;
+    lowLatency.gopSeconds = 1.0;
+    lowLatency.bFrames = 0;
+    lowLatency.threading = EncoderThreading::Slice;
+    list.append(lowLatency);
+
+    return list;
+}
+
+EncoderProfile EncoderProfile::named(const QString &name)
+{
+    for (const EncoderProfile &profile : presets())
+    {
+        if (profile.name == name)
+            return profile;
+    }
+    return EncoderProfile();
+}
+
+QStringList EncoderProfile::x264Presets()
+{
+    return {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium", "slow"};
+}
+
+QStringList EncoderProfile::x264Tunes()
+{
+    return {"", "film", "animation", "grain", "stillimage", "fastdecode", "zerolatency"};
+}
@@ -1,11 +1,27 @@
 #include "FfmpegWriter.h"
+#include "AllocationTrace.h"
 #include "Logging.h"
+#include "ColorConvert.h"
+#include "WorkerPool.h"
 #include <QDir>
+#include <QFile>
 #include <QDebug>
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+#include <algorithm>
+#include <cmath>
 
 FfmpegWriter::FfmpegWriter()
-    : m_fmtCtx(nullptr), m_videoStream(nullptr), m_videoCodecCtx(nullptr), m_sws(nullptr), m_convertedFrame(nullptr),
-      m_startMs(0), m_segmentIndex(1), m_inputWidth(0), m_inputHeight(0), m_inputFormat(AV_PIX_FMT_NONE)
+    : m_videoCodecCtx(nullptr), m_codecPar(nullptr), m_prepareThread(nullptr), m_sws(nullptr), m_passThroughFrame(nullptr),
+      m_convertedFrame(nullptr), m_segmentIndex(1), m_inputWidth(0), m_inputHeight(0), m_inputFormat(AV_PIX_FMT_NONE),
+      m_colorMatrix(ColorConvert::Matrix::Bt709), m_slices(1), m_firstInputPts(AV_NOPTS_VALUE), m_nextPts(0), m_frameDuration(1),
+      m_segmentLength(0), m_nextBoundaryPts(0), m_pendingBoundaryPts(AV_NOPTS_VALUE), m_audioCodecCtx(nullptr), m_audioPar(nullptr),
+      m_swr(nullptr), m_audioFifo(nullptr), m_audioFrame(nullptr), m_audioPacket(nullptr), m_audioData(nullptr), m_audioDataSamples(0),
+      m_audioInChannels(0), m_audioInRate(0), m_audioFrameSize(0), m_audioFifoPts(AV_NOPTS_VALUE), m_duplicatedFrames(0),
+      m_droppedFrames(0), m_audioResyncs(0), m_bytesWritten(0)
 {
     avformat_network_init();
 }
@@ -16,37 +32,26 @@ FfmpegWriter::~FfmpegWriter()
     avformat_network_deinit();
 }
 
-QString FfmpegWriter::nextFileName()
+QString FfmpegWriter::fileNameForSegment(int index) const
 {
-    QDateTime now = QDateTime::currentDateTime();
-    QString ts = now.toString("yyyyMMdd_HHmmss");
+    // Named from the recording start plus the segment's nominal offset, so the
+    // next file can be opened before its first frame arrives.
+    const QDateTime start = m_recordingStart.addSecs(static_cast<qint64>(index - 1) * m_cfg.segmentMinutes * 60);
+    const QString ts = start.toString("yyyyMMdd_HHmmss");
     if (m_cfg.segmented)
     {
-        return QString("%1/%2_%3_part%4.mp4").arg(m_cfg.outputFolder, m_cfg.sourceLabel, ts, QString::number(m_segmentIndex).rightJustified(2, '0'));
+        return QString("%1/%2_%3_part%4%5.%6")
+            .arg(m_cfg.outputFolder, m_cfg.sourceLabel, ts, QString::number(index).rightJustified(2, '0'), m_fileSuffix, fileExtension());
     }
-    return QString("%1/%2_%3.mp4").arg(m_cfg.outputFolder, m_cfg.sourceLabel, ts);
+    return QString("%1/%2_%3%4.%5").arg(m_cfg.outputFolder, m_cfg.sourceLabel, ts, m_fileSuffix, fileExtension());
 }
 
-bool FfmpegWriter::openContext(const QString &path)
+bool FfmpegWriter::openEncoder()
 {
-    avformat_alloc_output_context2(&m_fmtCtx, nullptr, "mp4", path.toUtf8().constData());
-    if (!m_fmtCtx)
-    {
-        Logger::instance().log("Failed to alloc output context");
-        return false;
-    }
-
     const AVCodec *videoCodec = avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!videoCodec)
     {
-        Logger::instance().log("Missing codecs");
-        return false;
-    }
-
-    m_videoStream = avformat_new_stream(m_fmtCtx, videoCodec);
-    if (!m_videoStream)
-    {
-        Logger::instance().log("Failed to create streams");
+        Logger::instance().log(LogLevel::Error, "Missing codecs");
         return false;
     }
 
@@ -68,61 +73,694 @@ bool FfmpegWriter::openContext(const QString &path)
         }
         if (!supported)
         {
-            Logger::instance().log("Requested pixel format not supported by H.264 encoder; falling back to YUV420P");
+            Logger::instance().log(LogLevel::Warning, "Requested pixel format not supported by H.264 encoder; falling back to YUV420P");
             m_videoCodecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
         }
     }
-    m_videoCodecCtx->time_base = {m_cfg.fpsDen, m_cfg.fpsNum};
+    // CFR counts pts in frames; VFR keeps source timing on a 90 kHz clock.
+    if (m_cfg.constantFrameRate)
+        m_videoCodecCtx->time_base = {m_cfg.fpsDen, m_cfg.fpsNum};
+    else
+        m_videoCodecCtx->time_base = {1, 90000};
     m_videoCodecCtx->framerate = {m_cfg.fpsNum, m_cfg.fpsDen};
-    m_videoCodecCtx->gop_size = m_cfg.fps;
-    m_videoCodecCtx->max_b_frames = 0;
-    m_videoCodecCtx->bit_rate = 12000000;
+    // NDI sends HD as BT.709 and SD as BT.601; RGB input is converted to match.
+    // Renditions are scaled from the master's picture and keep its matrix.
+    if (m_master)
+        m_colorMatrix = m_master->m_colorMatrix;
+    else
+        m_colorMatrix = m_cfg.height >= 720 ? ColorConvert::Matrix::Bt709 : ColorConvert::Matrix::Bt601;
+    m_videoCodecCtx->color_range = AVCOL_RANGE_MPEG;
+    // Auto picks one slice per quarter of a 1080p frame, capped by the pool size.
+    const int maxSlices = std::max(1, m_cfg.height / 16);
+    if (m_cfg.conversionSlices > 0)
+        m_slices = std::min(m_cfg.conversionSlices, maxSlices);
+    else
+        m_slices = std::clamp((m_cfg.width * m_cfg.height + 960 * 544 - 1) / (960 * 544), 1,
+                              std::min(WorkerPool::instance().threadCount(), maxSlices));
+    if (m_colorMatrix == ColorConvert::Matrix::Bt709)
+    {
+        m_videoCodecCtx->colorspace = AVCOL_SPC_BT709;
+        m_videoCodecCtx->color_primaries = AVCOL_PRI_BT709;
+        m_videoCodecCtx->color_trc = AVCOL_TRC_BT709;
+    }
+    else
+    {
+        m_videoCodecCtx->colorspace = AVCOL_SPC_SMPTE170M;
+        m_videoCodecCtx->color_primaries = AVCOL_PRI_SMPTE170M;
+        m_videoCodecCtx->color_trc = AVCOL_TRC_SMPTE170M;
+    }
+    const EncoderProfile &profile = m_cfg.encoder;
+    const double fps = static_cast<double>(m_cfg.fpsNum) / m_cfg.fpsDen;
+    m_videoCodecCtx->gop_size = std::max(1, static_cast<int>(profile.gopSeconds * fps + 0.5));
+    m_videoCodecCtx->max_b_frames = std::max(0, profile.bFrames);
+    m_videoCodecCtx->thread_count = std::max(0, profile.threads);
+    m_videoCodecCtx->thread_type = profile.threading == EncoderThreading::Slice ? FF_THREAD_SLICE : FF_THREAD_FRAME;
 
-    if (m_fmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
+    if (containerNeedsGlobalHeader())
         m_videoCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
     AVDictionary *videoOpts = nullptr;
-    av_dict_set(&videoOpts, "preset", "ultrafast", 0);
-    av_dict_set(&videoOpts, "tune", "zerolatency", 0);
-    av_dict_set(&videoOpts, "crf", "23", 0);
+    av_dict_set(&videoOpts, "preset", profile.preset.toUtf8().constData(), 0);
+    if (!profile.tune.isEmpty())
+        av_dict_set(&videoOpts, "tune", profile.tune.toUtf8().constData(), 0);
+    const int64_t bitrate = static_cast<int64_t>(profile.bitrateKbps) * 1000;
+    switch (profile.rateControl)
+    {
+    case RateControl::Crf:
+        av_dict_set_int(&videoOpts, "crf", profile.crf, 0);
+        break;
+    case RateControl::Cbr:
+        m_videoCodecCtx->bit_rate = bitrate;
+        m_videoCodecCtx->rc_min_rate = bitrate;
+        m_videoCodecCtx->rc_max_rate = bitrate;
+        m_videoCodecCtx->rc_buffer_size = static_cast<int>(bitrate);
+        av_dict_set(&videoOpts, "nal-hrd", "cbr", 0);
+        break;
+    case RateControl::Vbr:
+        m_videoCodecCtx->bit_rate = bitrate;
+        m_videoCodecCtx->rc_max_rate = bitrate * 3 / 2;
+        m_videoCodecCtx->rc_buffer_size = static_cast<int>(bitrate * 2);
+        break;
+    }
+    // Keyframes requested at segment boundaries must be IDRs so each file decodes on its own.
+    av_dict_set(&videoOpts, "forced-idr", "1", 0);
 
     if (avcodec_open2(m_videoCodecCtx, videoCodec, &videoOpts) < 0)
     {
-        Logger::instance().log("Failed to open video codec");
+        Logger::instance().log(LogLevel::Error, "Failed to open video codec");
         av_dict_free(&videoOpts);
         return false;
     }
     av_dict_free(&videoOpts);
+    Logger::instance().log(QString("Encoder for %1: profile %2, preset %3, gop %4, b-frames %5, %6 threads, %7 threading")
+                               .arg(m_cfg.sourceLabel, profile.name, profile.preset)
+                               .arg(m_videoCodecCtx->gop_size)
+                               .arg(m_videoCodecCtx->max_b_frames)
+                               .arg(m_videoCodecCtx->thread_count > 0 ? QString::number(m_videoCodecCtx->thread_count) : QString("auto"))
+                               .arg(profile.threading == EncoderThreading::Slice ? "slice" : "frame"));
+
+    m_codecPar = avcodec_parameters_alloc();
+    if (!m_codecPar || avcodec_parameters_from_context(m_codecPar, m_videoCodecCtx) < 0)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to copy video params");
+        return false;
+    }
+
+    if (!createFramePool())
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to allocate frame pool");
+        return false;
+    }
+
+    m_frameDuration = std::max<int64_t>(1, av_rescale_q(1, AVRational{m_cfg.fpsDen, m_cfg.fpsNum}, m_videoCodecCtx->time_base));
+    m_segmentLength = m_cfg.segmented ? av_rescale_q(static_cast<int64_t>(m_cfg.segmentMinutes) * 60, AVRational{1, 1}, m_videoCodecCtx->time_base) : 0;
+    m_nextBoundaryPts = m_segmentLength;
+    m_pendingBoundaryPts = AV_NOPTS_VALUE;
+    m_pendingFolderSwitch = false;
+    m_appliedBitrateScale = 1.0;
+    m_firstInputPts = AV_NOPTS_VALUE;
+    m_nextPts = 0;
+    return true;
+}
+
+void FfmpegWriter::closeEncoder()
+{
+    if (m_videoCodecCtx)
+    {
+        avcodec_free_context(&m_videoCodecCtx);
+    }
+    avcodec_parameters_free(&m_codecPar);
+    releaseScalers();
+    m_inputFormat = AV_PIX_FMT_NONE;
+    m_convertedFrame = nullptr;
+    av_frame_free(&m_passThroughFrame);
+    m_pictures.clear();
+}
+
+const char *FfmpegWriter::containerName() const
+{
+    if (m_cfg.discardOutput)
+        return "null";
+    if (m_cfg.container == ContainerMode::Matroska)
+        return "matroska";
+    // MP4 has no PCM audio mapping that players agree on; PCM goes to MOV.
+    return m_cfg.audioCodec == AudioCodec::Pcm ? "mov" : "mp4";
+}
+
+const char *FfmpegWriter::fileExtension() const
+{
+    return m_cfg.container == ContainerMode::Matroska && !m_cfg.discardOutput ? "mkv" : containerName();
+}
+
+bool FfmpegWriter::containerNeedsGlobalHeader() const
+{
+    const AVOutputFormat *container = av_guess_format(containerName(), nullptr, nullptr);
+    return container && (container->flags & AVFMT_GLOBALHEADER);
+}
+
+bool FfmpegWriter::openAudioEncoder()
+{
+    if (m_cfg.audioCodec == AudioCodec::None)
+        return true;
+
+    const bool aac = m_cfg.audioCodec == AudioCodec::Aac;
+    const AVCodec *audioCodec = avcodec_find_encoder(aac ? AV_CODEC_ID_AAC : AV_CODEC_ID_PCM_S16LE);
+    if (!audioCodec)
+    {
+        Logger::instance().log(LogLevel::Error, "Missing audio codec");
+        return false;
+    }
+    m_audioCodecCtx = avcodec_alloc_context3(audioCodec);
+    if (!m_audioCodecCtx)
+        return false;
+    m_audioCodecCtx->sample_rate = m_cfg.audioSampleRate;
+    av_channel_layout_default(&m_audioCodecCtx->ch_layout, m_cfg.audioChannels);
+    m_audioCodecCtx->sample_fmt = aac ? AV_SAMPLE_FMT_FLTP : AV_SAMPLE_FMT_S16;
+    if (aac)
+        m_audioCodecCtx->bit_rate = 96000 * m_cfg.audioChannels;
+    m_audioCodecCtx->time_base = {1, m_cfg.audioSampleRate};
+    if (containerNeedsGlobalHeader())
+        m_audioCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(m_audioCodecCtx, audioCodec, nullptr) < 0)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to open audio codec");
+        return false;
+    }
+
+    m_audioPar = avcodec_parameters_alloc();
+    if (!m_audioPar || avcodec_parameters_from_context(m_audioPar, m_audioCodecCtx) < 0)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to copy audio params");
+        return false;
+    }
+
+    // PCM takes any frame size; 10 ms keeps its packets small.
+    m_audioFrameSize = m_audioCodecCtx->frame_size > 0 ? m_audioCodecCtx->frame_size : m_cfg.audioSampleRate / 100;
+    m_audioFifo = av_audio_fifo_alloc(m_audioCodecCtx->sample_fmt, m_cfg.audioChannels, m_audioFrameSize * 4);
+    m_audioFrame = av_frame_alloc();
+    m_audioPacket = av_packet_alloc();
+    if (!m_audioFifo || !m_audioFrame || !m_audioPacket)
+        return false;
+    m_audioFrame->nb_samples = m_audioFrameSize;
+    m_audioFrame->format = m_audioCodecCtx->sample_fmt;
+    m_audioFrame->sample_rate = m_audioCodecCtx->sample_rate;
+    if (av_channel_layout_copy(&m_audioFrame->ch_layout, &m_audioCodecCtx->ch_layout) < 0 || av_frame_get_buffer(m_audioFrame, 0) < 0)
+        return false;
+    m_audioFifoPts = AV_NOPTS_VALUE;
+    return true;
+}
+
+void FfmpegWriter::closeAudioEncoder()
+{
+    if (m_audioCodecCtx)
+    {
+        avcodec_free_context(&m_audioCodecCtx);
+    }
+    avcodec_parameters_free(&m_audioPar);
+    swr_free(&m_swr);
+    m_audioInChannels = 0;
+    m_audioInRate = 0;
+    if (m_audioFifo)
+    {
+        av_audio_fifo_free(m_audioFifo);
+        m_audioFifo = nullptr;
+    }
+    av_frame_free(&m_audioFrame);
+    av_packet_free(&m_audioPacket);
+    if (m_audioData)
+    {
+        av_freep(&m_audioData[0]);
+        av_freep(&m_audioData);
+    }
+    m_audioDataSamples = 0;
+}
+
+bool FfmpegWriter::writeAudio(const uint8_t *const *planes, int channels, int samples, int sampleRate, int64_t timestamp)
+{
+    QMutexLocker locker(&m_audioMutex);
+    const int64_t origin = m_firstInputPts.load();
+    // Audio is timed against the first video frame; anything earlier is dropped.
+    if (!m_audioCodecCtx || origin == AV_NOPTS_VALUE || timestamp < origin || samples <= 0 || channels <= 0)
+        return false;
+
+    if (!m_swr || channels != m_audioInChannels || sampleRate != m_audioInRate)
+    {
+        AVChannelLayout inLayout;
+        av_channel_layout_default(&inLayout, channels);
+        swr_free(&m_swr);
+        const int rc = swr_alloc_set_opts2(&m_swr, &m_audioCodecCtx->ch_layout, m_audioCodecCtx->sample_fmt, m_audioCodecCtx->sample_rate,
+                                           &inLayout, AV_SAMPLE_FMT_FLTP, sampleRate, 0, nullptr);
+        av_channel_layout_uninit(&inLayout);
+        if (rc < 0 || swr_init(m_swr) < 0)
+        {
+            Logger::instance().log(LogLevel::Warning, QString("Unsupported NDI audio (%1 ch, %2 Hz) for %3").arg(channels).arg(sampleRate).arg(m_cfg.sourceLabel));
+            swr_free(&m_swr);
+            return false;
+        }
+        m_audioInChannels = channels;
+        m_audioInRate = sampleRate;
+    }
+
+    const int capacity = swr_get_out_samples(m_swr, samples);
+    if (capacity > m_audioDataSamples)
+    {
+        if (m_audioData)
+        {
+            av_freep(&m_audioData[0]);
+            av_freep(&m_audioData);
+        }
+        m_audioDataSamples = 0;
+        if (av_samples_alloc_array_and_samples(&m_audioData, nullptr, m_cfg.audioChannels, capacity, m_audioCodecCtx->sample_fmt, 0) < 0)
+            return false;
+        m_audioDataSamples = capacity;
+    }
+    const int converted = swr_convert(m_swr, m_audioData, capacity, const_cast<const uint8_t **>(planes), samples);
+    if (converted <= 0)
+        return converted == 0;
+
+    // Blocks are placed by sample count; the source timestamp only resyncs
+    // the count when it drifts further than jitter would explain.
+    const int64_t pts = av_rescale_q(timestamp - origin, InputTimeBase, m_audioCodecCtx->time_base);
+    int skip = 0;
+    if (m_audioFifoPts == AV_NOPTS_VALUE)
+    {
+        m_audioFifoPts = pts;
+    }
+    else
+    {
+        const int64_t expected = m_audioFifoPts + av_audio_fifo_size(m_audioFifo);
+        const int64_t tolerance = m_audioCodecCtx->sample_rate / 20;
+        if (pts > expected + tolerance)
+        {
+            // Gap in the source: the partial frame is dropped and timing restarts here.
+            ++m_audioResyncs;
+            av_audio_fifo_reset(m_audioFifo);
+            m_audioFifoPts = pts;
+        }
+        else if (pts < expected - tolerance)
+        {
+            // Overlap: samples already written are skipped.
+            ++m_audioResyncs;
+            skip = static_cast<int>(std::min<int64_t>(converted, expected - pts));
+        }
+    }
+
+    if (skip < converted)
+    {
+        void *data[AV_NUM_DATA_POINTERS] = {};
+        const int bytesPerSample = av_get_bytes_per_sample(m_audioCodecCtx->sample_fmt);
+        if (av_sample_fmt_is_planar(m_audioCodecCtx->sample_fmt))
+        {
+            for (int c = 0; c < m_cfg.audioChannels; ++c)
+                data[c] = m_audioData[c] + static_cast<ptrdiff_t>(skip) * bytesPerSample;
+        }
+        else
+        {
+            data[0] = m_audioData[0] + static_cast<ptrdiff_t>(skip) * bytesPerSample * m_cfg.audioChannels;
+        }
+        if (av_audio_fifo_write(m_audioFifo, data, converted - skip) < converted - skip)
+            return false;
+    }
+
+    while (av_audio_fifo_size(m_audioFifo) >= m_audioFrameSize)
+    {
+        if (!encodeAudioFrame(m_audioFrameSize))
+            return false;
+    }
+    return true;
+}
+
+bool FfmpegWriter::encodeAudioFrame(int samples)
+{
+    if (av_frame_make_writable(m_audioFrame) < 0)
+        return false;
+    m_audioFrame->nb_samples = samples;
+    if (av_audio_fifo_read(m_audioFifo, reinterpret_cast<void **>(m_audioFrame->data), samples) < samples)
+        return false;
+    m_audioFrame->pts = m_audioFifoPts;
+    m_audioFifoPts += samples;
+    return encodeAudio(m_audioFrame);
+}
 
-    if (avcodec_parameters_from_context(m_videoStream->codecpar, m_videoCodecCtx) < 0)
+bool FfmpegWriter::encodeAudio(AVFrame *frame)
+{
+    if (avcodec_send_frame(m_audioCodecCtx, frame) < 0)
+        return false;
+    while (avcodec_receive_packet(m_audioCodecCtx, m_audioPacket) == 0)
     {
-        Logger::instance().log("Failed to copy video params");
+        QMutexLocker muxLocker(&m_muxMutex);
+        keepRecent(m_audioPacket, false);
+        if (!m_armed.load(std::memory_order_relaxed))
+        {
+            for (FfmpegWriter *rendition : m_renditions)
+                rendition->writeRenditionAudio(m_audioPacket);
+            writeAudioPacket(m_audioPacket);
+        }
+        av_packet_unref(m_audioPacket);
+    }
+    return true;
+}
+
+void FfmpegWriter::flushAudio()
+{
+    if (!m_audioCodecCtx)
+        return;
+    const int remaining = av_audio_fifo_size(m_audioFifo);
+    if (remaining > 0)
+        encodeAudioFrame(remaining);
+    encodeAudio(nullptr);
+}
+
+void FfmpegWriter::writeAudioPacket(AVPacket *pkt)
+{
+    const AVRational videoTb = m_muxerSetup.videoTimeBase;
+    const AVRational audioTb = m_muxerSetup.audioTimeBase;
+    if (m_retiringMuxer.fmtCtx)
+    {
+        if (pkt->pts < av_rescale_q(m_retiringMuxer.endPts, videoTb, audioTb))
+        {
+            writePacket(m_retiringMuxer, m_retiringMuxer.audioStream, pkt, audioTb, av_rescale_q(m_retiringMuxer.startPts, videoTb, audioTb));
+            return;
+        }
+        retireMuxer(m_retiringMuxer);
+    }
+    // Audio skips the frame queue and runs ahead of video; packets past the
+    // current segment wait for the video switch. They never go into the
+    // current file: if video falls that far behind, the oldest are dropped.
+    if (m_muxer.endPts != AV_NOPTS_VALUE && pkt->pts >= av_rescale_q(m_muxer.endPts, videoTb, audioTb))
+    {
+        if (m_heldAudio.size() >= MaxHeldAudioPackets)
+        {
+            av_packet_free(&m_heldAudio.first());
+            m_heldAudio.removeFirst();
+            Logger::instance().log(m_heldAudioLog, LogLevel::Warning,
+                                   QString("Video of %1 is behind the segment switch; dropping audio held for the next segment")
+                                       .arg(m_cfg.sourceLabel));
+        }
+        if (AVPacket *held = av_packet_clone(pkt))
+            m_heldAudio.append(held);
+        return;
+    }
+    writePacket(m_muxer, m_muxer.audioStream, pkt, audioTb, av_rescale_q(m_muxer.startPts, videoTb, audioTb));
+}
+
+bool FfmpegWriter::writePacket(Muxer &muxer, AVStream *stream, AVPacket *pkt, AVRational timeBase, int64_t startPts)
+{
+    const int size = pkt->size;
+    if (!muxPacket(muxer, stream, pkt, timeBase, startPts))
+        return false;
+    (m_master ? m_master : this)->m_bytesWritten.fetchAndAddRelaxed(size);
+    return true;
+}
+
+bool FfmpegWriter::muxPacket(Muxer &muxer, AVStream *stream, AVPacket *pkt, AVRational timeBase, int64_t startPts)
+{
+    // Every segment starts at zero; the encoder clocks keep running.
+    pkt->stream_index = stream->index;
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts -= startPts;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts -= startPts;
+    av_packet_rescale_ts(pkt, timeBase, stream->time_base);
+    AllocationTrace::ForeignScope ffmpeg;
+    return av_interleaved_write_frame(muxer.fmtCtx, pkt) >= 0;
+}
+
+bool FfmpegWriter::interleave(const QVector<AVPacket *> &video, AVRational videoTimeBase, const QVector<AVPacket *> &audio,
+                              AVRational audioTimeBase, const std::function<bool(AVPacket *)> &writeVideo,
+                              const std::function<bool(AVPacket *)> &writeAudio)
+{
+    bool ok = true;
+    int next = 0;
+    for (AVPacket *pkt : video)
+    {
+        while (next < audio.size() && av_compare_ts(audio[next]->dts, audioTimeBase, pkt->dts, videoTimeBase) <= 0)
+            ok = writeAudio(audio[next++]) && ok;
+        ok = writeVideo(pkt) && ok;
+    }
+    while (next < audio.size())
+        ok = writeAudio(audio[next++]) && ok;
+    return ok;
+}
+
+bool FfmpegWriter::openMuxer(Muxer &muxer, const QString &path, const MuxerSetup &setup)
+{
+    avformat_alloc_output_context2(&muxer.fmtCtx, nullptr, setup.format, path.toUtf8().constData());
+    if (!muxer.fmtCtx)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to alloc output context");
         return false;
     }
 
-    m_videoStream->time_base = m_videoCodecCtx->time_base;
-    m_videoStream->avg_frame_rate = {m_cfg.fpsNum, m_cfg.fpsDen};
-    m_videoStream->r_frame_rate = {m_cfg.fpsNum, m_cfg.fpsDen};
+    muxer.videoStream = avformat_new_stream(muxer.fmtCtx, nullptr);
+    if (!muxer.videoStream || avcodec_parameters_copy(muxer.videoStream->codecpar, setup.videoPar) < 0)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to create streams");
+        closeMuxer(muxer);
+        return false;
+    }
+    muxer.videoStream->time_base = setup.videoTimeBase;
+    muxer.videoStream->avg_frame_rate = setup.frameRate;
+    muxer.videoStream->r_frame_rate = setup.frameRate;
+
+    if (setup.audioPar)
+    {
+        muxer.audioStream = avformat_new_stream(muxer.fmtCtx, nullptr);
+        if (!muxer.audioStream || avcodec_parameters_copy(muxer.audioStream->codecpar, setup.audioPar) < 0)
+        {
+            Logger::instance().log(LogLevel::Error, "Failed to create streams");
+            closeMuxer(muxer);
+            return false;
+        }
+        muxer.audioStream->time_base = setup.audioTimeBase;
+    }
 
-    if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE))
+    if (!(muxer.fmtCtx->oformat->flags & AVFMT_NOFILE))
     {
-        if (avio_open(&m_fmtCtx->pb, path.toUtf8().constData(), AVIO_FLAG_WRITE) < 0)
+        muxer.file = new AsyncFileWriter(setup.diskCounters);
+        if (!muxer.file->open(path, setup.file))
         {
-            Logger::instance().log("Failed to open output file");
+            Logger::instance().log(LogLevel::Error, "Failed to open output file");
+            closeMuxer(muxer);
             return false;
         }
+        muxer.fmtCtx->pb = muxer.file->avio();
     }
 
-    if (avformat_write_header(m_fmtCtx, nullptr) < 0)
+    AVDictionary *options = nullptr;
+    if (setup.container == ContainerMode::FragmentedMp4)
     {
-        Logger::instance().log("Failed to write header");
+        // An empty moov up front and self-contained fragments after it; the
+        // trailer only adds an index, so nothing is rewritten at stop.
+        if (setup.fragmentSeconds > 0)
+        {
+            av_dict_set(&options, "movflags", "empty_moov+default_base_moof", 0);
+            av_dict_set_int(&options, "frag_duration", static_cast<int64_t>(setup.fragmentSeconds) * 1000000, 0);
+        }
+        else
+        {
+            av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        }
+    }
+    else if (setup.container == ContainerMode::Matroska && setup.fragmentSeconds > 0)
+    {
+        av_dict_set_int(&options, "cluster_time_limit", static_cast<int64_t>(setup.fragmentSeconds) * 1000, 0);
+    }
+    // Both muxers only write to the file when a fragment or cluster is
+    // complete, so flushing after every packet hands each one to the OS as
+    // soon as it exists and costs nothing in between.
+    if (setup.container != ContainerMode::Mp4)
+        muxer.fmtCtx->flush_packets = 1;
+    const int headerResult = avformat_write_header(muxer.fmtCtx, &options);
+    av_dict_free(&options);
+    if (headerResult < 0)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to write header");
+        closeMuxer(muxer);
         return false;
     }
+    muxer.headerWritten = true;
+    muxer.path = path;
+    return true;
+}
+
+bool FfmpegWriter::closeMuxer(Muxer &muxer)
+{
+    bool ok = true;
+    if (muxer.fmtCtx)
+    {
+        if (muxer.headerWritten)
+            ok = av_write_trailer(muxer.fmtCtx) >= 0;
+        // The context is owned by the file writer.
+        muxer.fmtCtx->pb = nullptr;
+        avformat_free_context(muxer.fmtCtx);
+    }
+    if (muxer.file)
+    {
+        if (!muxer.file->close())
+        {
+            Logger::instance().log(LogLevel::Error, QString("Output file %1 is incomplete").arg(muxer.path));
+            ok = false;
+        }
+        delete muxer.file;
+    }
+    muxer = Muxer();
+    return ok;
+}
+
+void FfmpegWriter::prepareNextMuxer()
+{
+    const QString path = fileNameForSegment(m_segmentIndex + 1);
+    const MuxerSetup setup = m_muxerSetup;
+    m_prepareThread = QThread::create([this, path, setup]() { openMuxer(m_nextMuxer, path, setup); });
+    m_prepareThread->start();
+}
+
+void FfmpegWriter::discardPreparedMuxer()
+{
+    if (!m_prepareThread)
+        return;
+    m_prepareThread->wait();
+    delete m_prepareThread;
+    m_prepareThread = nullptr;
+    if (m_nextMuxer.fmtCtx)
+    {
+        // Never received a frame; drop the header-only file.
+        const QString path = m_nextMuxer.path;
+        closeMuxer(m_nextMuxer);
+        QFile::remove(path);
+    }
+}
 
-    m_startMs = QDateTime::currentMSecsSinceEpoch();
+bool FfmpegWriter::switchMuxer(int64_t boundaryPts, bool sameSegment)
+{
+    Muxer next;
+    if (m_prepareThread)
+    {
+        m_prepareThread->wait();
+        delete m_prepareThread;
+        m_prepareThread = nullptr;
+        next = m_nextMuxer;
+        m_nextMuxer = Muxer();
+    }
+    const int index = sameSegment ? m_segmentIndex : m_segmentIndex + 1;
+    if (!next.fmtCtx && !openMuxer(next, fileNameForSegment(index), m_muxerSetup))
+        return false;
+
+    // With audio the finished file stays open until audio passes the boundary.
+    retireMuxer(m_retiringMuxer);
+    m_muxer.endPts = boundaryPts;
+    if (m_muxer.audioStream)
+        m_retiringMuxer = m_muxer;
+    else
+        retireMuxer(m_muxer);
+
+    m_muxer = next;
+    m_muxer.startPts = boundaryPts;
+    m_muxer.endPts = m_segmentLength > 0 ? m_segmentOrigin + ((boundaryPts - m_segmentOrigin) / m_segmentLength + 1) * m_segmentLength
+                                         : AV_NOPTS_VALUE;
+    m_segmentIndex = index;
+    {
+        QMutexLocker fileLocker(&m_fileMutex);
+        m_currentFile = m_muxer.path;
+    }
+    if (m_cfg.segmented)
+        prepareNextMuxer();
+
+    QVector<AVPacket *> held;
+    held.swap(m_heldAudio);
+    for (AVPacket *pkt : held)
+    {
+        writeAudioPacket(pkt);
+        av_packet_free(&pkt);
+    }
     return true;
 }
 
+void FfmpegWriter::retireMuxer(Muxer &muxer)
+{
+    if (!muxer.fmtCtx)
+        return;
+    // Writing the trailer happens off the encode path.
+    reapRetiredMuxers(false);
+    Muxer finished = muxer;
+    muxer = Muxer();
+    QThread *closer = QThread::create([finished]() mutable { closeMuxer(finished); });
+    closer->start();
+    m_retiringThreads.append(closer);
+}
+
+void FfmpegWriter::reapRetiredMuxers(bool wait)
+{
+    for (int i = m_retiringThreads.size() - 1; i >= 0; --i)
+    {
+        QThread *thread = m_retiringThreads[i];
+        if (wait)
+            thread->wait();
+        if (thread->isFinished())
+        {
+            delete thread;
+            m_retiringThreads.removeAt(i);
+        }
+    }
+}
+
+QString FfmpegWriter::currentFile() const
+{
+    QMutexLocker fileLocker(&m_fileMutex);
+    return m_currentFile;
+}
+
+void FfmpegWriter::setOutputFolder(const QString &folder)
+{
+    QMutexLocker fileLocker(&m_fileMutex);
+    m_pendingFolder = folder;
+}
+
+bool FfmpegWriter::outputFailed() const
+{
+    QMutexLocker muxLocker(&m_muxMutex);
+    return m_muxer.file && m_muxer.file->failed();
+}
+
+void FfmpegWriter::applyBitrateScale(double scale)
+{
+    // libx264 reconfigures rate control between frames when these change.
+    m_appliedBitrateScale = scale;
+    const EncoderProfile &profile = m_cfg.encoder;
+    if (profile.rateControl == RateControl::Crf)
+    {
+        // Six CRF steps roughly halve the bitrate.
+        const double crf = std::min(51.0, profile.crf - 6.0 * std::log2(scale));
+        av_opt_set_double(m_videoCodecCtx->priv_data, "crf", crf, 0);
+        Logger::instance().log(QString("CRF for %1 set to %2").arg(m_cfg.sourceLabel).arg(crf, 0, 'f', 1));
+        return;
+    }
+    const int64_t bitrate = static_cast<int64_t>(profile.bitrateKbps * scale) * 1000;
+    m_videoCodecCtx->bit_rate = bitrate;
+    if (profile.rateControl == RateControl::Cbr)
+    {
+        m_videoCodecCtx->rc_min_rate = bitrate;
+        m_videoCodecCtx->rc_max_rate = bitrate;
+        m_videoCodecCtx->rc_buffer_size = static_cast<int>(bitrate);
+    }
+    else
+    {
+        m_videoCodecCtx->rc_max_rate = bitrate * 3 / 2;
+        m_videoCodecCtx->rc_buffer_size = static_cast<int>(bitrate * 2);
+    }
+    Logger::instance().log(QString("Bitrate for %1 set to %2 kbps").arg(m_cfg.sourceLabel).arg(bitrate / 1000));
+}
+
+WriterLatency FfmpegWriter::latency() const
+{
+    WriterLatency latency;
+    latency.convert = m_convertTime.snapshot();
+    latency.encode = m_encodeTime.snapshot();
+    latency.mux = m_muxTime.snapshot();
+    return latency;
+}
+
 AVRational FfmpegWriter::videoTimeBase() const
 {
     if (m_videoCodecCtx)
@@ -133,162 +771,811 @@ AVRational FfmpegWriter::videoTimeBase() const
 bool FfmpegWriter::start(const RecordingConfig &cfg)
 {
     QMutexLocker locker(&m_mutex);
+    QMutexLocker audioLocker(&m_audioMutex);
+    QMutexLocker muxLocker(&m_muxMutex);
     m_cfg = cfg;
     m_segmentIndex = 1;
-    QDir().mkpath(cfg.outputFolder);
-    const QString nextFile = nextFileName();
-    if (!openContext(nextFile))
+    m_duplicatedFrames = 0;
+    m_droppedFrames = 0;
+    m_audioResyncs = 0;
+    m_bytesWritten = 0;
+    m_convertTime.reset();
+    m_encodeTime.reset();
+    m_muxTime.reset();
+    m_diskCounters.reset();
+    m_recordingStart = QDateTime::currentDateTime();
+    if (!cfg.discardOutput)
+        QDir().mkpath(cfg.outputFolder);
     {
+        QMutexLocker fileLocker(&m_fileMutex);
         m_currentFile.clear();
+        m_pendingFolder.clear();
+    }
+    if (!openEncoder() || !openAudioEncoder())
+    {
+        closeAudioEncoder();
+        closeEncoder();
         return false;
     }
-    m_currentFile = nextFile;
+
+    m_muxerSetup = MuxerSetup();
+    m_muxerSetup.format = containerName();
+    m_muxerSetup.videoPar = m_codecPar;
+    m_muxerSetup.videoTimeBase = m_videoCodecCtx->time_base;
+    m_muxerSetup.frameRate = {m_cfg.fpsNum, m_cfg.fpsDen};
+    if (!m_cfg.discardOutput)
+    {
+        m_muxerSetup.container = m_cfg.container;
+        m_muxerSetup.fragmentSeconds = std::max(0, m_cfg.fragmentSeconds);
+        m_muxerSetup.file.bufferBytes = std::clamp(m_cfg.writeBufferMb, 2, 256) * 1024 * 1024;
+        m_muxerSetup.diskCounters = &m_diskCounters;
+    }
+    if (m_audioCodecCtx)
+    {
+        m_muxerSetup.audioPar = m_audioPar;
+        m_muxerSetup.audioTimeBase = m_audioCodecCtx->time_base;
+    }
+    if (!m_cfg.discardOutput && m_cfg.preallocate)
+    {
+        // For CRF the bitrate setting is only a guess, which is all a
+        // reservation needs. Segments reserve their whole expected size up
+        // front, continuous files five minutes at a time.
+        int64_t bitsPerSecond = static_cast<int64_t>(m_cfg.encoder.bitrateKbps) * 1000;
+        if (m_audioCodecCtx)
+            bitsPerSecond += m_audioCodecCtx->bit_rate > 0 ? m_audioCodecCtx->bit_rate : static_cast<int64_t>(m_cfg.audioSampleRate) * m_cfg.audioChannels * 16;
+        const int64_t seconds = m_cfg.segmented ? static_cast<int64_t>(m_cfg.segmentMinutes) * 60 : 300;
+        m_muxerSetup.file.preallocateBytes = bitsPerSecond / 8 * seconds * 11 / 10;
+    }
+    m_segmentOrigin = 0;
+    const bool armed = m_cfg.preRollSeconds > 0;
+    m_keepRecent = m_cfg.replaySeconds > 0;
+    if (armed || m_keepRecent)
+    {
+        m_recent.configure(m_videoCodecCtx->time_base, m_muxerSetup.audioTimeBase,
+                           av_rescale_q(armed ? m_cfg.preRollSeconds : m_cfg.replaySeconds, AVRational{1, 1}, m_videoCodecCtx->time_base),
+                           static_cast<qint64>(std::max(1, m_cfg.ringMaxMb)) * 1024 * 1024);
+    }
+    if (armed)
+    {
+        // No file until the ring is committed; see flushPreRoll.
+        m_armed.store(true, std::memory_order_release);
+        updateRingStats();
+        Logger::instance().log(QString("%1 armed with %2 s pre-roll, up to %3 MB").arg(m_cfg.sourceLabel).arg(m_cfg.preRollSeconds).arg(m_cfg.ringMaxMb));
+        return true;
+    }
+    if (!openMuxer(m_muxer, fileNameForSegment(1), m_muxerSetup))
+    {
+        closeAudioEncoder();
+        closeEncoder();
+        return false;
+    }
+    m_muxer.endPts = m_segmentLength > 0 ? m_segmentLength : AV_NOPTS_VALUE;
+    {
+        QMutexLocker fileLocker(&m_fileMutex);
+        m_currentFile = m_muxer.path;
+    }
+    if (m_cfg.segmented)
+        prepareNextMuxer();
+    muxLocker.unlock();
+    startRenditions(0);
     return true;
 }
 
-void FfmpegWriter::closeContext()
+void FfmpegWriter::flushEncoder()
+{
+    if (!m_videoCodecCtx || !m_muxer.fmtCtx)
+        return;
+    if (avcodec_send_frame(m_videoCodecCtx, nullptr) < 0)
+        return;
+    drainPackets();
+}
+
+void FfmpegWriter::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    QMutexLocker audioLocker(&m_audioMutex);
+    flushAudio();
+    flushEncoder();
+    while (!m_renditions.isEmpty())
+        stopRendition(m_renditions.constLast());
+    {
+        QMutexLocker muxLocker(&m_muxMutex);
+        // Audio still held for a next segment that never started goes into the last file.
+        const AVRational videoTb = m_muxerSetup.videoTimeBase;
+        const AVRational audioTb = m_muxerSetup.audioTimeBase;
+        for (AVPacket *pkt : m_heldAudio)
+        {
+            if (m_muxer.fmtCtx)
+                writePacket(m_muxer, m_muxer.audioStream, pkt, audioTb, av_rescale_q(m_muxer.startPts, videoTb, audioTb));
+            av_packet_free(&pkt);
+        }
+        m_heldAudio.clear();
+        closeMuxer(m_retiringMuxer);
+        closeMuxer(m_muxer);
+        // A pre-roll never committed is dropped with the recorder's stop.
+        m_recent.clear();
+        m_keepRecent = false;
+        m_armed.store(false, std::memory_order_release);
+        m_commitRequested.store(false, std::memory_order_relaxed);
+        updateRingStats();
+    }
+    discardPreparedMuxer();
+    reapRetiredMuxers(true);
+    closeAudioEncoder();
+    closeEncoder();
+}
+
+bool FfmpegWriter::writeVideoFrame(AVFrame *frame)
 {
-    if (m_fmtCtx)
+    QMutexLocker locker(&m_mutex);
+    if (!m_videoCodecCtx)
+        return false;
+
+    if (m_firstInputPts == AV_NOPTS_VALUE)
+        m_firstInputPts = frame->pts;
+    const int64_t relativePts = frame->pts - m_firstInputPts;
+
+    int64_t pts = 0;
+    if (m_cfg.constantFrameRate)
     {
-        auto flushEncoder = [&](AVCodecContext *ctx, AVStream *stream) {
-            if (!ctx || !stream)
-                return;
-            if (avcodec_send_frame(ctx, nullptr) < 0)
-                return;
-            AVPacket pkt;
-            av_init_packet(&pkt);
-            while (avcodec_receive_packet(ctx, &pkt) == 0)
+        // Snap to the nearest frame slot; late duplicates are dropped and
+        // gaps are filled by repeating the previous picture.
+        pts = av_rescale_q_rnd(relativePts, InputTimeBase, m_videoCodecCtx->time_base, AV_ROUND_NEAR_INF);
+        if (pts < m_nextPts)
+        {
+            ++m_droppedFrames;
+            return true;
+        }
+        if (m_convertedFrame && m_nextPts > 0)
+        {
+            // Bounded so a timestamp jump cannot hold up the encode thread;
+            // past the limit the file keeps the gap instead.
+            const int64_t maxFill = av_rescale_q(MaxFillSeconds, AVRational{1, 1}, m_videoCodecCtx->time_base);
+            if (pts - m_nextPts > maxFill)
             {
-                pkt.stream_index = stream->index;
-                av_packet_rescale_ts(&pkt, ctx->time_base, stream->time_base);
-                av_interleaved_write_frame(m_fmtCtx, &pkt);
-                av_packet_unref(&pkt);
+                Logger::instance().log(m_fillLog, LogLevel::Warning,
+                                       QString("Timestamp jump of %1 s in %2; repeating %3 s of it and leaving the rest as a gap")
+                                           .arg(av_rescale_q(pts - m_nextPts, m_videoCodecCtx->time_base, AVRational{1, 1}))
+                                           .arg(m_cfg.sourceLabel)
+                                           .arg(MaxFillSeconds));
             }
-        };
+            const int64_t fillEnd = std::min(pts, m_nextPts + maxFill);
+            while (m_nextPts < fillEnd)
+            {
+                m_convertedFrame->pts = m_nextPts++;
+                if (!encodeFrame(m_convertedFrame, true))
+                    return false;
+                ++m_duplicatedFrames;
+            }
+        }
+    }
+    else
+    {
+        pts = av_rescale_q(relativePts, InputTimeBase, m_videoCodecCtx->time_base);
+        if (m_nextPts > 0 && pts < m_nextPts)
+            pts = m_nextPts;
+    }
+    m_nextPts = pts + 1;
 
-        flushEncoder(m_videoCodecCtx, m_videoStream);
-        av_write_trailer(m_fmtCtx);
-        if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE))
+    const qint64 convertStart = LatencyHistogram::now();
+    av_frame_unref(m_passThroughFrame);
+    if (frame->buf[0] && passesThrough(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height))
+    {
+        // Same layout as the encoder wants: hand the source buffer over as-is.
         {
-            avio_closep(&m_fmtCtx->pb);
+            AllocationTrace::ForeignScope ffmpeg;
+            if (av_frame_ref(m_passThroughFrame, frame) < 0)
+                return false;
         }
-        avformat_free_context(m_fmtCtx);
+        m_convertTime.recordSince(convertStart);
+        m_convertedFrame = m_passThroughFrame;
+        m_convertedFrame->pts = pts;
+        return encodeFrame(m_convertedFrame);
     }
-    m_fmtCtx = nullptr;
-    if (m_videoCodecCtx)
+
+    if (!acquireConvertedFrame())
+        return false;
+    if (!convertFrame(frame))
+        return false;
+    m_convertTime.recordSince(convertStart);
+
+    m_convertedFrame->pts = pts;
+    return encodeFrame(m_convertedFrame);
+}
+
+bool FfmpegWriter::canConvertDirect(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+{
+    if (dstFormat == AV_PIX_FMT_YUV420P)
     {
-        avcodec_free_context(&m_videoCodecCtx);
+        return srcFormat == AV_PIX_FMT_UYVY422 || srcFormat == AV_PIX_FMT_RGBA || srcFormat == AV_PIX_FMT_RGB0 ||
+               srcFormat == AV_PIX_FMT_BGRA || srcFormat == AV_PIX_FMT_BGR0;
+    }
+    return dstFormat == AV_PIX_FMT_NV12 && srcFormat == AV_PIX_FMT_UYVY422;
+}
+
+void FfmpegWriter::sliceRows(int slice, int height, int &first, int &last) const
+{
+    // Slice boundaries stay on even rows so no slice shares a chroma row.
+    const int step = std::max(2, (height / m_slices) & ~1);
+    first = std::min(height, slice * step);
+    last = slice == m_slices - 1 ? height : std::min(height, first + step);
+}
+
+void FfmpegWriter::offsetPlanes(AVPixelFormat format, uint8_t *const data[4], const int linesize[4], int row, uint8_t *out[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    const bool planarChroma = desc && !(desc->flags & AV_PIX_FMT_FLAG_PAL);
+    for (int i = 0; i < 4; ++i)
+    {
+        const int shift = planarChroma && (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        out[i] = data[i] ? data[i] + static_cast<ptrdiff_t>(row >> shift) * linesize[i] : nullptr;
     }
+}
+
+SwsContext *FfmpegWriter::createScaler(const AVFrame *src, int srcHeight, int dstHeight) const
+{
+    SwsContext *sws = sws_getContext(src->width, srcHeight, (AVPixelFormat)src->format, m_videoCodecCtx->width, dstHeight,
+                                     m_videoCodecCtx->pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!sws)
+        return nullptr;
+    const bool rgbInput = av_pix_fmt_desc_get((AVPixelFormat)src->format)->flags & AV_PIX_FMT_FLAG_RGB;
+    const int dstSpace = m_colorMatrix == ColorConvert::Matrix::Bt709 ? SWS_CS_ITU709 : SWS_CS_ITU601;
+    sws_setColorspaceDetails(sws, sws_getCoefficients(dstSpace), rgbInput ? 1 : 0, sws_getCoefficients(dstSpace), 0, 0, 1 << 16,
+                             1 << 16);
+    return sws;
+}
+
+void FfmpegWriter::releaseScalers()
+{
     if (m_sws)
     {
         sws_freeContext(m_sws);
         m_sws = nullptr;
     }
-    if (m_convertedFrame)
+    for (SwsContext *&sws : m_sliceSws)
     {
-        av_frame_free(&m_convertedFrame);
+        sws_freeContext(sws);
+        sws = nullptr;
     }
+    m_sliceSws.clear();
 }
 
-void FfmpegWriter::stop()
+bool FfmpegWriter::convertFrame(const AVFrame *frame)
 {
-    QMutexLocker locker(&m_mutex);
-    closeContext();
-}
+    AVFrame *dst = m_convertedFrame;
+    const AVPixelFormat srcFormat = static_cast<AVPixelFormat>(frame->format);
+    const bool sameSize = frame->width == dst->width && frame->height == dst->height;
 
-bool FfmpegWriter::writeVideoFrame(AVFrame *frame)
-{
-    QMutexLocker locker(&m_mutex);
-    if (!m_fmtCtx)
-        return false;
-    frame->width = m_videoCodecCtx->width;
-    frame->height = m_videoCodecCtx->height;
+    if (sameSize && canConvertDirect(srcFormat, static_cast<AVPixelFormat>(dst->format)))
+    {
+        WorkerPool::instance().run(m_slices, [&](int slice) {
+            int first = 0, last = 0;
+            sliceRows(slice, frame->height, first, last);
+            if (first < last)
+                convertDirect(frame, dst, first, last);
+        });
+        return true;
+    }
 
-    if (!m_sws || m_inputWidth != frame->width || m_inputHeight != frame->height || m_inputFormat != frame->format)
+    if (m_inputWidth != frame->width || m_inputHeight != frame->height || m_inputFormat != srcFormat)
     {
-        m_sws = sws_getCachedContext(m_sws, frame->width, frame->height, (AVPixelFormat)frame->format,
-                                     m_videoCodecCtx->width, m_videoCodecCtx->height, m_videoCodecCtx->pix_fmt,
-                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
-        if (!m_sws)
-            return false;
+        releaseScalers();
         m_inputWidth = frame->width;
         m_inputHeight = frame->height;
-        m_inputFormat = (AVPixelFormat)frame->format;
+        m_inputFormat = srcFormat;
     }
 
-    if (!ensureConvertedFrame())
-        return false;
-    if (av_frame_make_writable(m_convertedFrame) < 0)
+    // Scaling reads neighbouring rows across slice edges, so it stays whole-frame.
+    if (!sameSize)
+    {
+        if (!m_sws && !(m_sws = createScaler(frame, frame->height, dst->height)))
+            return false;
+        return sws_scale(m_sws, frame->data, frame->linesize, 0, frame->height, dst->data, dst->linesize) > 0;
+    }
+
+    if (m_sliceSws.size() != m_slices)
+    {
+        m_sliceSws.resize(m_slices);
+        for (int slice = 0; slice < m_slices; ++slice)
+        {
+            int first = 0, last = 0;
+            sliceRows(slice, frame->height, first, last);
+            m_sliceSws[slice] = first < last ? createScaler(frame, last - first, last - first) : nullptr;
+            if (first < last && !m_sliceSws[slice])
+            {
+                releaseScalers();
+                return false;
+            }
+        }
+    }
+
+    WorkerPool::instance().run(m_slices, [&](int slice) {
+        int first = 0, last = 0;
+        sliceRows(slice, frame->height, first, last);
+        if (first >= last)
+            return;
+        uint8_t *srcPlanes[4];
+        uint8_t *dstPlanes[4];
+        offsetPlanes(srcFormat, frame->data, frame->linesize, first, srcPlanes);
+        offsetPlanes(static_cast<AVPixelFormat>(dst->format), dst->data, dst->linesize, first, dstPlanes);
+        sws_scale(m_sliceSws[slice], srcPlanes, frame->linesize, 0, last - first, dstPlanes, dst->linesize);
+    });
+    return true;
+}
+
+bool FfmpegWriter::convertDirect(const AVFrame *src, AVFrame *dst, int firstRow, int lastRow)
+{
+    const AVPixelFormat srcFormat = static_cast<AVPixelFormat>(src->format);
+    const int rows = lastRow - firstRow;
+    const uint8_t *in = src->data[0] + static_cast<ptrdiff_t>(firstRow) * src->linesize[0];
+    uint8_t *luma = dst->data[0] + static_cast<ptrdiff_t>(firstRow) * dst->linesize[0];
+    uint8_t *chroma1 = dst->data[1] + static_cast<ptrdiff_t>(firstRow / 2) * dst->linesize[1];
+    if (dst->format == AV_PIX_FMT_NV12)
+    {
+        ColorConvert::uyvyToNv12(in, src->linesize[0], luma, dst->linesize[0], chroma1, dst->linesize[1], src->width, rows);
+        return true;
+    }
+
+    uint8_t *chroma2 = dst->data[2] + static_cast<ptrdiff_t>(firstRow / 2) * dst->linesize[2];
+    switch (srcFormat)
+    {
+    case AV_PIX_FMT_UYVY422:
+        ColorConvert::uyvyToI420(in, src->linesize[0], luma, dst->linesize[0], chroma1, dst->linesize[1], chroma2, dst->linesize[2],
+                                 src->width, rows);
+        return true;
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+        ColorConvert::rgbaToI420(in, src->linesize[0], luma, dst->linesize[0], chroma1, dst->linesize[1], chroma2, dst->linesize[2],
+                                 src->width, rows, m_colorMatrix);
+        return true;
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+        ColorConvert::bgraToI420(in, src->linesize[0], luma, dst->linesize[0], chroma1, dst->linesize[1], chroma2, dst->linesize[2],
+                                 src->width, rows, m_colorMatrix);
+        return true;
+    default:
         return false;
-    if (sws_scale(m_sws, frame->data, frame->linesize, 0, frame->height, m_convertedFrame->data, m_convertedFrame->linesize) <= 0)
+    }
+}
+
+bool FfmpegWriter::encodeFrame(AVFrame *frame, bool repeat)
+{
+    const double scale = m_bitrateScale.load(std::memory_order_relaxed);
+    if (scale != m_appliedBitrateScale)
+        applyBitrateScale(scale);
+    for (FfmpegWriter *rendition : m_renditions)
+        rendition->setBitrateScale(scale);
+
+    QString folder;
+    {
+        QMutexLocker fileLocker(&m_fileMutex);
+        folder.swap(m_pendingFolder);
+    }
+    const bool moveFolder = !folder.isEmpty() && folder != m_cfg.outputFolder && !m_cfg.discardOutput;
+    const bool armed = m_armed.load(std::memory_order_relaxed);
+    if (moveFolder)
     {
+        // The prepared next segment is in the old folder; the files from here
+        // on open in the new one.
+        discardPreparedMuxer();
+        m_cfg.outputFolder = folder;
+        QDir().mkpath(folder);
+        Logger::instance().log(LogLevel::Warning, QString("%1 continues in %2").arg(m_cfg.sourceLabel, folder));
+        for (FfmpegWriter *rendition : m_renditions)
+            rendition->setOutputFolder(folder);
+    }
+
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    if (armed && m_commitRequested.load(std::memory_order_acquire) && !flushPreRoll(frame->pts))
         return false;
+    if (armed && !m_armed.load(std::memory_order_relaxed))
+        startRenditions(frame->pts);
+    if (!m_armed.load(std::memory_order_relaxed) && m_segmentLength > 0 && frame->pts >= m_nextBoundaryPts)
+    {
+        // First frame of the next segment: force an IDR and switch files when
+        // that packet leaves the encoder, so segments join frame-exactly.
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        m_pendingBoundaryPts = frame->pts;
+        m_pendingFolderSwitch = false;
+        while (m_nextBoundaryPts <= frame->pts)
+            m_nextBoundaryPts += m_segmentLength;
     }
+    else if (moveFolder && !armed)
+    {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        m_pendingBoundaryPts = frame->pts;
+        m_pendingFolderSwitch = true;
+    }
+    const qint64 start = LatencyHistogram::now();
+    {
+        AllocationTrace::ForeignScope ffmpeg;
+        if (avcodec_send_frame(m_videoCodecCtx, frame) < 0)
+            return false;
+    }
+    qint64 muxNs = 0;
+    const bool ok = drainPackets(&muxNs);
+    // Renditions count as encode time. Each scales from the one before it, so
+    // every level of the pyramid is a small step from the next larger picture.
+    const AVFrame *source = frame;
+    for (int i = 0; i < m_renditions.size();)
+    {
+        FfmpegWriter *rendition = m_renditions[i];
+        if (rendition->encodeRendition(source, frame->pts, repeat))
+        {
+            source = rendition->m_convertedFrame;
+            ++i;
+            continue;
+        }
+        Logger::instance().log(LogLevel::Error, QString("%1 rendition of %2 failed; the recording continues without it")
+                                                    .arg(rendition->m_fileSuffix.mid(1), m_cfg.sourceLabel));
+        stopRendition(rendition);
+    }
+    m_encodeTime.record(LatencyHistogram::now() - start - muxNs);
+    return ok;
+}
+
+void FfmpegWriter::startRenditions(int64_t firstPts)
+{
+    QVector<RenditionConfig> renditions = m_cfg.renditions;
+    std::sort(renditions.begin(), renditions.end(), [](const RenditionConfig &a, const RenditionConfig &b) { return a.height > b.height; });
+    for (const RenditionConfig &config : renditions)
+    {
+        if (config.height < 16 || config.height >= m_videoCodecCtx->height)
+        {
+            Logger::instance().log(LogLevel::Warning, QString("Skipping %1p rendition of %2: not below the %3p master")
+                                                          .arg(config.height)
+                                                          .arg(m_cfg.sourceLabel)
+                                                          .arg(m_videoCodecCtx->height));
+            continue;
+        }
+        FfmpegWriter *rendition = new FfmpegWriter();
+        if (!rendition->startRendition(*this, config, firstPts))
+        {
+            Logger::instance().log(LogLevel::Error, QString("Failed to start %1p rendition of %2").arg(config.height).arg(m_cfg.sourceLabel));
+            delete rendition;
+            continue;
+        }
+        QMutexLocker muxLocker(&m_muxMutex);
+        m_renditions.append(rendition);
+    }
+}
+
+void FfmpegWriter::stopRendition(FfmpegWriter *rendition)
+{
+    {
+        QMutexLocker muxLocker(&m_muxMutex);
+        m_renditions.removeOne(rendition);
+    }
+    delete rendition;
+}
 
-    m_convertedFrame->pts = av_rescale_q(frame->pts, m_videoCodecCtx->time_base, m_videoStream->time_base);
+bool FfmpegWriter::startRendition(FfmpegWriter &master, const RenditionConfig &rendition, int64_t firstPts)
+{
+    QMutexLocker locker(&m_mutex);
+    QMutexLocker muxLocker(&m_muxMutex);
+    m_master = &master;
+    m_cfg = master.m_cfg;
+    m_cfg.renditions.clear();
+    m_cfg.preRollSeconds = 0;
+    m_cfg.replaySeconds = 0;
+    // Input is the master's encoder picture, so the conversion here is a scale only.
+    const AVCodecContext *masterCtx = master.m_videoCodecCtx;
+    m_cfg.inputPixFmt = masterCtx->pix_fmt;
+    m_cfg.outputPixFmt = masterCtx->pix_fmt;
+    m_cfg.height = rendition.height & ~1;
+    m_cfg.width = static_cast<int>(static_cast<int64_t>(masterCtx->width) * m_cfg.height / masterCtx->height + 1) & ~1;
+    const double pixelRatio = static_cast<double>(m_cfg.width) * m_cfg.height / (static_cast<double>(masterCtx->width) * masterCtx->height);
+    EncoderProfile &encoder = m_cfg.encoder;
+    encoder.bitrateKbps = rendition.bitrateKbps > 0 ? rendition.bitrateKbps : std::max(250, static_cast<int>(encoder.bitrateKbps * pixelRatio));
+    if (encoder.threads > 0)
+        encoder.threads = std::max(1, static_cast<int>(std::ceil(encoder.threads * pixelRatio)));
+    m_fileSuffix = QString("_%1p").arg(m_cfg.height);
+    m_recordingStart = master.m_recordingStart;
+    m_bitrateScale.store(master.m_appliedBitrateScale, std::memory_order_relaxed);
+    if (!openEncoder())
+    {
+        closeEncoder();
+        return false;
+    }
 
-    if (avcodec_send_frame(m_videoCodecCtx, m_convertedFrame) < 0)
+    // Same container, audio parameters and disk counters as the master.
+    m_muxerSetup = master.m_muxerSetup;
+    m_muxerSetup.videoPar = m_codecPar;
+    m_muxerSetup.file.preallocateBytes =
+        m_muxerSetup.file.preallocateBytes * encoder.bitrateKbps / std::max(1, master.m_cfg.encoder.bitrateKbps);
+    m_segmentOrigin = master.m_segmentOrigin;
+    m_nextBoundaryPts = master.m_nextBoundaryPts;
+    m_segmentIndex = master.m_segmentIndex;
+    if (!openMuxer(m_muxer, fileNameForSegment(m_segmentIndex), m_muxerSetup))
+    {
+        closeEncoder();
+        return false;
+    }
+    m_firstPts = firstPts;
+    m_muxer.startPts = firstPts;
+    m_muxer.endPts = master.m_muxer.endPts;
     {
+        QMutexLocker fileLocker(&m_fileMutex);
+        m_currentFile = m_muxer.path;
+    }
+    if (m_cfg.segmented)
+        prepareNextMuxer();
+    Logger::instance().log(QString("%1 rendition of %2: %3x%4 at %5 kbps to %6")
+                               .arg(m_fileSuffix.mid(1), m_cfg.sourceLabel)
+                               .arg(m_cfg.width)
+                               .arg(m_cfg.height)
+                               .arg(encoder.bitrateKbps)
+                               .arg(m_muxer.path));
+    return true;
+}
+
+bool FfmpegWriter::encodeRendition(const AVFrame *source, int64_t pts, bool repeat)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_videoCodecCtx)
         return false;
+    // A CFR repeat re-sends the picture already scaled for the previous frame.
+    if (!repeat || !m_convertedFrame)
+    {
+        const qint64 convertStart = LatencyHistogram::now();
+        if (!acquireConvertedFrame() || !convertFrame(source))
+            return false;
+        m_convertTime.recordSince(convertStart);
     }
+    m_convertedFrame->pts = pts;
+    return encodeFrame(m_convertedFrame);
+}
+
+void FfmpegWriter::writeRenditionAudio(const AVPacket *pkt)
+{
+    // The master's packets, on the same clock; the muxer rewrites timestamps,
+    // so each rendition writes its own reference.
+    const AVRational videoTb = m_muxerSetup.videoTimeBase;
+    const AVRational audioTb = m_muxerSetup.audioTimeBase;
+    QMutexLocker muxLocker(&m_muxMutex);
+    if (pkt->pts < av_rescale_q(m_firstPts, videoTb, audioTb))
+        return;
+    AVPacket *copy = av_packet_clone(pkt);
+    if (!copy)
+        return;
+    writeAudioPacket(copy);
+    av_packet_free(&copy);
+}
+
+bool FfmpegWriter::drainPackets(qint64 *muxNs)
+{
     AVPacket pkt;
     av_init_packet(&pkt);
     pkt.data = nullptr;
     pkt.size = 0;
-    while (avcodec_receive_packet(m_videoCodecCtx, &pkt) == 0)
+    auto receive = [&]() {
+        AllocationTrace::ForeignScope ffmpeg;
+        return avcodec_receive_packet(m_videoCodecCtx, &pkt) == 0;
+    };
+    while (receive())
     {
-        pkt.stream_index = m_videoStream->index;
-        av_packet_rescale_ts(&pkt, m_videoCodecCtx->time_base, m_videoStream->time_base);
-        pkt.duration = 1;
-        if (av_interleaved_write_frame(m_fmtCtx, &pkt) < 0)
+        QMutexLocker muxLocker(&m_muxMutex);
+        if (pkt.duration <= 0)
+            pkt.duration = m_frameDuration;
+        keepRecent(&pkt, true);
+        if (m_armed.load(std::memory_order_relaxed))
         {
             av_packet_unref(&pkt);
-            return false;
+            continue;
+        }
+        if (m_pendingBoundaryPts != AV_NOPTS_VALUE && pkt.pts >= m_pendingBoundaryPts && (pkt.flags & AV_PKT_FLAG_KEY))
+        {
+            if (!switchMuxer(pkt.pts, m_pendingFolderSwitch))
+                Logger::instance().log(LogLevel::Error, "Failed to open next segment for " + m_cfg.sourceLabel + "; continuing in " + m_currentFile);
+            m_pendingBoundaryPts = AV_NOPTS_VALUE;
+            m_pendingFolderSwitch = false;
         }
+        // Give up on late audio for the previous file after a second of video.
+        if (m_retiringMuxer.fmtCtx && pkt.pts - m_muxer.startPts > av_rescale_q(1, AVRational{1, 1}, m_videoCodecCtx->time_base))
+            retireMuxer(m_retiringMuxer);
+        const qint64 muxStart = LatencyHistogram::now();
+        const bool written = writePacket(m_muxer, m_muxer.videoStream, &pkt, m_videoCodecCtx->time_base, m_muxer.startPts);
+        const qint64 muxTime = LatencyHistogram::now() - muxStart;
+        m_muxTime.record(muxTime);
+        if (muxNs)
+            *muxNs += muxTime;
         av_packet_unref(&pkt);
+        if (!written)
+            return false;
     }
     return true;
 }
 
-bool FfmpegWriter::ensureConvertedFrame()
+bool FfmpegWriter::flushPreRoll(int64_t currentPts)
 {
-    if (m_convertedFrame &&
-        (m_convertedFrame->width != m_videoCodecCtx->width || m_convertedFrame->height != m_videoCodecCtx->height ||
-         m_convertedFrame->format != m_videoCodecCtx->pix_fmt))
+    QMutexLocker muxLocker(&m_muxMutex);
+    if (!m_recent.hasKeyframe())
+        return true;
+    m_commitRequested.store(false, std::memory_order_relaxed);
+    const AVRational videoTb = m_videoCodecCtx->time_base;
+    QVector<AVPacket *> video;
+    QVector<AVPacket *> audio;
+    // Copies, because the muxer rewrites timestamps and the ring may stay on for replay.
+    const int64_t origin = m_recent.copyFrom(AV_NOPTS_VALUE, video, audio);
+    if (m_keepRecent)
+        m_recent.setDuration(av_rescale_q(m_cfg.replaySeconds, AVRational{1, 1}, videoTb));
+    else
+        m_recent.clear();
+    const qint64 preRollMs = av_rescale_q(currentPts - origin, videoTb, AVRational{1, 1000});
+    // Named for when the oldest buffered frame was captured.
+    m_recordingStart = QDateTime::currentDateTime().addMSecs(-preRollMs);
+    bool ok = openMuxer(m_muxer, fileNameForSegment(1), m_muxerSetup);
+    if (ok)
     {
-        av_frame_free(&m_convertedFrame);
+        m_armed.store(false, std::memory_order_release);
+        m_segmentOrigin = origin;
+        m_nextBoundaryPts = origin + m_segmentLength;
+        m_muxer.startPts = origin;
+        m_muxer.endPts = m_segmentLength > 0 ? origin + m_segmentLength : AV_NOPTS_VALUE;
+        {
+            QMutexLocker fileLocker(&m_fileMutex);
+            m_currentFile = m_muxer.path;
+        }
+        ok = interleave(
+            video, videoTb, audio, m_muxerSetup.audioTimeBase,
+            [&](AVPacket *pkt) { return writePacket(m_muxer, m_muxer.videoStream, pkt, videoTb, origin); },
+            [&](AVPacket *pkt) {
+                writeAudioPacket(pkt);
+                return true;
+            });
+        if (m_cfg.segmented)
+            prepareNextMuxer();
+        Logger::instance().log(QString("Recording %1 from %2 s before start").arg(m_cfg.sourceLabel).arg(preRollMs / 1000.0, 0, 'f', 1));
     }
+    else
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to open the recording for " + m_cfg.sourceLabel + "; pre-roll discarded");
+    }
+    for (AVPacket *pkt : video)
+        av_packet_free(&pkt);
+    for (AVPacket *pkt : audio)
+        av_packet_free(&pkt);
+    updateRingStats();
+    return ok;
+}
+
+void FfmpegWriter::keepRecent(const AVPacket *pkt, bool video)
+{
+    if (!m_armed.load(std::memory_order_relaxed) && !m_keepRecent)
+        return;
+    // A new reference to the encoder's buffer; the payload is not copied.
+    AVPacket *copy = av_packet_clone(pkt);
+    if (!copy)
+        return;
+    if (video)
+        m_recent.pushVideo(copy);
+    else
+        m_recent.pushAudio(copy);
+    updateRingStats();
+}
 
-    if (!m_convertedFrame)
+void FfmpegWriter::updateRingStats()
+{
+    const bool active = m_armed.load(std::memory_order_relaxed) || m_keepRecent;
+    m_ringBytes.store(m_recent.bytes(), std::memory_order_relaxed);
+    m_ringMs.store(active ? av_rescale_q(m_recent.duration(), m_videoCodecCtx->time_base, AVRational{1, 1000}) : 0,
+                   std::memory_order_relaxed);
+    m_ringMaxBytes.store(active ? m_recent.maxBytes() : 0, std::memory_order_relaxed);
+}
+
+PacketRingStats FfmpegWriter::ringStats() const
+{
+    PacketRingStats stats;
+    stats.bytes = m_ringBytes.load(std::memory_order_relaxed);
+    stats.durationMs = m_ringMs.load(std::memory_order_relaxed);
+    stats.maxBytes = m_ringMaxBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool FfmpegWriter::copyRecent(int seconds, ClipPackets &clip) const
+{
+    PacketRing::Span span;
     {
-        m_convertedFrame = av_frame_alloc();
-        if (!m_convertedFrame)
+        QMutexLocker muxLocker(&m_muxMutex);
+        if (!m_keepRecent || m_armed.load(std::memory_order_relaxed) || !m_recent.hasKeyframe())
             return false;
-        m_convertedFrame->format = m_videoCodecCtx->pix_fmt;
-        m_convertedFrame->width = m_videoCodecCtx->width;
-        m_convertedFrame->height = m_videoCodecCtx->height;
-        if (av_frame_get_buffer(m_convertedFrame, 32) < 0)
-        {
-            av_frame_free(&m_convertedFrame);
+        const AVRational videoTb = m_muxerSetup.videoTimeBase;
+        const int64_t newest = m_recent.newestPts();
+        if (!m_recent.span(newest - av_rescale_q(seconds, AVRational{1, 1}, videoTb), span))
             return false;
+        clip.startPts = span.keyframePts;
+        clip.durationMs = av_rescale_q(newest + m_frameDuration - clip.startPts, videoTb, AVRational{1, 1000});
+        clip.format = m_cfg.audioCodec == AudioCodec::Pcm ? "mov" : "mp4";
+        clip.videoTimeBase = videoTb;
+        clip.frameRate = m_muxerSetup.frameRate;
+        clip.videoPar = avcodec_parameters_alloc();
+        if (!clip.videoPar || avcodec_parameters_copy(clip.videoPar, m_muxerSetup.videoPar) < 0)
+            return false;
+        if (m_muxerSetup.audioPar)
+        {
+            clip.audioTimeBase = m_muxerSetup.audioTimeBase;
+            clip.audioPar = avcodec_parameters_alloc();
+            if (!clip.audioPar || avcodec_parameters_copy(clip.audioPar, m_muxerSetup.audioPar) < 0)
+                return false;
         }
     }
+
+    // The encoder threads push into the ring under the same lock, so it is
+    // taken per packet: they wait for one clone at most, not the whole window.
+    // Trimming only drops from the front, which the copy stays ahead of; a
+    // miss means the ring was cleared or overtook it.
+    clip.video.reserve(static_cast<int>(span.videoEnd - span.videoBegin));
+    for (quint64 sequence = span.videoBegin; sequence < span.videoEnd; ++sequence)
+    {
+        QMutexLocker muxLocker(&m_muxMutex);
+        AVPacket *copy = m_recent.cloneVideo(sequence);
+        if (!copy)
+            return false;
+        clip.video.append(copy);
+    }
+    clip.audio.reserve(static_cast<int>(span.audioEnd - span.audioBegin));
+    for (quint64 sequence = span.audioBegin; sequence < span.audioEnd; ++sequence)
+    {
+        QMutexLocker muxLocker(&m_muxMutex);
+        if (AVPacket *copy = m_recent.cloneAudio(sequence))
+            clip.audio.append(copy);
+    }
     return true;
 }
 
-bool FfmpegWriter::needsRollover()
+bool FfmpegWriter::writeClip(ClipPackets &clip, const QString &path)
 {
-    if (!m_cfg.segmented)
+    MuxerSetup setup;
+    setup.format = clip.format;
+    setup.videoPar = clip.videoPar;
+    setup.videoTimeBase = clip.videoTimeBase;
+    setup.frameRate = clip.frameRate;
+    setup.audioPar = clip.audioPar;
+    setup.audioTimeBase = clip.audioTimeBase;
+    Muxer muxer;
+    if (!openMuxer(muxer, path, setup))
         return false;
-    qint64 elapsed = QDateTime::currentMSecsSinceEpoch() - m_startMs;
-    return elapsed >= (qint64)m_cfg.segmentMinutes * 60 * 1000;
+    const int64_t audioStart = av_rescale_q(clip.startPts, clip.videoTimeBase, clip.audioTimeBase);
+    bool ok = interleave(
+        clip.video, clip.videoTimeBase, clip.audio, clip.audioTimeBase,
+        [&](AVPacket *pkt) { return muxPacket(muxer, muxer.videoStream, pkt, clip.videoTimeBase, clip.startPts); },
+        [&](AVPacket *pkt) { return !muxer.audioStream || muxPacket(muxer, muxer.audioStream, pkt, clip.audioTimeBase, audioStart); });
+    ok = closeMuxer(muxer) && ok;
+    if (!ok)
+        QFile::remove(path);
+    return ok;
 }
 
-void FfmpegWriter::rollover()
+ClipPackets::~ClipPackets()
 {
-    QMutexLocker locker(&m_mutex);
-    closeContext();
-    ++m_segmentIndex;
-    m_currentFile = nextFileName();
-    openContext(m_currentFile);
+    for (AVPacket *pkt : video)
+        av_packet_free(&pkt);
+    for (AVPacket *pkt : audio)
+        av_packet_free(&pkt);
+    avcodec_parameters_free(&videoPar);
+    avcodec_parameters_free(&audioPar);
+}
+
+bool FfmpegWriter::createFramePool()
+{
+    // Enough pictures for the encoder's in-flight depth plus the one kept for
+    // CFR repeats, so steady-state recording never allocates one.
+    const int depth = std::clamp(m_videoCodecCtx->delay + 2, 2, MaxPooledFrames);
+    if (!m_pictures.init(m_videoCodecCtx->pix_fmt, m_videoCodecCtx->width, m_videoCodecCtx->height, depth))
+        return false;
+    m_passThroughFrame = av_frame_alloc();
+    return m_passThroughFrame != nullptr;
+}
+
+bool FfmpegWriter::acquireConvertedFrame()
+{
+    // The previous picture may still be referenced by the encoder; the pool
+    // hands it out again once the encoder is done with it.
+    m_convertedFrame = m_pictures.acquire();
+    return m_convertedFrame != nullptr;
+}
+
+bool FfmpegWriter::passesThrough(AVPixelFormat format, int width, int height) const
+{
+    return m_videoCodecCtx && format == m_videoCodecCtx->pix_fmt && width == m_videoCodecCtx->width && height == m_videoCodecCtx->height;
 }
@@ -0,0 +1,112 @@
+#include "FileFrameSource.h"
+#include "Logging.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+FileFrameSource::FileFrameSource(const Options &options)
+    : m_options(options), m_file(options.path)
+{
+    m_realtime = options.realtime;
+}
+
+bool FileFrameSource::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        Logger::instance().log(LogLevel::Error, QString("Cannot open replay file %1: %2").arg(m_options.path, m_file.errorString()));
+        return false;
+    }
+
+    Format format = m_options.format;
+    m_y4m = m_file.peek(10) == "YUV4MPEG2 ";
+    if (m_y4m && !readY4mHeader(format))
+    {
+        Logger::instance().log(LogLevel::Warning, "Unsupported Y4M header in " + m_options.path);
+        return false;
+    }
+    m_dataStart = m_file.pos();
+    // Files store planes back to back with no row padding.
+    m_frameSize = av_image_get_buffer_size(format.format, format.width, format.height, 1);
+    if (!allocateFrames(format, 1))
+        return false;
+    Logger::instance().log(QString("Replaying %1 (%2x%3 at %4/%5%6%7)")
+                               .arg(m_options.path)
+                               .arg(format.width)
+                               .arg(format.height)
+                               .arg(format.fpsNum)
+                               .arg(format.fpsDen)
+                               .arg(m_options.loop ? ", looped" : "")
+                               .arg(m_realtime ? "" : ", unthrottled"));
+    return true;
+}
+
+bool FileFrameSource::readY4mHeader(Format &format)
+{
+    const QList<QByteArray> tokens = m_file.readLine(1024).trimmed().split(' ');
+    format.format = AV_PIX_FMT_YUV420P;
+    for (int i = 1; i < tokens.size(); ++i)
+    {
+        const QByteArray &token = tokens.at(i);
+        if (token.isEmpty())
+            continue;
+        const QByteArray value = token.mid(1);
+        switch (token.at(0))
+        {
+        case 'W':
+            format.width = value.toInt();
+            break;
+        case 'H':
+            format.height = value.toInt();
+            break;
+        case 'F':
+        {
+            const QList<QByteArray> rate = value.split(':');
+            if (rate.size() == 2)
+            {
+                format.fpsNum = rate.at(0).toInt();
+                format.fpsDen = rate.at(1).toInt();
+            }
+            break;
+        }
+        case 'C':
+            if (value.startsWith("420"))
+                format.format = AV_PIX_FMT_YUV420P;
+            else if (value == "422")
+                format.format = AV_PIX_FMT_YUV422P;
+            else if (value == "444")
+                format.format = AV_PIX_FMT_YUV444P;
+            else if (value == "mono")
+                format.format = AV_PIX_FMT_GRAY8;
+            else
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return format.width > 0 && format.height > 0 && format.fpsNum > 0 && format.fpsDen > 0;
+}
+
+bool FileFrameSource::readFrame(uint8_t *buffer)
+{
+    if (m_y4m && !m_file.readLine(256).startsWith("FRAME"))
+        return false;
+    return m_file.read(reinterpret_cast<char *>(buffer), m_frameSize) == m_frameSize;
+}
+
+bool FileFrameSource::renderFrame(qint64, VideoFrame &frame)
+{
+    if (readFrame(frame.buffer))
+    {
+        ++m_framesInPass;
+        return true;
+    }
+    if (!m_options.loop || m_framesInPass == 0 || !m_file.seek(m_dataStart))
+        return false;
+    m_framesInPass = 0;
+    if (!readFrame(frame.buffer))
+        return false;
+    ++m_framesInPass;
+    return true;
+}
@@ -0,0 +1,40 @@
+#include "FinalizationPool.h"
+#include <QThread>
+#include <algorithm>
+
+FinalizationPool &FinalizationPool::instance()
+{
+    static FinalizationPool inst;
+    return inst;
+}
+
+FinalizationPool::FinalizationPool()
+{
+    // Each job mostly waits on encoder threads that have their own budget.
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount() / 4, 2, 8));
+    m_pool.setObjectName("FinalizationPool");
+}
+
+void FinalizationPool::setMaxConcurrent(int count)
+{
+    m_pool.setMaxThreadCount(std::max(1, count));
+}
+
+int FinalizationPool::maxConcurrent() const
+{
+    return m_pool.maxThreadCount();
+}
+
+void FinalizationPool::submit(std::function<void()> job)
+{
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_pool.start([this, job = std::move(job)]() {
+        job();
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
+void FinalizationPool::waitForAll()
+{
+    m_pool.waitForDone();
+}
@@ -0,0 +1,116 @@
+#include "FrameSource.h"
+#include "FileFrameSource.h"
+#include "Logging.h"
+#include "SyntheticFrameSource.h"
+#ifdef WITH_NDI
+#include "NdiFrameSource.h"
+#endif
+#include <QFileInfo>
+#include <QUrl>
+#include <QUrlQuery>
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+namespace
+{
+AVPixelFormat parsePixelFormat(const QString &name)
+{
+    const QString lower = name.toLower();
+    if (lower == "uyvy")
+        return AV_PIX_FMT_UYVY422;
+    if (lower == "bgrx")
+        return AV_PIX_FMT_BGR0;
+    if (lower == "rgbx")
+        return AV_PIX_FMT_RGB0;
+    if (lower == "i420")
+        return AV_PIX_FMT_YUV420P;
+    return av_get_pix_fmt(lower.toUtf8().constData());
+}
+
+// size=WxH, fps=N or N/D, format=uyvy|bgra|bgrx|rgba|rgbx|nv12|i420 or any FFmpeg pixel format name.
+bool parseFormat(const QUrlQuery &query, PacedFrameSource::Format &format)
+{
+    if (query.hasQueryItem("size"))
+    {
+        const QStringList size = query.queryItemValue("size").split('x');
+        if (size.size() != 2)
+            return false;
+        format.width = size.at(0).toInt();
+        format.height = size.at(1).toInt();
+    }
+    if (query.hasQueryItem("fps"))
+    {
+        const QStringList rate = query.queryItemValue("fps").split('/');
+        format.fpsNum = rate.at(0).toInt();
+        format.fpsDen = rate.size() > 1 ? rate.at(1).toInt() : 1;
+    }
+    if (query.hasQueryItem("format"))
+        format.format = parsePixelFormat(query.queryItemValue("format"));
+    return format.width > 0 && format.height > 0 && format.fpsNum > 0 && format.fpsDen > 0 && format.format != AV_PIX_FMT_NONE;
+}
+
+bool queryFlag(const QUrlQuery &query, const QString &key, bool fallback)
+{
+    if (!query.hasQueryItem(key))
+        return fallback;
+    const QString value = query.queryItemValue(key).toLower();
+    return value == "1" || value == "true" || value == "yes";
+}
+} // namespace
+
+std::unique_ptr<FrameSource> FrameSource::create(const QString &uri, NdiColorFormat colorFormat)
+{
+    if (uri.startsWith("synthetic:"))
+    {
+        const QUrlQuery query(QUrl(uri).query());
+        SyntheticFrameSource::Options options;
+        if (!parseFormat(query, options.format))
+        {
+            Logger::instance().log(LogLevel::Error, "Invalid synthetic source: " + uri);
+            return nullptr;
+        }
+        options.jitterMs = query.queryItemValue("jitter").toDouble();
+        options.dropRate = query.queryItemValue("drop").toDouble();
+        options.realtime = queryFlag(query, "realtime", true);
+        if (query.hasQueryItem("seed"))
+            options.seed = query.queryItemValue("seed").toUInt();
+        return std::make_unique<SyntheticFrameSource>(options);
+    }
+    if (uri.startsWith("file:"))
+    {
+        const QUrl url(uri);
+        const QUrlQuery query(url.query());
+        FileFrameSource::Options options;
+        options.path = url.toLocalFile();
+        if (!parseFormat(query, options.format))
+        {
+            Logger::instance().log(LogLevel::Error, "Invalid replay source: " + uri);
+            return nullptr;
+        }
+        options.loop = queryFlag(query, "loop", true);
+        options.realtime = queryFlag(query, "realtime", true);
+        return std::make_unique<FileFrameSource>(options);
+    }
+#ifdef WITH_NDI
+    return std::make_unique<NdiFrameSource>(uri, colorFormat);
+#else
+    Q_UNUSED(colorFormat);
+    Logger::instance().log(LogLevel::Warning, "Built without NDI; cannot receive " + uri);
+    return nullptr;
+#endif
+}
+
+bool FrameSource::isAvailable(const QString &uri)
+{
+    if (uri.startsWith("synthetic:"))
+        return true;
+    if (uri.startsWith("file:"))
+        return QFileInfo::exists(QUrl(uri).toLocalFile());
+#ifdef WITH_NDI
+    NdiManager ndi;
+    return ndi.availableSources().contains(uri);
+#else
+    return false;
+#endif
+}
@@ -1,6 +1,54 @@
 #include "Logging.h"
 #include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMutexLocker>
+#include <QThread>
+#include <chrono>
+
+namespace
+{
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *levelName(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Debug:
+        return "debug";
+    case LogLevel::Info:
+        return "info";
+    case LogLevel::Warning:
+        return "warning";
+    case LogLevel::Error:
+        return "error";
+    }
+    return "info";
+}
+} // namespace
+
+quint64 LogThrottle::admit(qint64 &sinceMs)
+{
+    const qint64 now = steadyNowNs();
+    qint64 last = m_lastNs.load(std::memory_order_relaxed);
+    if (last != 0 && now - last < m_intervalNs)
+    {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    // Several threads may pass the check at once; only one wins the window.
+    if (!m_lastNs.compare_exchange_strong(last, now, std::memory_order_relaxed))
+    {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    sinceMs = last != 0 ? (now - last) / 1000000 : 0;
+    return m_suppressed.exchange(0, std::memory_order_relaxed) + 1;
+}
 
 Logger &Logger::instance()
 {
@@ -9,26 +57,168 @@ Logger &Logger::instance()
 }
 
 Logger::Logger()
-    : m_file(), m_stream(&m_file)
+    : m_queue(QueueDepth), m_file(), m_stream(&m_file)
+{
+    openFile();
+    m_writer = QThread::create([this]() { writerThreadFunc(); });
+    m_writer->start(QThread::LowPriority);
+}
+
+Logger::~Logger()
 {
-    QDir().mkpath("logs");
-    m_file.setFileName("logs/app.log");
-    m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+    m_stopping = true;
+    m_queue.wakeAll();
+    m_writer->wait();
+    delete m_writer;
 }
 
-void Logger::log(const QString &message)
+void Logger::log(LogLevel level, const QString &message)
 {
-    QMutexLocker locker(&m_mutex);
-    if (!m_file.isOpen())
+    if (static_cast<int>(level) < m_level.load(std::memory_order_relaxed))
+        return;
+    Entry entry;
+    entry.timeMs = QDateTime::currentMSecsSinceEpoch();
+    entry.level = level;
+    entry.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    entry.message = message;
+    if (!m_queue.tryPush(entry))
     {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
         return;
     }
-    QString line = QString("[%1] %2\n").arg(QDateTime::currentDateTime().toString(Qt::ISODate), message);
-    m_stream << line;
-    m_stream.flush();
+    m_enqueued.fetch_add(1, std::memory_order_release);
+}
+
+void Logger::log(LogThrottle &throttle, LogLevel level, const QString &message)
+{
+    if (static_cast<int>(level) < m_level.load(std::memory_order_relaxed))
+        return;
+    qint64 sinceMs = 0;
+    const quint64 count = throttle.admit(sinceMs);
+    if (count == 0)
+        return;
+    if (count == 1)
+        log(level, message);
+    else
+        log(level, QString("%1 (x%2 in the last %3 s)").arg(message).arg(count).arg(sinceMs / 1000));
+}
+
+void Logger::configure(const LogOptions &options)
+{
+    QMutexLocker locker(&m_fileMutex);
+    const bool reopen = options.path != m_options.path;
+    m_options = options;
+    m_level = static_cast<int>(options.level);
+    if (reopen)
+        openFile();
+}
+
+void Logger::flush()
+{
+    const quint64 target = m_enqueued.load(std::memory_order_acquire);
+    quint64 written = m_written.load(std::memory_order_acquire);
+    while (written < target)
+    {
+        m_written.wait(written, std::memory_order_acquire);
+        written = m_written.load(std::memory_order_acquire);
+    }
 }
 
 QString Logger::logFilePath() const
 {
+    QMutexLocker locker(&m_fileMutex);
     return m_file.fileName();
 }
+
+bool Logger::openFile()
+{
+    m_stream.flush();
+    m_file.close();
+    const QFileInfo info(m_options.path);
+    QDir().mkpath(info.absolutePath());
+    m_file.setFileName(m_options.path);
+    return m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+void Logger::rotateIfNeeded()
+{
+    if (m_options.maxBytes <= 0 || m_file.size() < m_options.maxBytes)
+        return;
+    m_stream.flush();
+    m_file.close();
+    const QString path = m_options.path;
+    if (m_options.keepFiles > 0)
+    {
+        QFile::remove(QString("%1.%2").arg(path).arg(m_options.keepFiles));
+        for (int i = m_options.keepFiles - 1; i >= 1; --i)
+            QFile::rename(QString("%1.%2").arg(path).arg(i), QString("%1.%2").arg(path).arg(i + 1));
+        QFile::rename(path, path + ".1");
+    }
+    else
+    {
+        QFile::remove(path);
+    }
+    openFile();
+}
+
+void Logger::writeEntry(const Entry &entry)
+{
+    const QString time = QDateTime::fromMSecsSinceEpoch(entry.timeMs).toString(Qt::ISODateWithMs);
+    if (m_options.jsonLines)
+    {
+        QJsonObject object;
+        object["time"] = time;
+        object["level"] = levelName(entry.level);
+        object["thread"] = QString::number(entry.thread, 16);
+        object["message"] = entry.message;
+        m_stream << QJsonDocument(object).toJson(QJsonDocument::Compact) << '\n';
+        return;
+    }
+    if (entry.level == LogLevel::Info)
+        m_stream << '[' << time << "] " << entry.message << '\n';
+    else
+        m_stream << '[' << time << "] " << levelName(entry.level) << ": " << entry.message << '\n';
+}
+
+void Logger::writerThreadFunc()
+{
+    for (;;)
+    {
+        const quint32 seen = m_queue.pushEvents();
+        quint64 batch = 0;
+        {
+            QMutexLocker locker(&m_fileMutex);
+            Entry entry;
+            while (m_queue.tryPop(entry))
+            {
+                if (m_file.isOpen())
+                    writeEntry(entry);
+                ++batch;
+            }
+            const quint64 dropped = m_dropped.load(std::memory_order_relaxed);
+            if (dropped != m_droppedReported && m_file.isOpen())
+            {
+                Entry note;
+                note.timeMs = QDateTime::currentMSecsSinceEpoch();
+                note.level = LogLevel::Warning;
+                note.message = QString("Log queue full; %1 messages dropped").arg(dropped - m_droppedReported);
+                writeEntry(note);
+                m_droppedReported = dropped;
+            }
+            if (batch > 0 && m_file.isOpen())
+            {
+                m_stream.flush();
+                rotateIfNeeded();
+            }
+        }
+        if (batch > 0)
+        {
+            m_written.fetch_add(batch, std::memory_order_release);
+            m_written.notify_all();
+            continue;
+        }
+        if (m_stopping)
+            break;
+        m_queue.waitPushEvent(seen);
+    }
+}
@@ -1,5 +1,9 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
+#include "CpuBudget.h"
+#include "FinalizationPool.h"
+#include "StorageMonitor.h"
+#include <QFileDialog>
 #include <QGridLayout>
 #include <QDesktopServices>
 #include <QUrl>
@@ -21,14 +25,20 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    m_metrics.stop();
+    // Stop everything first so the files are closed in parallel.
     for (auto rec : m_recorders)
-    {
         rec->stop();
+    for (auto rec : m_recorders)
         delete rec;
-    }
     delete ui;
 }
 
+bool MainWindow::serveMetrics(const QString &address)
+{
+    return m_metrics.start(address);
+}
+
 void MainWindow::rebuildSources(int count)
 {
     QLayoutItem *child;
@@ -38,6 +48,17 @@ void MainWindow::rebuildSources(int count)
         delete child;
     }
     m_tiles.clear();
+    // Tiles are gone, so nothing could stop these recorders any more.
+    for (auto rec : m_recorders)
+    {
+        m_metrics.removeRecorder(rec);
+        // A recorder still closing its files deletes itself once done; a
+        // deleteLater() already queued is dropped if it is deleted here.
+        connect(rec, &SourceRecorder::recordingStopped, rec, &QObject::deleteLater);
+        rec->stop();
+        if (!rec->isFinalizing())
+            delete rec;
+    }
     m_recorders.clear();
 
     for (int i = 0; i < count; ++i)
@@ -54,6 +75,20 @@ void MainWindow::rebuildSources(int count)
             e.sourceLabel = rec->settings().label;
             e.timestamp = info.lastModified();
             e.size = info.size();
+            e.finalizePercent = -1;
+            m_libraryModel->addEntry(e);
+        });
+        connect(rec, &SourceRecorder::finalizationProgress, m_libraryModel, &RecordingLibraryModel::setFinalizeProgress);
+        connect(rec, &SourceRecorder::clipExported, this, [this, rec](const QString &file, bool ok) {
+            if (!ok)
+                return;
+            RecordingEntry e;
+            e.fullPath = file;
+            QFileInfo info(file);
+            e.filename = info.fileName();
+            e.sourceLabel = rec->settings().label;
+            e.timestamp = info.lastModified();
+            e.size = info.size();
             m_libraryModel->addEntry(e);
         });
         int row = i / 2;
@@ -61,6 +96,7 @@ void MainWindow::rebuildSources(int count)
         ui->gridLayout->addWidget(tile, row, col);
         m_recorders.append(rec);
         m_tiles.append(tile);
+        m_metrics.addRecorder(rec);
     }
 }
 
@@ -92,6 +128,36 @@ void MainWindow::on_pauseAllButton_clicked()
     }
 }
 
+void MainWindow::on_cpuCoresSpin_valueChanged(int value)
+{
+    CpuBudget::instance().setTotalCores(value);
+    updateMasterTimer();
+}
+
+void MainWindow::on_pinThreadsCheck_toggled(bool checked)
+{
+    CpuBudget::instance().setPinning(checked);
+    updateMasterTimer();
+}
+
+void MainWindow::on_storagePolicyCombo_currentIndexChanged(int index)
+{
+    StorageOptions options = StorageMonitor::instance().options();
+    options.policy = static_cast<StoragePolicy>(index);
+    StorageMonitor::instance().setOptions(options);
+}
+
+void MainWindow::on_fallbackFolderButton_clicked()
+{
+    StorageOptions options = StorageMonitor::instance().options();
+    const QString dir = QFileDialog::getExistingDirectory(this, tr("Fallback Folder"), options.fallbackFolder);
+    if (dir.isEmpty())
+        return;
+    options.fallbackFolder = dir;
+    StorageMonitor::instance().setOptions(options);
+    ui->fallbackFolderButton->setToolTip(dir);
+}
+
 void MainWindow::handleSettings(SourceRecorder *recorder)
 {
     SourceSettingsDialog dlg(this);
@@ -110,7 +176,10 @@ void MainWindow::updateMasterTimer()
         if (rec->status() == "Recording" || rec->status() == "Paused")
             ++total;
     }
-    ui->masterStatusLabel->setText(QString("Active sources: %1").arg(total));
+    QString text = QString("Active sources: %1").arg(total);
+    if (const int finalizing = FinalizationPool::instance().pending())
+        text += QString(", finalizing %1").arg(finalizing);
+    ui->masterStatusLabel->setText(text + QString("  |  %1").arg(CpuBudget::instance().summary()));
 }
 
 void MainWindow::openRecording()
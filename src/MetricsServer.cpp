@@ -0,0 +1,364 @@
+#include "MetricsServer.h"
+#include "Logging.h"
+#include "SourceRecorder.h"
+#include <QHostAddress>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStorageInfo>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <type_traits>
+
+namespace
+{
+// Upper bounds of the exported latency buckets, in seconds.
+constexpr double LatencyBounds[] = {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 1.0};
+
+QByteArray escapeLabel(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    escaped.replace('\n', "\\n");
+    return escaped;
+}
+
+// Builds the text exposition format, one metric family at a time.
+struct Exposition
+{
+    QByteArray text;
+
+    void family(const char *name, const char *type, const char *help)
+    {
+        text += QByteArray("# HELP ") + name + ' ' + help + '\n';
+        text += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+    }
+
+    void sample(const QByteArray &name, const QByteArray &labels, const QByteArray &value)
+    {
+        text += name + '{' + labels + "} " + value + '\n';
+    }
+    void sample(const QByteArray &name, const QByteArray &labels, quint64 value) { sample(name, labels, QByteArray::number(value)); }
+    void sample(const QByteArray &name, const QByteArray &labels, double value) { sample(name, labels, QByteArray::number(value, 'g', 15)); }
+
+    void histogram(const QByteArray &name, const QByteArray &labels, const LatencyHistogram::Snapshot &snapshot)
+    {
+        for (double bound : LatencyBounds)
+        {
+            const quint64 count = snapshot.countAtMost(static_cast<qint64>(bound * 1e9));
+            sample(name + "_bucket", labels + ",le=\"" + QByteArray::number(bound, 'g', 6) + '"', count);
+        }
+        sample(name + "_bucket", labels + ",le=\"+Inf\"", snapshot.count);
+        sample(name + "_sum", labels, snapshot.totalNs / 1e9);
+        sample(name + "_count", labels, snapshot.count);
+    }
+};
+
+QByteArray recorderState(const RecorderStats &stats)
+{
+    if (stats.finalizing)
+        return "finalizing";
+    if (!stats.running)
+        return "idle";
+    if (stats.paused)
+        return "paused";
+    if (stats.sinceLastFrameMs < 0)
+        return "connecting";
+    return stats.armed ? "armed" : "recording";
+}
+
+void closeSocket(QIODevice *socket)
+{
+    // Both disconnects let pending writes go out first.
+    if (QTcpSocket *tcp = qobject_cast<QTcpSocket *>(socket))
+        tcp->disconnectFromHost();
+    else if (QLocalSocket *local = qobject_cast<QLocalSocket *>(socket))
+        local->disconnectFromServer();
+}
+} // namespace
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start(const QString &address)
+{
+    stop();
+    m_listener = new QObject;
+    m_listener->moveToThread(&m_thread);
+    m_thread.setObjectName("Metrics");
+    m_thread.start(QThread::LowPriority);
+    bool ok = false;
+    QMetaObject::invokeMethod(m_listener, [this, &address, &ok]() { ok = listen(address); }, Qt::BlockingQueuedConnection);
+    if (!ok)
+    {
+        stop();
+        return false;
+    }
+    Logger::instance().log("Serving metrics on " + address);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    if (!m_listener)
+        return;
+    m_thread.quit();
+    m_thread.wait();
+    // The thread has finished, so its objects can be deleted from here.
+    delete m_listener;
+    m_listener = nullptr;
+}
+
+void MetricsServer::addRecorder(SourceRecorder *recorder)
+{
+    QMutexLocker locker(&m_recordersMutex);
+    if (!m_recorders.contains(recorder))
+        m_recorders.append(recorder);
+}
+
+void MetricsServer::removeRecorder(SourceRecorder *recorder)
+{
+    QMutexLocker locker(&m_recordersMutex);
+    m_recorders.removeAll(recorder);
+}
+
+bool MetricsServer::listen(const QString &address)
+{
+    auto accept = [this](auto *socket) {
+        using Socket = std::remove_pointer_t<decltype(socket)>;
+        QObject::connect(socket, &QIODevice::readyRead, m_listener, [this, socket]() { handleReadyRead(socket); });
+        QObject::connect(socket, &Socket::disconnected, socket, &QObject::deleteLater);
+    };
+
+    if (address.startsWith("unix:"))
+    {
+        const QString path = address.mid(5);
+        QLocalServer *server = new QLocalServer(m_listener);
+        // A socket file left by a previous run would make listen() fail.
+        QLocalServer::removeServer(path);
+        if (!server->listen(path))
+        {
+            Logger::instance().log(LogLevel::Error, QString("Metrics server cannot listen on %1: %2").arg(path, server->errorString()));
+            return false;
+        }
+        QObject::connect(server, &QLocalServer::newConnection, m_listener, [server, accept]() {
+            while (QLocalSocket *socket = server->nextPendingConnection())
+                accept(socket);
+        });
+        return true;
+    }
+
+    const int colon = address.lastIndexOf(':');
+    bool portOk = false;
+    const quint16 port = colon >= 0 ? address.mid(colon + 1).toUShort(&portOk) : 0;
+    const QString host = colon > 0 ? address.left(colon) : QString();
+    const QHostAddress hostAddress =
+        host.isEmpty() || host == "localhost" ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host);
+    if (!portOk || hostAddress.isNull())
+    {
+        Logger::instance().log(LogLevel::Error, "Invalid metrics address " + address);
+        return false;
+    }
+    QTcpServer *server = new QTcpServer(m_listener);
+    if (!server->listen(hostAddress, port))
+    {
+        Logger::instance().log(LogLevel::Error, QString("Metrics server cannot listen on %1: %2").arg(address, server->errorString()));
+        return false;
+    }
+    QObject::connect(server, &QTcpServer::newConnection, m_listener, [server, accept]() {
+        while (QTcpSocket *socket = server->nextPendingConnection())
+            accept(socket);
+    });
+    return true;
+}
+
+void MetricsServer::handleReadyRead(QIODevice *socket)
+{
+    // Only the request line matters; headers are read and ignored.
+    const QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+    {
+        if (request.size() > MaxRequestBytes)
+            closeSocket(socket);
+        else
+            socket->setProperty("request", request);
+        return;
+    }
+
+    const QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    const QByteArray method = requestLine.value(0);
+    const QByteArray path = requestLine.value(1);
+    QByteArray status = "200 OK";
+    QByteArray contentType = "text/plain; version=0.0.4; charset=utf-8";
+    QByteArray body;
+    if (method != "GET" && method != "HEAD")
+    {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain";
+        body = "Only GET is supported\n";
+    }
+    else if (path != "/metrics" && !path.startsWith("/metrics?"))
+    {
+        status = "404 Not Found";
+        contentType = "text/plain";
+        body = "Metrics are at /metrics\n";
+    }
+    else
+    {
+        body = render();
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+                          "\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n";
+    if (method != "HEAD")
+        response += body;
+    socket->write(response);
+    closeSocket(socket);
+}
+
+QByteArray MetricsServer::render() const
+{
+    QVector<RecorderStats> recorders;
+    {
+        QMutexLocker locker(&m_recordersMutex);
+        recorders.reserve(m_recorders.size());
+        for (const SourceRecorder *recorder : m_recorders)
+            recorders.append(recorder->stats());
+    }
+    QVector<QByteArray> labels;
+    for (const RecorderStats &stats : recorders)
+        labels.append("source=\"" + escapeLabel(stats.label) + '"');
+
+    Exposition out;
+    out.family("ndirec_recorder_state", "gauge", "Recorder state; 1 for the current one.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        const QByteArray current = recorderState(recorders[i]);
+        for (const char *state : {"idle", "connecting", "armed", "recording", "paused", "finalizing"})
+            out.sample("ndirec_recorder_state", labels[i] + ",state=\"" + state + '"', current == state ? "1" : "0");
+    }
+
+    out.family("ndirec_frames_received_total", "counter", "Video frames taken from the source.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_frames_received_total", labels[i], recorders[i].queue.captured);
+    out.family("ndirec_frames_encoded_total", "counter", "Video frames handed to the encoder.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_frames_encoded_total", labels[i], recorders[i].queue.encoded);
+    out.family("ndirec_frames_dropped_total", "counter", "Video frames lost, by where they were dropped.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        const RecorderStats &stats = recorders[i];
+        out.sample("ndirec_frames_dropped_total", labels[i] + ",reason=\"queue_oldest\"", stats.queue.droppedOldest);
+        out.sample("ndirec_frames_dropped_total", labels[i] + ",reason=\"queue_newest\"", stats.queue.droppedNewest);
+        out.sample("ndirec_frames_dropped_total", labels[i] + ",reason=\"late\"", stats.queue.droppedLate);
+        out.sample("ndirec_frames_dropped_total", labels[i] + ",reason=\"source\"", stats.source.dropped);
+    }
+    out.family("ndirec_frames_duplicated_total", "counter", "Frames repeated to fill the constant frame rate grid.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_frames_duplicated_total", labels[i], recorders[i].queue.duplicated);
+
+    out.family("ndirec_timestamp_gaps_total", "counter", "Source timestamp jumps of more than 1.5 frame intervals.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_timestamp_gaps_total", labels[i], recorders[i].queue.timestampGaps);
+    out.family("ndirec_frames_missing_total", "counter", "Frames implied missing by source timestamp gaps.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_frames_missing_total", labels[i], recorders[i].queue.framesMissing);
+    out.family("ndirec_frames_repeated_total", "counter", "Frames that repeated the previous timestamp and were skipped.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_frames_repeated_total", labels[i], recorders[i].queue.repeatedTimestamps);
+
+    out.family("ndirec_fps_in", "gauge", "Frames received per second over the last second.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_fps_in", labels[i], recorders[i].fpsIn);
+    out.family("ndirec_fps_out", "gauge", "Frames encoded per second over the last second.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_fps_out", labels[i], recorders[i].fpsOut);
+
+    out.family("ndirec_queue_frames", "gauge", "Frames waiting between the capture and encode threads.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_queue_frames", labels[i], static_cast<quint64>(recorders[i].queue.queued));
+    out.family("ndirec_source_queue_frames", "gauge", "Video frames waiting in the source's own receive queue.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_source_queue_frames", labels[i], static_cast<quint64>(recorders[i].source.queuedVideo));
+
+    out.family("ndirec_stage_latency_seconds", "histogram", "Per-frame time in each pipeline stage.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        const StageLatency &latency = recorders[i].latency;
+        out.histogram("ndirec_stage_latency_seconds", labels[i] + ",stage=\"capture\"", latency.capture);
+        out.histogram("ndirec_stage_latency_seconds", labels[i] + ",stage=\"queue\"", latency.queue);
+        out.histogram("ndirec_stage_latency_seconds", labels[i] + ",stage=\"convert\"", latency.convert);
+        out.histogram("ndirec_stage_latency_seconds", labels[i] + ",stage=\"encode\"", latency.encode);
+        out.histogram("ndirec_stage_latency_seconds", labels[i] + ",stage=\"mux\"", latency.mux);
+    }
+
+    out.family("ndirec_bytes_written_total", "counter", "Encoded bytes handed to the muxer.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_bytes_written_total", labels[i], recorders[i].bytesWritten);
+    out.family("ndirec_disk_bytes_total", "counter", "Bytes the I/O threads wrote to output files.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_disk_bytes_total", labels[i], recorders[i].disk.bytes);
+    out.family("ndirec_disk_write_seconds", "histogram", "Time per write call to an output file.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.histogram("ndirec_disk_write_seconds", labels[i], recorders[i].disk.writeTime);
+    out.family("ndirec_disk_buffer_stalls_total", "counter", "Times the muxer waited for the disk because the write buffer was full.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_disk_buffer_stalls_total", labels[i], recorders[i].disk.stalls);
+    out.family("ndirec_storage_level", "gauge", "Output volume state: 0 ok, 1 low, 2 critical.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (!recorders[i].storage.volume.isEmpty())
+            out.sample("ndirec_storage_level", labels[i], static_cast<quint64>(recorders[i].storage.level));
+    }
+    out.family("ndirec_storage_seconds_to_full", "gauge", "Predicted time until the output volume reaches its free-space minimum.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].storage.secondsToFull >= 0)
+            out.sample("ndirec_storage_seconds_to_full", labels[i], static_cast<quint64>(recorders[i].storage.secondsToFull));
+    }
+    out.family("ndirec_bitrate_scale", "gauge", "Bitrate factor applied by the storage policy.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].running)
+            out.sample("ndirec_bitrate_scale", labels[i], recorders[i].storage.bitrateScale);
+    }
+    out.family("ndirec_packet_ring_bytes", "gauge", "Encoded packets held in memory for the pre-roll or replay clips.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].ring.maxBytes > 0)
+            out.sample("ndirec_packet_ring_bytes", labels[i], static_cast<quint64>(recorders[i].ring.bytes));
+    }
+    out.family("ndirec_packet_ring_seconds", "gauge", "Time covered by the packets held in memory.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].ring.maxBytes > 0)
+            out.sample("ndirec_packet_ring_seconds", labels[i], recorders[i].ring.durationMs / 1000.0);
+    }
+    out.family("ndirec_segment_info", "gauge", "File currently being written.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (!recorders[i].currentFile.isEmpty())
+            out.sample("ndirec_segment_info", labels[i] + ",file=\"" + escapeLabel(recorders[i].currentFile) + '"', "1");
+    }
+    out.family("ndirec_output_free_bytes", "gauge", "Free space on the output folder's volume.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].outputFolder.isEmpty())
+            continue;
+        const QStorageInfo storage(recorders[i].outputFolder);
+        if (storage.isValid() && storage.isReady())
+            out.sample("ndirec_output_free_bytes", labels[i], static_cast<quint64>(storage.bytesAvailable()));
+    }
+    out.family("ndirec_seconds_since_last_frame", "gauge", "Time since the source last delivered video.");
+    for (int i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i].running && recorders[i].sinceLastFrameMs >= 0)
+            out.sample("ndirec_seconds_since_last_frame", labels[i], recorders[i].sinceLastFrameMs / 1000.0);
+    }
+    out.family("ndirec_recording_seconds", "gauge", "Recorded time, excluding pauses.");
+    for (int i = 0; i < recorders.size(); ++i)
+        out.sample("ndirec_recording_seconds", labels[i], recorders[i].elapsedMs / 1000.0);
+    return out.text;
+}
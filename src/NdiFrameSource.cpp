@@ -0,0 +1,232 @@
+#include "NdiFrameSource.h"
+#include "Logging.h"
+
+namespace
+{
+AVPixelFormat pixelFormatForFourCC(NDIlib_FourCC_video_type_e fourCC)
+{
+    switch (fourCC)
+    {
+    case NDIlib_FourCC_video_type_UYVY:
+    case NDIlib_FourCC_video_type_UYVA: // alpha plane follows the UYVY plane and is ignored
+        return AV_PIX_FMT_UYVY422;
+    case NDIlib_FourCC_video_type_BGRA:
+        return AV_PIX_FMT_BGRA;
+    case NDIlib_FourCC_video_type_BGRX:
+        return AV_PIX_FMT_BGR0;
+    case NDIlib_FourCC_video_type_RGBA:
+        return AV_PIX_FMT_RGBA;
+    case NDIlib_FourCC_video_type_RGBX:
+        return AV_PIX_FMT_RGB0;
+    case NDIlib_FourCC_video_type_NV12:
+        return AV_PIX_FMT_NV12;
+    case NDIlib_FourCC_video_type_I420:
+        return AV_PIX_FMT_YUV420P;
+    default:
+        return AV_PIX_FMT_NONE;
+    }
+}
+
+// Points data/linesize at the planes of an NDI frame, honouring its line stride.
+void fillFramePlanes(const NDIlib_video_frame_v2_t &videoFrame, AVPixelFormat format, uint8_t *data[4], int linesize[4])
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        data[i] = nullptr;
+        linesize[i] = 0;
+    }
+    const int stride = videoFrame.line_stride_in_bytes;
+    data[0] = videoFrame.p_data;
+    linesize[0] = stride;
+    if (format == AV_PIX_FMT_NV12)
+    {
+        data[1] = videoFrame.p_data + static_cast<ptrdiff_t>(stride) * videoFrame.yres;
+        linesize[1] = stride;
+    }
+    else if (format == AV_PIX_FMT_YUV420P)
+    {
+        data[1] = videoFrame.p_data + static_cast<ptrdiff_t>(stride) * videoFrame.yres;
+        linesize[1] = stride / 2;
+        data[2] = data[1] + static_cast<ptrdiff_t>(linesize[1]) * ((videoFrame.yres + 1) / 2);
+        linesize[2] = stride / 2;
+    }
+}
+
+// Prefer the sender's timestamp, then its timecode, then our receive time.
+qint64 mediaTimestamp(int64_t timestamp, int64_t timecode, qint64 receivedTicks)
+{
+    if (timestamp != NDIlib_recv_timestamp_undefined && timestamp > 0)
+        return timestamp;
+    if (timecode != NDIlib_send_timecode_synthesize)
+        return timecode;
+    return receivedTicks;
+}
+
+int frameDataSize(const NDIlib_video_frame_v2_t &videoFrame)
+{
+    const int plane = videoFrame.line_stride_in_bytes * videoFrame.yres;
+    switch (videoFrame.FourCC)
+    {
+    case NDIlib_FourCC_video_type_UYVA:
+        return plane + videoFrame.xres * videoFrame.yres;
+    case NDIlib_FourCC_video_type_NV12:
+    case NDIlib_FourCC_video_type_I420:
+        return plane + plane / 2;
+    default:
+        return plane;
+    }
+}
+} // namespace
+
+NdiFrameSource::NdiFrameSource(const QString &name, NdiColorFormat colorFormat)
+    : m_name(name.toUtf8()), m_colorFormat(colorFormat)
+{
+}
+
+NdiFrameSource::~NdiFrameSource()
+{
+    if (m_recv)
+        NDIlib_recv_destroy(m_recv);
+}
+
+bool NdiFrameSource::open()
+{
+    NdiManager ndi; // makes sure the library is initialised
+    if (m_recv)
+    {
+        NDIlib_recv_destroy(m_recv);
+        m_recv = nullptr;
+    }
+
+    NDIlib_source_t source = {};
+    source.p_ndi_name = m_name.constData();
+
+    NDIlib_recv_create_v3_t recvCreate = {};
+    recvCreate.source_to_connect_to = source;
+    switch (m_colorFormat)
+    {
+    case NdiColorFormat::Fastest:
+        recvCreate.color_format = NDIlib_recv_color_format_fastest;
+        break;
+    case NdiColorFormat::Rgba:
+        recvCreate.color_format = NDIlib_recv_color_format_RGBX_RGBA;
+        break;
+    case NdiColorFormat::UyvyBgra:
+    default:
+        recvCreate.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+        break;
+    }
+    recvCreate.bandwidth = NDIlib_recv_bandwidth_highest;
+    recvCreate.allow_video_fields = false;
+
+    m_recv = NDIlib_recv_create_v3(&recvCreate);
+    if (!m_recv)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to create NDI receiver for " + QString::fromUtf8(m_name));
+        return false;
+    }
+    m_clock.start();
+    m_statsThrottle.invalidate();
+    return true;
+}
+
+FrameType NdiFrameSource::capture(VideoFrame &video, AudioFrame &audio, int timeoutMs)
+{
+    if (!m_statsThrottle.isValid() || m_statsThrottle.elapsed() >= 1000)
+    {
+        sampleReceiverStats();
+        m_statsThrottle.restart();
+    }
+    NDIlib_video_frame_v2_t videoFrame;
+    NDIlib_audio_frame_v3_t audioFrame;
+    switch (NDIlib_recv_capture_v3(m_recv, &videoFrame, &audioFrame, nullptr, timeoutMs))
+    {
+    case NDIlib_frame_type_video:
+        video = VideoFrame();
+        video.format = pixelFormatForFourCC(videoFrame.FourCC);
+        video.width = videoFrame.xres;
+        video.height = videoFrame.yres;
+        video.buffer = videoFrame.p_data;
+        video.bufferSize = frameDataSize(videoFrame);
+        video.frameRateNum = videoFrame.frame_rate_N;
+        video.frameRateDen = videoFrame.frame_rate_D;
+        video.timestamp = mediaTimestamp(videoFrame.timestamp, videoFrame.timecode, m_clock.nsecsElapsed() / 100);
+        video.handle = videoFrame.FourCC;
+        if (video.format != AV_PIX_FMT_NONE && videoFrame.p_data)
+            fillFramePlanes(videoFrame, video.format, video.data, video.linesize);
+        else
+            video.linesize[0] = videoFrame.line_stride_in_bytes;
+        return FrameType::Video;
+    case NDIlib_frame_type_audio:
+        // Receivers deliver planar float unless asked otherwise.
+        if (audioFrame.FourCC != NDIlib_FourCC_audio_type_FLTP)
+        {
+            NDIlib_recv_free_audio_v3(m_recv, &audioFrame);
+            return FrameType::None;
+        }
+        audio.data = audioFrame.p_data;
+        audio.channels = audioFrame.no_channels;
+        audio.samples = audioFrame.no_samples;
+        audio.sampleRate = audioFrame.sample_rate;
+        audio.channelStride = audioFrame.channel_stride_in_bytes;
+        audio.timestamp = mediaTimestamp(audioFrame.timestamp, audioFrame.timecode, m_clock.nsecsElapsed() / 100);
+        audio.handle = audioFrame.FourCC;
+        return FrameType::Audio;
+    default:
+        return FrameType::None;
+    }
+}
+
+// The SDK only needs the buffer back, so the frame description is rebuilt
+// from what capture() kept.
+void NdiFrameSource::releaseVideo(VideoFrame &video)
+{
+    if (!video.buffer)
+        return;
+    NDIlib_video_frame_v2_t videoFrame;
+    videoFrame.xres = video.width;
+    videoFrame.yres = video.height;
+    videoFrame.FourCC = static_cast<NDIlib_FourCC_video_type_e>(video.handle);
+    videoFrame.line_stride_in_bytes = video.linesize[0];
+    videoFrame.p_data = video.buffer;
+    NDIlib_recv_free_video_v2(m_recv, &videoFrame);
+    video = VideoFrame();
+}
+
+void NdiFrameSource::releaseAudio(AudioFrame &audio)
+{
+    if (!audio.data)
+        return;
+    NDIlib_audio_frame_v3_t audioFrame;
+    audioFrame.sample_rate = audio.sampleRate;
+    audioFrame.no_channels = audio.channels;
+    audioFrame.no_samples = audio.samples;
+    audioFrame.FourCC = static_cast<NDIlib_FourCC_audio_type_e>(audio.handle);
+    audioFrame.p_data = audio.data;
+    audioFrame.channel_stride_in_bytes = audio.channelStride;
+    NDIlib_recv_free_audio_v3(m_recv, &audioFrame);
+    audio = AudioFrame();
+}
+
+void NdiFrameSource::sampleReceiverStats()
+{
+    NDIlib_recv_performance_t total;
+    NDIlib_recv_performance_t dropped;
+    NDIlib_recv_get_performance(m_recv, &total, &dropped);
+    NDIlib_recv_queue_t queue;
+    NDIlib_recv_get_queue(m_recv, &queue);
+    m_received = static_cast<quint64>(total.video_frames);
+    m_dropped = static_cast<quint64>(dropped.video_frames);
+    m_queuedVideo = queue.video_frames;
+    m_queuedAudio = queue.audio_frames;
+}
+
+SourceStats NdiFrameSource::stats() const
+{
+    SourceStats stats;
+    stats.received = m_received;
+    stats.dropped = m_dropped;
+    stats.queuedVideo = m_queuedVideo;
+    stats.queuedAudio = m_queuedAudio;
+    return stats;
+}
@@ -18,14 +18,14 @@ void NdiManager::ensureInitialized()
 {
     if (!NDIlib_initialize())
     {
-        Logger::instance().log("Failed to initialize NDI");
+        Logger::instance().log(LogLevel::Error, "Failed to initialize NDI");
     }
     if (!s_finder)
     {
         s_finder = NDIlib_find_create_v2();
         if (!s_finder)
         {
-            Logger::instance().log("Failed to create NDI finder");
+            Logger::instance().log(LogLevel::Error, "Failed to create NDI finder");
         }
     }
 }
@@ -0,0 +1,136 @@
+#include "PacedFrameSource.h"
+#include "Logging.h"
+#include <QThread>
+#include <algorithm>
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+}
+
+PacedFrameSource::~PacedFrameSource()
+{
+    for (uint8_t *buffer : m_buffers)
+        av_free(buffer);
+}
+
+bool PacedFrameSource::allocateFrames(const Format &format, int align)
+{
+    m_bufferSize = av_image_get_buffer_size(format.format, format.width, format.height, align);
+    if (m_bufferSize <= 0 || format.fpsNum <= 0 || format.fpsDen <= 0)
+    {
+        Logger::instance().log(LogLevel::Warning, QString("Unsupported frame source format %1x%2 at %3/%4")
+                                   .arg(format.width)
+                                   .arg(format.height)
+                                   .arg(format.fpsNum)
+                                   .arg(format.fpsDen));
+        return false;
+    }
+    m_format = format;
+    m_align = align;
+    m_freeBuffers.reset(FrameCount);
+    for (int i = 0; i < FrameCount; ++i)
+    {
+        uint8_t *buffer = static_cast<uint8_t *>(av_malloc(m_bufferSize));
+        if (!buffer)
+            return false;
+        m_buffers.append(buffer);
+        int slot = i;
+        m_freeBuffers.tryPush(slot);
+    }
+    return true;
+}
+
+FrameType PacedFrameSource::capture(VideoFrame &video, AudioFrame &, int timeoutMs)
+{
+    if (m_ended)
+    {
+        QThread::msleep(timeoutMs);
+        return FrameType::EndOfStream;
+    }
+    if (!m_clock.isValid())
+        m_clock.start();
+
+    qint64 index = m_nextIndex;
+    while (dropFrame(index))
+    {
+        ++index;
+        ++m_framesDropped;
+    }
+    m_nextIndex = index;
+    const qint64 due = std::max<qint64>(0, frameTicks(index) + jitterTicks(index));
+
+    int slot = -1;
+    if (m_realtime)
+    {
+        const qint64 waitUs = (due - m_clock.nsecsElapsed() / 100) / 10;
+        if (waitUs > static_cast<qint64>(timeoutMs) * 1000)
+        {
+            QThread::msleep(timeoutMs);
+            return FrameType::None;
+        }
+        if (waitUs > 0)
+            QThread::usleep(waitUs);
+        // A live sender would not wait for us either.
+        if (!m_freeBuffers.tryPop(slot))
+        {
+            ++m_framesDropped;
+            ++m_nextIndex;
+            return FrameType::None;
+        }
+    }
+    else
+    {
+        QElapsedTimer waited;
+        waited.start();
+        while (!m_freeBuffers.tryPop(slot))
+        {
+            if (waited.elapsed() >= timeoutMs)
+                return FrameType::None;
+            QThread::msleep(1);
+        }
+    }
+
+    video = VideoFrame();
+    video.format = m_format.format;
+    video.width = m_format.width;
+    video.height = m_format.height;
+    av_image_fill_arrays(video.data, video.linesize, m_buffers[slot], m_format.format, m_format.width, m_format.height, m_align);
+    video.buffer = m_buffers[slot];
+    video.bufferSize = m_bufferSize;
+    video.frameRateNum = m_format.fpsNum;
+    video.frameRateDen = m_format.fpsDen;
+    video.timestamp = due;
+    video.handle = static_cast<quintptr>(slot);
+    if (!renderFrame(index, video))
+    {
+        m_freeBuffers.tryPush(slot);
+        video = VideoFrame();
+        m_ended = true;
+        return FrameType::EndOfStream;
+    }
+    ++m_nextIndex;
+    ++m_framesDelivered;
+    return FrameType::Video;
+}
+
+void PacedFrameSource::releaseVideo(VideoFrame &video)
+{
+    if (!video.buffer)
+        return;
+    int slot = static_cast<int>(video.handle);
+    m_freeBuffers.tryPush(slot);
+    video = VideoFrame();
+}
+
+SourceStats PacedFrameSource::stats() const
+{
+    SourceStats stats;
+    stats.received = m_framesDelivered;
+    stats.dropped = m_framesDropped;
+    return stats;
+}
+
+qint64 PacedFrameSource::frameTicks(qint64 index) const
+{
+    return index * 10000000 * m_format.fpsDen / m_format.fpsNum;
+}
@@ -0,0 +1,166 @@
+#include "PacketRing.h"
+#include <algorithm>
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+void PacketRing::configure(AVRational videoTimeBase, AVRational audioTimeBase, int64_t duration, qint64 maxBytes)
+{
+    clear();
+    m_videoTimeBase = videoTimeBase;
+    m_audioTimeBase = audioTimeBase;
+    m_duration = duration;
+    m_maxBytes = maxBytes;
+}
+
+void PacketRing::setDuration(int64_t duration)
+{
+    m_duration = duration;
+    trim();
+}
+
+void PacketRing::pushVideo(AVPacket *pkt)
+{
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+    {
+        m_keyframes.push_back({m_frontSequence + m_video.size(), pkt->pts});
+    }
+    else if (m_keyframes.empty())
+    {
+        // Nothing to decode it from.
+        freePacket(pkt);
+        return;
+    }
+    m_video.push_back(pkt);
+    m_bytes += pkt->size;
+    m_newestPts = m_newestPts == AV_NOPTS_VALUE ? pkt->pts : std::max(m_newestPts, pkt->pts);
+    trim();
+}
+
+void PacketRing::pushAudio(AVPacket *pkt)
+{
+    if (m_keyframes.empty() || pkt->pts < av_rescale_q(m_keyframes.front().pts, m_videoTimeBase, m_audioTimeBase))
+    {
+        freePacket(pkt);
+        return;
+    }
+    m_audio.push_back(pkt);
+    m_bytes += pkt->size;
+    trim();
+}
+
+int64_t PacketRing::copyFrom(int64_t fromPts, QVector<AVPacket *> &video, QVector<AVPacket *> &audio) const
+{
+    Span selected;
+    if (!span(fromPts, selected))
+        return AV_NOPTS_VALUE;
+    video.reserve(video.size() + static_cast<int>(selected.videoEnd - selected.videoBegin));
+    for (quint64 sequence = selected.videoBegin; sequence < selected.videoEnd; ++sequence)
+    {
+        if (AVPacket *copy = cloneVideo(sequence))
+            video.append(copy);
+    }
+    audio.reserve(audio.size() + static_cast<int>(selected.audioEnd - selected.audioBegin));
+    for (quint64 sequence = selected.audioBegin; sequence < selected.audioEnd; ++sequence)
+    {
+        if (AVPacket *copy = cloneAudio(sequence))
+            audio.append(copy);
+    }
+    return selected.keyframePts;
+}
+
+bool PacketRing::span(int64_t fromPts, Span &span) const
+{
+    if (m_keyframes.empty())
+        return false;
+    auto key = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), fromPts,
+                                [](int64_t pts, const Keyframe &keyframe) { return pts < keyframe.pts; });
+    if (key != m_keyframes.begin())
+        --key;
+    span.keyframePts = key->pts;
+    span.videoBegin = key->sequence;
+    span.videoEnd = m_frontSequence + m_video.size();
+    const int64_t audioPts = av_rescale_q(key->pts, m_videoTimeBase, m_audioTimeBase);
+    auto first = std::lower_bound(m_audio.begin(), m_audio.end(), audioPts, [](const AVPacket *pkt, int64_t pts) { return pkt->pts < pts; });
+    span.audioBegin = m_audioFrontSequence + static_cast<quint64>(first - m_audio.begin());
+    span.audioEnd = m_audioFrontSequence + m_audio.size();
+    return true;
+}
+
+AVPacket *PacketRing::cloneVideo(quint64 sequence) const
+{
+    if (sequence < m_frontSequence || sequence >= m_frontSequence + m_video.size())
+        return nullptr;
+    return av_packet_clone(m_video[sequence - m_frontSequence]);
+}
+
+AVPacket *PacketRing::cloneAudio(quint64 sequence) const
+{
+    if (sequence < m_audioFrontSequence || sequence >= m_audioFrontSequence + m_audio.size())
+        return nullptr;
+    return av_packet_clone(m_audio[sequence - m_audioFrontSequence]);
+}
+
+void PacketRing::clear()
+{
+    for (AVPacket *pkt : m_video)
+        freePacket(pkt);
+    for (AVPacket *pkt : m_audio)
+        freePacket(pkt);
+    // Sequences carry on across clear() so a span taken before it cannot
+    // point at packets pushed after.
+    m_frontSequence += m_video.size();
+    m_audioFrontSequence += m_audio.size();
+    m_video.clear();
+    m_audio.clear();
+    m_keyframes.clear();
+    m_newestPts = AV_NOPTS_VALUE;
+    m_bytes = 0;
+}
+
+int64_t PacketRing::duration() const
+{
+    return m_keyframes.empty() ? 0 : m_newestPts - m_keyframes.front().pts;
+}
+
+void PacketRing::trim()
+{
+    // Only whole GOPs go, and only while the rest still covers the window.
+    while (m_keyframes.size() >= 2 && (m_newestPts - m_keyframes[1].pts >= m_duration || m_bytes > m_maxBytes))
+        dropOldestGop();
+    if (m_bytes > m_maxBytes)
+        clear();
+}
+
+void PacketRing::dropOldestGop()
+{
+    const quint64 end = m_keyframes[1].sequence;
+    m_keyframes.pop_front();
+    while (m_frontSequence < end)
+    {
+        AVPacket *pkt = m_video.front();
+        m_video.pop_front();
+        ++m_frontSequence;
+        m_bytes -= pkt->size;
+        freePacket(pkt);
+    }
+    dropAudioBefore(m_keyframes.front().pts);
+}
+
+void PacketRing::dropAudioBefore(int64_t videoPts)
+{
+    const int64_t audioPts = av_rescale_q(videoPts, m_videoTimeBase, m_audioTimeBase);
+    while (!m_audio.empty() && m_audio.front()->pts < audioPts)
+    {
+        AVPacket *pkt = m_audio.front();
+        m_audio.pop_front();
+        ++m_audioFrontSequence;
+        m_bytes -= pkt->size;
+        freePacket(pkt);
+    }
+}
+
+void PacketRing::freePacket(AVPacket *pkt)
+{
+    av_packet_free(&pkt);
+}
@@ -0,0 +1,76 @@
+#include "PicturePool.h"
+
+bool PicturePool::init(AVPixelFormat format, int width, int height, int count)
+{
+    clear();
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_allocations = 0;
+    m_pictures.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        AVFrame *frame = allocPicture();
+        if (!frame)
+            return false;
+        m_pictures.append(frame);
+    }
+    return true;
+}
+
+void PicturePool::clear()
+{
+    // Buffers the encoder still references are freed when it lets go of them.
+    for (AVFrame *&frame : m_pictures)
+        av_frame_free(&frame);
+    m_pictures.clear();
+    m_next = 0;
+}
+
+AVFrame *PicturePool::acquire()
+{
+    // Round-robin from the last picture handed out: the oldest ones are the
+    // likeliest to have left the encoder.
+    for (int i = 0; i < m_pictures.size(); ++i)
+    {
+        const int index = (m_next + i) % m_pictures.size();
+        if (isFree(m_pictures[index]))
+        {
+            m_next = (index + 1) % m_pictures.size();
+            return m_pictures[index];
+        }
+    }
+    AVFrame *frame = allocPicture();
+    if (!frame)
+        return nullptr;
+    m_pictures.append(frame);
+    m_next = 0;
+    return frame;
+}
+
+AVFrame *PicturePool::allocPicture()
+{
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return nullptr;
+    frame->format = m_format;
+    frame->width = m_width;
+    frame->height = m_height;
+    if (av_frame_get_buffer(frame, Align) < 0)
+    {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    ++m_allocations;
+    return frame;
+}
+
+bool PicturePool::isFree(const AVFrame *frame)
+{
+    for (AVBufferRef *buf : frame->buf)
+    {
+        if (buf && av_buffer_get_ref_count(buf) > 1)
+            return false;
+    }
+    return true;
+}
@@ -13,7 +13,7 @@ int RecordingLibraryModel::rowCount(const QModelIndex &) const
 
 int RecordingLibraryModel::columnCount(const QModelIndex &) const
 {
-    return 5;
+    return 6;
 }
 
 QVariant RecordingLibraryModel::data(const QModelIndex &index, int role) const
@@ -28,6 +28,10 @@ QVariant RecordingLibraryModel::data(const QModelIndex &index, int role) const
     case 2: return e.fullPath;
     case 3: return e.timestamp.toString(Qt::ISODate);
     case 4: return QString::number(e.size / (1024.0 * 1024.0), 'f', 2) + " MB";
+    case 5:
+        if (e.finalizePercent < 0)
+            return "Recording";
+        return e.finalizePercent < 100 ? QString("Finalizing %1%").arg(e.finalizePercent) : QString("Complete");
     default: return QVariant();
     }
 }
@@ -43,6 +47,7 @@ QVariant RecordingLibraryModel::headerData(int section, Qt::Orientation orientat
     case 2: return "Path";
     case 3: return "Date";
     case 4: return "Size";
+    case 5: return "Status";
     default: return QVariant();
     }
 }
@@ -54,13 +59,28 @@ void RecordingLibraryModel::addEntry(const RecordingEntry &entry)
     endInsertRows();
 }
 
+void RecordingLibraryModel::setFinalizeProgress(const QString &fullPath, int percent)
+{
+    for (int row = m_entries.size() - 1; row >= 0; --row)
+    {
+        RecordingEntry &e = m_entries[row];
+        if (e.fullPath != fullPath)
+            continue;
+        e.finalizePercent = percent;
+        if (percent >= 100)
+            e.size = QFileInfo(fullPath).size();
+        emit dataChanged(index(row, 4), index(row, 5));
+        return;
+    }
+}
+
 void RecordingLibraryModel::scanFolders(const QStringList &folders)
 {
     beginResetModel();
     m_entries.clear();
     for (const QString &folder : folders)
     {
-        QDirIterator it(folder, QStringList() << "*.mkv", QDir::Files, QDirIterator::Subdirectories);
+        QDirIterator it(folder, QStringList() << "*.mp4" << "*.mov" << "*.mkv", QDir::Files, QDirIterator::Subdirectories);
         while (it.hasNext())
         {
             QFileInfo info(it.next());
@@ -1,28 +1,53 @@
 #include "SourceRecorder.h"
+#include "AllocationTrace.h"
+#include "CpuBudget.h"
+#include "FinalizationPool.h"
 #include "Logging.h"
+#include "StorageMonitor.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 #include <QImage>
-#include <QByteArray>
 #include <QThread>
 #include <QMutexLocker>
-#include <QProcess>
-#include <QFile>
-#include <QFileInfo>
+#include <QVarLengthArray>
 #include <algorithm>
 #include <cmath>
+#include <memory>
 extern "C" {
 #include <libavutil/imgutils.h>
 #include <libavutil/rational.h>
 }
 
 SourceRecorder::SourceRecorder(QObject *parent)
-    : QObject(parent), m_running(false), m_paused(false), m_recordingStarted(false), m_recv(nullptr), m_pausedDurationMs(0), m_pauseStartMs(0)
+    : QObject(parent), m_active(false), m_running(false), m_encoding(false), m_paused(false), m_recordingStarted(false),
+      m_armed(false), m_commitRequested(false), m_previewEnabled(true), m_finalizing(false), m_stoppedForStorage(false), m_finalizePercent(0), m_previewWidth(640), m_previewHeight(360),
+      m_framesCaptured(0), m_framesEncoded(0), m_timestampGaps(0), m_framesMissing(0), m_repeatedTimestamps(0), m_encoderThreads(0),
+      m_lastFrameNs(0), m_pausedDurationMs(0), m_pauseStartMs(0)
 {
     m_status = "Idle";
+    connect(&m_captureThread, &QThread::started, this, &SourceRecorder::captureThreadFunc, Qt::DirectConnection);
+    connect(&m_encodeThread, &QThread::started, this, &SourceRecorder::encodeThreadFunc, Qt::DirectConnection);
+    connect(&m_audioThread, &QThread::started, this, &SourceRecorder::audioThreadFunc, Qt::DirectConnection);
+    m_frameRefs.resize(FrameRefSlots);
+    for (int i = 0; i < FrameRefSlots; ++i)
+    {
+        m_frameRefs[i].owner = this;
+        m_frameRefs[i].index = i;
+    }
 }
 
 SourceRecorder::~SourceRecorder()
 {
     stop();
+    waitFinalized();
+    {
+        // Clip jobs report back through this object.
+        QMutexLocker locker(&m_finalizeMutex);
+        while (m_clipExports > 0)
+            m_finalized.wait(&m_finalizeMutex);
+    }
+    sws_freeContext(m_previewSws);
 }
 
 void SourceRecorder::applySettings(const SourceSettings &settings)
@@ -34,112 +59,320 @@ void SourceRecorder::applySettings(const SourceSettings &settings)
 }
 
 void SourceRecorder::start()
+{
+    if (m_armed)
+    {
+        // Already encoding; the writer opens the file at the oldest buffered keyframe.
+        m_commitRequested = true;
+        m_writer.commitPreRoll();
+        return;
+    }
+    startPipeline(false);
+}
+
+void SourceRecorder::arm()
+{
+    if (m_settings.preRollSeconds <= 0 || m_armed)
+        return;
+    startPipeline(true);
+}
+
+void SourceRecorder::startPipeline(bool armed)
 {
     if (m_running)
         return;
+    // A pipeline that ended on its own (error, end of file) is closed first.
+    stop();
+    {
+        QMutexLocker locker(&m_finalizeMutex);
+        if (m_finalizing)
+        {
+            // Start once the previous files are closed rather than block the caller.
+            m_startPending = true;
+            m_armPending = armed;
+            return;
+        }
+    }
 
-    if (m_settings.ndiSource.isEmpty() || m_settings.outputFolder.isEmpty())
+    if (m_settings.ndiSource.isEmpty() || (m_settings.outputFolder.isEmpty() && !m_settings.discardOutput))
     {
         m_status = "Missing settings";
-        emit errorOccurred("Configure NDI source and output folder before starting.");
+        emit errorOccurred("Configure a source and output folder before starting.");
         return;
     }
 
-    // Validate that the configured NDI source is still available
-    NdiManager ndi;
-    if (!ndi.availableSources().contains(m_settings.ndiSource))
+    QString reason;
+    if (!m_settings.discardOutput && !StorageMonitor::instance().canStart(m_settings.outputFolder, reason))
+    {
+        m_status = "Disk full";
+        emit errorOccurred(QString("Not starting %1: %2").arg(m_settings.label, reason));
+        return;
+    }
+
+    // Validate that the configured source is still available
+    if (!FrameSource::isAvailable(m_settings.ndiSource))
     {
         m_status = "Source unavailable";
-        emit errorOccurred("NDI source not found: " + m_settings.ndiSource);
+        emit errorOccurred("Source not found: " + m_settings.ndiSource);
+        return;
+    }
+    {
+        QMutexLocker sourceLocker(&m_sourceMutex);
+        m_source = FrameSource::create(m_settings.ndiSource, m_settings.colorFormat);
+    }
+    if (!m_source)
+    {
+        m_status = "Error";
+        emit errorOccurred("Invalid source: " + m_settings.ndiSource);
         return;
     }
 
+    m_frameQueue.reset(static_cast<size_t>(std::max(2, m_settings.queueDepth)));
+    m_audioQueue.reset(AudioQueueDepth);
+    m_freeFrameRefs.reset(FrameRefSlots);
+    for (int i = 0; i < FrameRefSlots; ++i)
+        m_freeFrameRefs.tryPush(i);
+    m_framesCaptured = 0;
+    m_framesEncoded = 0;
+    m_captureTime.reset();
+    m_queueTime.reset();
+    m_lastFrameNs = 0;
+    m_timestampGaps = 0;
+    m_framesMissing = 0;
+    m_repeatedTimestamps = 0;
+    {
+        QMutexLocker rateLocker(&m_rateMutex);
+        m_rateTimer.invalidate();
+        m_fpsIn = 0.0;
+        m_fpsOut = 0.0;
+    }
+    m_encoderThreads = 0;
+    m_cpuLease = CpuBudget::instance().acquire(m_settings.label);
+    m_outputFolder = m_settings.outputFolder;
+    m_stopReason.clear();
+    m_stoppedForStorage = false;
+    if (!m_settings.discardOutput)
+        m_storageLease = StorageMonitor::instance().acquire(m_settings.label, m_settings.outputFolder, m_settings.priority,
+                                                            [this]() { return m_writer.diskStats(); });
+    m_active = true;
     m_running = true;
+    m_encoding = true;
     m_paused = false;
     m_recordingStarted = false;
-    m_videoPts = 0;
-    m_expectedFrameTicks10ns = 0;
-    m_expectedPtsStep = 1;
-    m_sourceFpsNum = 60;
-    m_sourceFpsDen = 1;
+    m_armed = armed;
+    m_commitRequested = false;
     {
         QMutexLocker stateLocker(&m_stateMutex);
         m_pausedDurationMs = 0;
         m_pauseStartMs = 0;
+        m_preRollMs = 0;
     }
     m_previewThrottle.invalidate();
     m_status = "Connecting";
-    {
-        QMutexLocker locker(&m_mutex);
-        m_preview = QImage();
-    }
+    m_previewSlot.clear();
     emit previewUpdated();
 
-    connect(&m_videoThread, &QThread::started, this, &SourceRecorder::videoThreadFunc);
-    moveToThread(&m_videoThread);
-    m_videoThread.start();
+    m_encodeThread.start();
+    if (m_settings.audioCodec != AudioCodec::None)
+        m_audioThread.start();
+    // Capture only copies and queues, but a late read drops frames at the sender.
+    m_captureThread.start(QThread::HighestPriority);
 }
 
 void SourceRecorder::stop()
 {
-    const QString recordedFile = m_writer.currentFile();
-
+    {
+        QMutexLocker locker(&m_finalizeMutex);
+        m_startPending = false;
+        m_armPending = false;
+    }
+    if (!m_active.fetchAndStoreOrdered(false))
+        return;
     m_running = false;
     m_paused = false;
     m_recordingStarted = false;
+    m_armed = false;
+    m_commitRequested = false;
     {
         QMutexLocker stateLocker(&m_stateMutex);
         m_pausedDurationMs = 0;
         m_pauseStartMs = 0;
     }
-    m_videoThread.quit();
-    m_videoThread.wait();
-    if (m_recv)
+    m_frameQueue.wakeAll();
+    m_audioQueue.wakeAll();
+    m_captureThread.quit();
+    m_captureThread.wait();
+
+    // Capture has halted. Draining and closing the files can take a while, so
+    // it runs on the finalization pool and stop() returns here.
+    const QString file = m_writer.currentFile();
     {
-        NDIlib_recv_destroy(m_recv);
-        m_recv = nullptr;
+        QMutexLocker locker(&m_finalizeMutex);
+        m_finalizing = true;
     }
+    m_finalizePercent = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_status = "Finalizing";
+    }
+    FinalizationPool::instance().submit([this, file]() { finalize(file); });
+}
+
+void SourceRecorder::waitFinalized()
+{
+    QMutexLocker locker(&m_finalizeMutex);
+    while (m_finalizing)
+        m_finalized.wait(&m_finalizeMutex);
+}
+
+void SourceRecorder::reportFinalizeProgress(const QString &file, int percent)
+{
+    if (percent == m_finalizePercent)
+        return;
+    m_finalizePercent = percent;
+    if (!file.isEmpty())
+        emit finalizationProgress(file, percent);
+}
+
+void SourceRecorder::finalize(const QString &file)
+{
+    // The encoder drains whatever is still queued before the receiver goes
+    // away; that drain is most of the progress, the flush and trailer the rest.
+    const int queued = std::max<int>(1, static_cast<int>(m_frameQueue.size()));
+    m_encoding = false;
+    m_frameQueue.wakeAll();
+    m_encodeThread.quit();
+    while (!m_encodeThread.wait(200))
+        reportFinalizeProgress(file, 80 * (queued - std::min<int>(queued, static_cast<int>(m_frameQueue.size()))) / queued);
+    m_audioQueue.wakeAll();
+    m_audioThread.quit();
+    m_audioThread.wait();
+    reportFinalizeProgress(file, 80);
+    // Closing the encoder drops its references to wrapped source frames,
+    // which must all be returned before the source is destroyed.
     m_writer.stop();
+    const SourceStats sourceStats = m_source ? m_source->stats() : SourceStats();
+    {
+        QMutexLocker sourceLocker(&m_sourceMutex);
+        m_source.reset();
+    }
+    if (m_cpuLease)
+    {
+        CpuBudget::instance().release(m_cpuLease);
+        m_cpuLease = 0;
+    }
+    if (m_storageLease)
+    {
+        StorageMonitor::instance().release(m_storageLease);
+        m_storageLease = 0;
+    }
 
-    if (!recordedFile.isEmpty())
+    if (m_framesCaptured > 0)
     {
-        QFileInfo info(recordedFile);
-        if (info.exists() && info.size() > 0)
-        {
-            QString fpsArg = QString::number(m_sourceFpsNum);
-            if (m_sourceFpsDen != 1)
-                fpsArg = QString("%1/%2").arg(m_sourceFpsNum).arg(m_sourceFpsDen);
-
-            const QString tmpPath = info.path() + "/." + info.completeBaseName() + "_fpsfix.mp4";
-            QStringList args = {"-y", "-i", recordedFile, "-r", fpsArg, "-vsync", "cfr", "-c:v", "libx264", "-preset",
-                                 "ultrafast", "-b:v", "12M", "-movflags", "+faststart", tmpPath};
-            QProcess ffmpeg;
-            ffmpeg.start("ffmpeg", args);
-            ffmpeg.waitForFinished(-1);
-            if (ffmpeg.exitStatus() == QProcess::NormalExit && ffmpeg.exitCode() == 0)
-            {
-                QFile::remove(recordedFile);
-                if (!QFile::rename(tmpPath, recordedFile))
-                {
-                    QFile::remove(tmpPath);
-                    Logger::instance().log("Failed to replace recording with fps-fixed version for " + m_settings.label);
-                }
-            }
-            else
-            {
-                QFile::remove(tmpPath);
-                Logger::instance().log("FFmpeg framerate fix failed for " + m_settings.label + ": " + ffmpeg.readAllStandardError());
-            }
-        }
+        const QueueStats stats = queueStats();
+        Logger::instance().log(QString("Frame queue for %1: captured %2, encoded %3, dropped oldest %4, dropped newest %5, blocked %6, "
+                                           "dropped late %7, duplicated %8, dropped by source %9, frame buffers allocated %10")
+                                   .arg(m_settings.label)
+                                   .arg(stats.captured)
+                                   .arg(stats.encoded)
+                                   .arg(stats.droppedOldest)
+                                   .arg(stats.droppedNewest)
+                                   .arg(stats.blockedPushes)
+                                   .arg(stats.droppedLate)
+                                   .arg(stats.duplicated)
+                                   .arg(sourceStats.dropped)
+                                   .arg(stats.bufferAllocations));
+        if (stats.timestampGaps > 0 || stats.repeatedTimestamps > 0)
+            Logger::instance().log(QString("Source timing for %1: %2 gaps with %3 frames missing, %4 repeated timestamps")
+                                       .arg(m_settings.label)
+                                       .arg(stats.timestampGaps)
+                                       .arg(stats.framesMissing)
+                                       .arg(stats.repeatedTimestamps));
+        const StageLatency latency = stageLatency();
+        auto stage = [](const char *name, const LatencyHistogram::Snapshot &snapshot) {
+            return QString("%1 %2/%3/%4")
+                .arg(name)
+                .arg(snapshot.percentileNs(0.50) / 1e6, 0, 'f', 2)
+                .arg(snapshot.percentileNs(0.99) / 1e6, 0, 'f', 2)
+                .arg(snapshot.maxNs / 1e6, 0, 'f', 2);
+        };
+        Logger::instance().log(QString("Stage latency for %1 in ms (p50/p99/max): %2, %3, %4, %5, %6")
+                                   .arg(m_settings.label)
+                                   .arg(stage("capture", latency.capture))
+                                   .arg(stage("queue", latency.queue))
+                                   .arg(stage("convert", latency.convert))
+                                   .arg(stage("encode", latency.encode))
+                                   .arg(stage("mux", latency.mux)));
+        const DiskWriteStats disk = m_writer.diskStats();
+        if (disk.writes > 0)
+            Logger::instance().log(QString("Disk writes for %1: %2 MB in %3 writes, %4, %5 buffer stalls (%6 ms)")
+                                       .arg(m_settings.label)
+                                       .arg(disk.bytes / 1e6, 0, 'f', 1)
+                                       .arg(disk.writes)
+                                       .arg(stage("write", disk.writeTime))
+                                       .arg(disk.stalls)
+                                       .arg(disk.stallNs / 1000000));
     }
 
-    emit recordingStopped();
-    m_status = "Idle";
     {
         QMutexLocker locker(&m_mutex);
-        m_preview = QImage();
+        m_status = m_stopReason.isEmpty() ? QString("Idle") : m_stopReason;
     }
+    m_previewSlot.clear();
     emit previewUpdated();
+    reportFinalizeProgress(file, 100);
+    emit recordingStopped();
+    // Last touch: a waiting destructor may delete the recorder right after.
+    QMutexLocker locker(&m_finalizeMutex);
+    m_finalizing = false;
+    m_finalized.wakeAll();
+    if (m_startPending)
+    {
+        m_startPending = false;
+        const bool armed = m_armPending;
+        QMetaObject::invokeMethod(this, [this, armed]() { armed ? arm() : start(); }, Qt::QueuedConnection);
+    }
+}
+
+
+QString SourceRecorder::exportClip(int seconds)
+{
+    auto clip = std::make_shared<ClipPackets>();
+    if (!m_running || !m_writer.copyRecent(seconds, *clip))
+    {
+        emit errorOccurred(QString("No recent video to export for %1; clips need a replay length in its settings").arg(m_settings.label));
+        return QString();
+    }
+    const QString current = m_writer.currentFile();
+    const QString folder = current.isEmpty() ? m_settings.outputFolder : QFileInfo(current).absolutePath();
+    const QString base = QString("%1/%2_%3_clip")
+                             .arg(folder, m_settings.label, QDateTime::currentDateTime().addMSecs(-clip->durationMs).toString("yyyyMMdd_HHmmss"));
+    QString path = QString("%1.%2").arg(base, clip->format);
+    for (int n = 2; QFile::exists(path); ++n)
+        path = QString("%1_%2.%3").arg(base).arg(n).arg(clip->format);
+
+    {
+        QMutexLocker locker(&m_finalizeMutex);
+        ++m_clipExports;
+    }
+    // Settings can change while the export runs; the pool job keeps its own label.
+    const QString label = m_settings.label;
+    FinalizationPool::instance().submit([this, clip, path, label]() {
+        const qint64 start = LatencyHistogram::now();
+        const bool ok = FfmpegWriter::writeClip(*clip, path);
+        if (ok)
+            Logger::instance().log(QString("Exported %1 s of %2 to %3 in %4 ms")
+                                       .arg(clip->durationMs / 1000.0, 0, 'f', 1)
+                                       .arg(label, path)
+                                       .arg((LatencyHistogram::now() - start) / 1000000));
+        else
+            Logger::instance().log(LogLevel::Error, "Clip export failed: " + path);
+        emit clipExported(path, ok);
+        QMutexLocker locker(&m_finalizeMutex);
+        --m_clipExports;
+        m_finalized.wakeAll();
+    });
+    return path;
 }
 
 void SourceRecorder::pause()
@@ -173,188 +406,622 @@ qint64 SourceRecorder::elapsedMs() const
         return 0;
     QMutexLocker stateLocker(&m_stateMutex);
     if (m_paused)
-        return m_pauseStartMs - m_pausedDurationMs;
-    return m_timer.elapsed() - m_pausedDurationMs;
+        return m_pauseStartMs - m_pausedDurationMs + m_preRollMs;
+    return m_timer.elapsed() - m_pausedDurationMs + m_preRollMs;
 }
 
-QImage SourceRecorder::lastFrame() const
+void SourceRecorder::setPreviewSize(int width, int height)
 {
-    QMutexLocker locker(&m_mutex);
-    return m_preview;
+    m_previewWidth = std::max(16, width);
+    m_previewHeight = std::max(16, height);
 }
 
-void SourceRecorder::reconnect()
+bool SourceRecorder::takePreview(QImage &image, quint64 &sequence)
 {
-    if (m_recv)
+    return m_previewSlot.take(image, sequence);
+}
+
+void SourceRecorder::updatePreview(const VideoFrame &videoFrame)
+{
+    if (videoFrame.format == AV_PIX_FMT_NONE || videoFrame.width <= 0 || videoFrame.height <= 0)
+        return;
+
+    // Box-filter straight from the source buffer to the largest integer
+    // fraction of the frame that fits the tile, so the GUI never scales.
+    const int maxWidth = m_previewWidth;
+    const int maxHeight = m_previewHeight;
+    const int factor = std::clamp(std::max((videoFrame.width + maxWidth - 1) / maxWidth, (videoFrame.height + maxHeight - 1) / maxHeight),
+                                  1, ColorConvert::MaxPreviewFactor);
+    const int previewWidth = std::max(1, videoFrame.width / factor);
+    const int previewHeight = std::max(1, videoFrame.height / factor);
+    QImage &img = m_previewSlot.backBuffer(previewWidth, previewHeight);
+    uint8_t *dst = img.bits();
+    const int dstStride = static_cast<int>(img.bytesPerLine());
+    switch (videoFrame.format)
+    {
+    case AV_PIX_FMT_UYVY422:
+        ColorConvert::uyvyToRgbxPreview(videoFrame.data[0], videoFrame.linesize[0], dst, dstStride, videoFrame.width, videoFrame.height,
+                                        factor, videoFrame.height >= 720 ? ColorConvert::Matrix::Bt709 : ColorConvert::Matrix::Bt601,
+                                        m_previewScratch);
+        break;
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+        ColorConvert::rgbaToRgbxPreview(videoFrame.data[0], videoFrame.linesize[0], dst, dstStride, videoFrame.width, videoFrame.height,
+                                        factor, m_previewScratch);
+        break;
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+        ColorConvert::bgraToRgbxPreview(videoFrame.data[0], videoFrame.linesize[0], dst, dstStride, videoFrame.width, videoFrame.height,
+                                        factor, m_previewScratch);
+        break;
+    default:
     {
-        NDIlib_recv_destroy(m_recv);
-        m_recv = nullptr;
+        // Planar test sources only.
+        m_previewSws = sws_getCachedContext(m_previewSws, videoFrame.width, videoFrame.height, videoFrame.format, previewWidth,
+                                            previewHeight, AV_PIX_FMT_RGB0, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+        if (!m_previewSws)
+            return;
+        uint8_t *dstData[4] = {dst, nullptr, nullptr, nullptr};
+        int dstLinesize[4] = {dstStride, 0, 0, 0};
+        sws_scale(m_previewSws, videoFrame.data, videoFrame.linesize, 0, videoFrame.height, dstData, dstLinesize);
+        break;
     }
+    }
+    m_previewSlot.publish();
+    emit previewUpdated();
+}
 
-    QByteArray ndiNameUtf8 = m_settings.ndiSource.toUtf8();
-    NDIlib_source_t source = {};
-    source.p_ndi_name = ndiNameUtf8.constData();
+QueueStats SourceRecorder::queueStats() const
+{
+    QueueStats stats;
+    stats.captured = m_framesCaptured;
+    stats.encoded = m_framesEncoded;
+    stats.droppedOldest = m_frameQueue.droppedOldest();
+    stats.droppedNewest = m_frameQueue.droppedNewest();
+    stats.blockedPushes = m_frameQueue.blockedPushes();
+    stats.duplicated = m_writer.duplicatedFrames();
+    stats.droppedLate = m_writer.droppedFrames();
+    stats.timestampGaps = m_timestampGaps;
+    stats.framesMissing = m_framesMissing;
+    stats.repeatedTimestamps = m_repeatedTimestamps;
+    stats.bufferAllocations = m_writer.bufferAllocations();
+    stats.queued = static_cast<int>(m_frameQueue.size());
+    stats.depth = static_cast<int>(m_frameQueue.capacity());
+    return stats;
+}
 
-    NDIlib_recv_create_v3_t recvCreate = {};
-    recvCreate.source_to_connect_to = source;
-    recvCreate.color_format = NDIlib_recv_color_format_RGBX_RGBA;
-    recvCreate.bandwidth = NDIlib_recv_bandwidth_highest;
-    recvCreate.allow_video_fields = false;
+StageLatency SourceRecorder::stageLatency() const
+{
+    StageLatency latency;
+    latency.capture = m_captureTime.snapshot();
+    latency.queue = m_queueTime.snapshot();
+    const WriterLatency writer = m_writer.latency();
+    latency.convert = writer.convert;
+    latency.encode = writer.encode;
+    latency.mux = writer.mux;
+    return latency;
+}
 
-    m_recv = NDIlib_recv_create_v3(&recvCreate);
-    if (!m_recv)
+RecorderStats SourceRecorder::stats() const
+{
+    RecorderStats stats;
     {
-        Logger::instance().log("Failed to create NDI receiver for " + m_settings.ndiSource);
-        emit errorOccurred("NDI receiver failed");
-        m_running = false;
-        m_status = "Error";
+        QMutexLocker locker(&m_mutex);
+        stats.label = m_settings.label;
+        stats.outputFolder = m_settings.outputFolder;
+        stats.status = m_status;
+    }
+    stats.running = m_running;
+    stats.paused = m_paused;
+    stats.finalizing = m_finalizing;
+    stats.finalizePercent = m_finalizePercent;
+    stats.armed = m_armed;
+    stats.elapsedMs = elapsedMs();
+    const qint64 lastFrameNs = m_lastFrameNs;
+    if (lastFrameNs)
+        stats.sinceLastFrameMs = (LatencyHistogram::now() - lastFrameNs) / 1000000;
+    stats.queue = queueStats();
+    {
+        QMutexLocker sourceLocker(&m_sourceMutex);
+        if (m_source)
+            stats.source = m_source->stats();
     }
+    stats.latency = stageLatency();
+    if (m_storageLease)
+        stats.storage = StorageMonitor::instance().status(m_storageLease);
+    stats.currentFile = m_writer.currentFile();
+    stats.bytesWritten = m_writer.bytesWritten();
+    stats.disk = m_writer.diskStats();
+    stats.ring = m_writer.ringStats();
+
+    // Whoever polls first each second moves the window; other callers share it.
+    QMutexLocker rateLocker(&m_rateMutex);
+    if (!m_running)
+    {
+        m_fpsIn = 0.0;
+        m_fpsOut = 0.0;
+    }
+    else if (!m_rateTimer.isValid())
+    {
+        m_rateTimer.start();
+        m_rateCaptured = stats.queue.captured;
+        m_rateEncoded = stats.queue.encoded;
+    }
+    else if (m_rateTimer.elapsed() >= 1000)
+    {
+        const double seconds = m_rateTimer.nsecsElapsed() / 1e9;
+        m_fpsIn = (stats.queue.captured - m_rateCaptured) / seconds;
+        m_fpsOut = (stats.queue.encoded - m_rateEncoded) / seconds;
+        m_rateTimer.restart();
+        m_rateCaptured = stats.queue.captured;
+        m_rateEncoded = stats.queue.encoded;
+    }
+    stats.fpsIn = m_fpsIn;
+    stats.fpsOut = m_fpsOut;
+    return stats;
 }
 
-void SourceRecorder::videoThreadFunc()
+QString SourceRecorder::cpuAllocation() const
 {
-    reconnect();
+    if (!m_cpuLease)
+        return QString();
+    const CpuBudget::Allocation allocation = CpuBudget::instance().allocation(m_cpuLease);
+    const int threads = m_encoderThreads;
+    QString text = threads > 0 ? QString("%1 encoder threads").arg(threads) : QString("Encoder not started");
+    if (threads > 0 && threads != allocation.encoderThreads)
+        text += QString(" (budget now %1)").arg(allocation.encoderThreads);
+    return text;
+}
+
+void SourceRecorder::followCpuBudget(quint32 &generation, bool capture)
+{
+    CpuBudget &budget = CpuBudget::instance();
+    const quint32 current = budget.generation();
+    if (current == generation)
+        return;
+    generation = current;
+    const CpuBudget::Allocation allocation = budget.allocation(m_cpuLease);
+    CpuBudget::pinCurrentThread(capture ? allocation.captureCores : allocation.encoderCores);
+}
+
+void SourceRecorder::followStorage(quint32 &generation)
+{
+    if (!m_storageLease)
+        return;
+    StorageMonitor &monitor = StorageMonitor::instance();
+    const quint32 current = monitor.generation();
+    if (current == generation)
+        return;
+    generation = current;
+    const StorageMonitor::Directive directive = monitor.directive(m_storageLease);
+    m_writer.setBitrateScale(directive.bitrateScale);
+    if (!directive.folder.isEmpty() && directive.folder != m_outputFolder)
+    {
+        m_outputFolder = directive.folder;
+        m_writer.setOutputFolder(directive.folder);
+    }
+    if (directive.stop)
+        haltWithReason("Stopped: low disk space", QString("%1 stopped to free disk space").arg(m_settings.label), true);
+}
+
+void SourceRecorder::followPreRoll(qint64 bufferedMs)
+{
+    if (!m_armed || !m_commitRequested || m_writer.isArmed())
+        return;
+    {
+        QMutexLocker stateLocker(&m_stateMutex);
+        m_timer.restart();
+        m_preRollMs = bufferedMs;
+    }
+    m_recordingStarted = true;
+    m_armed = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_status = "Recording";
+    }
+    emit recordingStarted(m_writer.currentFile());
+}
+
+void SourceRecorder::haltWithReason(const QString &status, const QString &error, bool storage)
+{
+    if (!m_stopReason.isEmpty())
+        return;
+    m_stopReason = status;
+    m_stoppedForStorage = storage;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_status = status;
+    }
+    emit errorOccurred(error);
+    QMetaObject::invokeMethod(this, [this]() { stop(); }, Qt::QueuedConnection);
+}
+
+void SourceRecorder::releaseFrame(CapturedFrame &frame)
+{
+    if (frame.video.buffer)
+        m_source->releaseVideo(frame.video);
+}
+
+AVBufferRef *SourceRecorder::wrapFrame(CapturedFrame &captured)
+{
+    int slot = -1;
+    if (!m_freeFrameRefs.tryPop(slot))
+        return nullptr;
+    FrameRef &ref = m_frameRefs[slot];
+    ref.source = m_source.get();
+    ref.video = captured.video;
+    AVBufferRef *buf = nullptr;
+    {
+        AllocationTrace::ForeignScope ffmpeg;
+        buf = av_buffer_create(captured.video.buffer, captured.video.bufferSize, &SourceRecorder::freeWrappedFrame, &ref,
+                               AV_BUFFER_FLAG_READONLY);
+    }
+    if (!buf)
+    {
+        ref.video = VideoFrame();
+        m_freeFrameRefs.tryPush(slot);
+        return nullptr;
+    }
+    captured.video.buffer = nullptr;
+    return buf;
+}
+
+void SourceRecorder::freeWrappedFrame(void *opaque, uint8_t *)
+{
+    FrameRef *ref = static_cast<FrameRef *>(opaque);
+    ref->source->releaseVideo(ref->video);
+    int slot = ref->index;
+    ref->owner->m_freeFrameRefs.tryPush(slot);
+}
+
+bool SourceRecorder::openSource()
+{
+    if (m_source->open())
+        return true;
+    Logger::instance().log(LogLevel::Error, "Failed to open source " + m_settings.ndiSource);
+    emit errorOccurred("Source failed to open");
+    m_running = false;
+    m_status = "Error";
+    return false;
+}
+
+void SourceRecorder::captureThreadFunc()
+{
+    if (!openSource())
+        return;
 
-    NDIlib_video_frame_v2_t videoFrame;
-    NDIlib_audio_frame_v3_t audioFrame;
     int timeoutStreak = 0;
+    bool resumed = false;
+    bool ended = false;
+    qint64 lastVideoTimestamp = AV_NOPTS_VALUE;
+    // Paused time and backward jumps of the sender clock, taken out of every timestamp.
+    qint64 removedTicks = 0;
+    quint32 cpuGeneration = 0;
 
     while (m_running)
     {
+        followCpuBudget(cpuGeneration, true);
         if (m_paused)
         {
+            resumed = true;
             QThread::msleep(20);
             continue;
         }
-        switch (NDIlib_recv_capture_v3(m_recv, &videoFrame, &audioFrame, nullptr, 500))
+        CapturedFrame captured;
+        CapturedAudio audio;
+        const qint64 captureStart = LatencyHistogram::now();
+        switch (m_source->capture(captured.video, audio.audio, 500))
         {
-        case NDIlib_frame_type_video:
+        case FrameType::Video:
         {
-            // Update preview
-            const bool shouldUpdatePreview = !m_previewThrottle.isValid() || m_previewThrottle.elapsed() >= 200;
-            if (shouldUpdatePreview)
+            const qint64 receivedNs = LatencyHistogram::now();
+            m_lastFrameNs = receivedNs;
+            m_captureTime.record(receivedNs - captureStart);
+            const VideoFrame &videoFrame = captured.video;
+            const qint64 timestamp = videoFrame.timestamp;
+            const qint64 frameTicks =
+                videoFrame.frameRateNum > 0 ? static_cast<qint64>(10000000) * videoFrame.frameRateDen / videoFrame.frameRateNum : 0;
+            if (lastVideoTimestamp != AV_NOPTS_VALUE)
             {
-                QImage img((uchar *)videoFrame.p_data, videoFrame.xres, videoFrame.yres, QImage::Format_RGBA8888);
+                const qint64 delta = timestamp - lastVideoTimestamp;
+                if (resumed)
                 {
-                    QMutexLocker locker(&m_mutex);
-                    m_preview = img.copy();
-                    m_status = "Recording";
+                    // Paused time is cut out so the file resumes one frame after the pause.
+                    removedTicks += std::max<qint64>(0, delta - frameTicks);
+                }
+                else if (delta == 0)
+                {
+                    // The sender repeated a frame; the writer fills time itself.
+                    ++m_repeatedTimestamps;
+                    m_source->releaseVideo(captured.video);
+                    break;
                 }
-                emit previewUpdated();
+                else if (delta < -frameTicks || delta > MaxTimestampGapTicks)
+                {
+                    // Sender restarted or its clock stepped (back, or further forward
+                    // than any real gap): continue one frame on. Smaller backward
+                    // steps are jitter and left to the writer.
+                    removedTicks += delta - frameTicks;
+                    Logger::instance().log(m_clockStepLog, LogLevel::Warning,
+                                           QString("Source clock for %1 jumped %2 %3 ms; continuing from the previous frame")
+                                               .arg(m_settings.label, delta < 0 ? QString("back") : QString("forward"))
+                                               .arg(std::abs(delta) / 10000));
+                }
+                else if (frameTicks > 0 && delta * 2 > frameTicks * 3)
+                {
+                    // More than one and a half intervals: frames were lost upstream.
+                    // The writer repeats the last picture (CFR) or keeps the gap (VFR).
+                    const qint64 missing = (delta + frameTicks / 2) / frameTicks - 1;
+                    ++m_timestampGaps;
+                    m_framesMissing += static_cast<quint64>(missing);
+                    Logger::instance().log(m_gapLog, LogLevel::Warning,
+                                           QString("Timestamp gap for %1: %2 ms since the previous frame, %3 frames missing")
+                                               .arg(m_settings.label)
+                                               .arg(delta / 10000)
+                                               .arg(missing));
+                }
+            }
+            resumed = false;
+            lastVideoTimestamp = timestamp;
+            captured.timestamp = timestamp - removedTicks;
+            const int previewFps = m_settings.previewFps;
+            if (m_previewEnabled && previewFps > 0 && (!m_previewThrottle.isValid() || m_previewThrottle.elapsed() >= 1000 / previewFps))
+            {
+                updatePreview(videoFrame);
                 m_previewThrottle.restart();
             }
-            else
             {
                 QMutexLocker locker(&m_mutex);
-                m_status = "Recording";
+                // Literals, so the per-frame update does not allocate.
+                m_status = m_armed ? QStringLiteral("Armed") : QStringLiteral("Recording");
             }
 
-            if (!m_recordingStarted)
+            // While armed the clock starts with the commit instead.
+            if (!m_recordingStarted && !m_armed)
             {
                 m_timer.restart();
                 m_recordingStarted = true;
             }
             timeoutStreak = 0;
 
-            // Prepare FFmpeg writer if needed
-            if (m_writer.currentFile().isEmpty())
-            {
-                RecordingConfig cfg;
-                cfg.outputFolder = m_settings.outputFolder;
-                cfg.sourceLabel = m_settings.label;
-                cfg.segmented = m_settings.segmented;
-                cfg.segmentMinutes = m_settings.segmentMinutes;
-                cfg.width = videoFrame.xres;
-                cfg.height = videoFrame.yres;
-                const int defaultFps = 60;
-                auto validatedFrameRate = [&](int num, int den) {
-                    struct
-                    {
-                        int fps{};
-                        int num{};
-                        int den{};
-                        bool fromSource{};
-                    } result;
-
-                    if (num > 0 && den > 0)
-                    {
-                        const double fpsValue = static_cast<double>(num) / den;
-                        if (fpsValue >= 1.0 && fpsValue <= 240.0)
-                        {
-                            result.fps = (std::max)(1, static_cast<int>(fpsValue + 0.5));
-                            result.num = num;
-                            result.den = den;
-                            result.fromSource = true;
-                            return result;
-                        }
-                        Logger::instance().log(QString("Ignoring unreasonable NDI frame rate %1/%2 for %3")
-                                                   .arg(num)
-                                                   .arg(den)
-                                                   .arg(m_settings.label));
-                    }
-
-                    result.fps = defaultFps;
-                    result.num = defaultFps;
-                    result.den = 1;
-                    result.fromSource = false;
-                    return result;
-                };
-
-                const auto fpsInfo = validatedFrameRate(videoFrame.frame_rate_N, videoFrame.frame_rate_D);
-                cfg.fps = fpsInfo.fps;
-                cfg.fpsNum = fpsInfo.num;
-                cfg.fpsDen = fpsInfo.den;
-                m_sourceFpsNum = fpsInfo.num;
-                m_sourceFpsDen = fpsInfo.den;
-                m_expectedFrameTicks10ns = (static_cast<qint64>(10000000) * fpsInfo.den) / fpsInfo.num;
-                cfg.inputPixFmt = AV_PIX_FMT_RGBA;
-                cfg.outputPixFmt = AV_PIX_FMT_YUV420P;
-                if (!m_writer.start(cfg))
-                {
-                    m_status = "Error";
-                    emit errorOccurred("Failed to start writer for " + m_settings.label);
-                    m_running = false;
-                    NDIlib_recv_free_video_v2(m_recv, &videoFrame);
-                    break;
-                }
-                m_videoPts = 0;
-                m_expectedPtsStep = std::max<int64_t>(1, av_rescale_q(m_expectedFrameTicks10ns, AVRational{1, 10000000}, m_writer.videoTimeBase()));
-                emit recordingStarted(m_writer.currentFile());
-            }
-
-            AVFrame *frame = av_frame_alloc();
-            frame->format = AV_PIX_FMT_RGBA;
-            frame->width = videoFrame.xres;
-            frame->height = videoFrame.yres;
-            av_image_fill_arrays(frame->data, frame->linesize, videoFrame.p_data, AV_PIX_FMT_RGBA, videoFrame.xres, videoFrame.yres, 1);
-            frame->pts = m_videoPts;
-            m_videoPts += m_expectedPtsStep;
-            m_writer.writeVideoFrame(frame);
-            av_frame_free(&frame);
-
-            NDIlib_recv_free_video_v2(m_recv, &videoFrame);
-            if (m_writer.needsRollover())
+            // Hand the frame to the encode thread; it releases the buffer once written.
+            ++m_framesCaptured;
+            captured.queuedNs = LatencyHistogram::now();
+            m_frameQueue.push(
+                captured, m_settings.overflowPolicy, [this](CapturedFrame &frame) { releaseFrame(frame); },
+                [this]() { return m_running && m_encoding; });
+            break;
+        }
+        case FrameType::Audio:
+        {
+            // After a resume, audio waits for the first video frame to measure the pause.
+            if (resumed || m_settings.audioCodec == AudioCodec::None)
             {
-                m_writer.rollover();
-                m_videoPts = 0;
-                m_expectedPtsStep = std::max<int64_t>(1, av_rescale_q(m_expectedFrameTicks10ns, AVRational{1, 10000000}, m_writer.videoTimeBase()));
+                m_source->releaseAudio(audio.audio);
+                break;
             }
+            audio.timestamp = audio.audio.timestamp - removedTicks;
+            m_audioQueue.push(
+                audio, OverflowPolicy::DropOldest, [this](CapturedAudio &dropped) { m_source->releaseAudio(dropped.audio); },
+                [this]() { return m_running && m_encoding; });
             break;
         }
-        case NDIlib_frame_type_audio:
-            NDIlib_recv_free_audio_v3(m_recv, &audioFrame);
+        case FrameType::EndOfStream:
+            // The file stays open until the recorder is stopped.
+            if (!ended)
+            {
+                Logger::instance().log("Source finished for " + m_settings.label);
+                QMutexLocker locker(&m_mutex);
+                m_status = "Source finished";
+            }
+            ended = true;
             break;
-        case NDIlib_frame_type_none:
-            Logger::instance().log("NDI timeout for " + m_settings.label);
+        case FrameType::None:
+            Logger::instance().log(m_timeoutLog, LogLevel::Warning, "Capture timeout for " + m_settings.label);
             if (!m_recordingStarted && ++timeoutStreak >= 10)
             {
                 m_status = "No signal";
                 emit errorOccurred("No video received from " + m_settings.label);
             }
             break;
-        default:
-            break;
         }
     }
 }
 
+bool SourceRecorder::startWriter(const VideoFrame &videoFrame)
+{
+    RecordingConfig cfg;
+    cfg.outputFolder = m_outputFolder;
+    cfg.sourceLabel = m_settings.label;
+    cfg.segmented = m_settings.segmented;
+    cfg.segmentMinutes = m_settings.segmentMinutes;
+    cfg.width = videoFrame.width;
+    cfg.height = videoFrame.height;
+    const int defaultFps = 60;
+    auto validatedFrameRate = [&](int num, int den) {
+        struct
+        {
+            int fps{};
+            int num{};
+            int den{};
+            bool fromSource{};
+        } result;
+
+        if (num > 0 && den > 0)
+        {
+            const double fpsValue = static_cast<double>(num) / den;
+            if (fpsValue >= 1.0 && fpsValue <= 240.0)
+            {
+                result.fps = (std::max)(1, static_cast<int>(fpsValue + 0.5));
+                result.num = num;
+                result.den = den;
+                result.fromSource = true;
+                return result;
+            }
+            Logger::instance().log(LogLevel::Warning, QString("Ignoring unreasonable frame rate %1/%2 for %3")
+                                       .arg(num)
+                                       .arg(den)
+                                       .arg(m_settings.label));
+        }
+
+        result.fps = defaultFps;
+        result.num = defaultFps;
+        result.den = 1;
+        result.fromSource = false;
+        return result;
+    };
+
+    const auto fpsInfo = validatedFrameRate(videoFrame.frameRateNum, videoFrame.frameRateDen);
+    cfg.fps = fpsInfo.fps;
+    cfg.fpsNum = fpsInfo.num;
+    cfg.fpsDen = fpsInfo.den;
+    cfg.inputPixFmt = videoFrame.format;
+    cfg.outputPixFmt = AV_PIX_FMT_YUV420P;
+    cfg.constantFrameRate = m_settings.constantFrameRate;
+    cfg.conversionSlices = m_settings.conversionSlices;
+    cfg.audioCodec = m_settings.audioCodec;
+    cfg.container = m_settings.container;
+    cfg.fragmentSeconds = m_settings.fragmentSeconds;
+    cfg.encoder = m_settings.encoder;
+    cfg.discardOutput = m_settings.discardOutput;
+    cfg.preRollSeconds = m_armed ? m_settings.preRollSeconds : 0;
+    cfg.replaySeconds = m_settings.replaySeconds;
+    cfg.ringMaxMb = m_settings.ringMaxMb;
+    cfg.renditions = m_settings.renditions;
+    // An explicit thread count in the profile wins over the shared budget.
+    if (cfg.encoder.threads <= 0)
+        cfg.encoder.threads = CpuBudget::instance().allocation(m_cpuLease).encoderThreads;
+    m_encoderThreads = cfg.encoder.threads;
+    if (!m_writer.start(cfg))
+    {
+        m_status = "Error";
+        emit errorOccurred("Failed to start writer for " + m_settings.label);
+        m_running = false;
+        return false;
+    }
+    if (!m_armed)
+        emit recordingStarted(m_writer.currentFile());
+    return true;
+}
+
+void SourceRecorder::encodeThreadFunc()
+{
+    bool writerStarted = false;
+    bool writerFailed = false;
+    bool warnedFormat = false;
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+    {
+        Logger::instance().log(LogLevel::Error, "Failed to allocate frame for " + m_settings.label);
+        return;
+    }
+
+    // x264 starts its worker threads from here, so they inherit this pinning
+    // where the platform passes affinity on to new threads.
+    quint32 cpuGeneration = 0;
+    quint32 storageGeneration = 0;
+    for (;;)
+    {
+        followCpuBudget(cpuGeneration, false);
+        followStorage(storageGeneration);
+        const quint32 seen = m_frameQueue.pushEvents();
+        CapturedFrame captured;
+        if (!m_frameQueue.tryPop(captured))
+        {
+            if (!m_encoding)
+                break;
+            m_frameQueue.waitPushEvent(seen);
+            continue;
+        }
+        m_queueTime.recordSince(captured.queuedNs);
+
+        const VideoFrame &videoFrame = captured.video;
+        if (!writerStarted && !writerFailed)
+        {
+            writerStarted = startWriter(videoFrame);
+            writerFailed = !writerStarted;
+        }
+
+        if (writerStarted)
+        {
+            if (videoFrame.format == AV_PIX_FMT_NONE)
+            {
+                if (!warnedFormat)
+                    Logger::instance().log(LogLevel::Warning, "Unsupported video format from " + m_settings.label);
+                warnedFormat = true;
+                releaseFrame(captured);
+                continue;
+            }
+            frame->format = videoFrame.format;
+            frame->width = videoFrame.width;
+            frame->height = videoFrame.height;
+            for (int i = 0; i < 4; ++i)
+            {
+                frame->data[i] = videoFrame.data[i];
+                frame->linesize[i] = videoFrame.linesize[i];
+            }
+            frame->pts = captured.timestamp;
+            // A frame the encoder takes as-is is handed over by reference and
+            // returned to the source when the last reference (ours or the
+            // encoder's) drops. Any other is converted into the writer's own
+            // picture before writeVideoFrame returns, so it needs no reference
+            // and goes back to the source below.
+            if (m_writer.passesThrough(videoFrame.format, videoFrame.width, videoFrame.height))
+                frame->buf[0] = wrapFrame(captured);
+            const qint64 bufferedMs = m_armed ? m_writer.ringStats().durationMs : 0;
+            if (m_writer.writeVideoFrame(frame))
+            {
+                ++m_framesEncoded;
+                followPreRoll(bufferedMs);
+            }
+            else if (m_commitRequested && m_writer.isArmed())
+            {
+                haltWithReason("Error", "Failed to open the recording for " + m_settings.label);
+                writerStarted = false;
+                writerFailed = true;
+            }
+            else if (m_writer.outputFailed())
+            {
+                // Nothing more can be written; the frames still queued are released unencoded.
+                Logger::instance().log(LogLevel::Error, QString("Writing %1 failed; stopping %2").arg(m_writer.currentFile(), m_settings.label));
+                haltWithReason("Disk write failed", "Writing to disk failed for " + m_settings.label, true);
+                writerStarted = false;
+                writerFailed = true;
+            }
+            av_frame_unref(frame);
+        }
+        releaseFrame(captured);
+    }
+    av_frame_free(&frame);
+}
+
+void SourceRecorder::audioThreadFunc()
+{
+    // Resampling and encoding audio happen here so neither the capture nor the
+    // video encode thread waits on it.
+    QVarLengthArray<const uint8_t *, 16> planes;
+    quint32 cpuGeneration = 0;
+    for (;;)
+    {
+        followCpuBudget(cpuGeneration, true);
+        const quint32 seen = m_audioQueue.pushEvents();
+        CapturedAudio captured;
+        if (!m_audioQueue.tryPop(captured))
+        {
+            if (!m_encoding)
+                break;
+            m_audioQueue.waitPushEvent(seen);
+            continue;
+        }
+
+        const AudioFrame &audio = captured.audio;
+        if (audio.data)
+        {
+            planes.resize(audio.channels);
+            for (int c = 0; c < audio.channels; ++c)
+                planes[c] = audio.data + static_cast<ptrdiff_t>(c) * audio.channelStride;
+            m_writer.writeAudio(planes.constData(), audio.channels, audio.samples, audio.sampleRate, captured.timestamp);
+        }
+        m_source->releaseAudio(captured.audio);
+    }
+}
@@ -1,6 +1,8 @@
 #include "SourceSettingsDialog.h"
 #include "ui_SourceSettingsDialog.h"
 #include <QFileDialog>
+#include <QSignalBlocker>
+#include <algorithm>
 
 SourceSettingsDialog::SourceSettingsDialog(QWidget *parent)
     : QDialog(parent), ui(new Ui::SourceSettingsDialog)
@@ -13,6 +15,19 @@ SourceSettingsDialog::SourceSettingsDialog(QWidget *parent)
         if (!dir.isEmpty())
             ui->folderEdit->setText(dir);
     });
+
+    for (const EncoderProfile &profile : EncoderProfile::presets())
+        ui->profileCombo->addItem(profile.name);
+    ui->profileCombo->addItem(tr("Custom"));
+    ui->presetCombo->addItems(EncoderProfile::x264Presets());
+    for (const QString &tune : EncoderProfile::x264Tunes())
+        ui->tuneCombo->addItem(tune.isEmpty() ? tr("No tune") : tune, tune);
+    connect(ui->profileCombo, &QComboBox::currentIndexChanged, this, [this]() {
+        if (ui->profileCombo->currentIndex() < ui->profileCombo->count() - 1)
+            showEncoderProfile(EncoderProfile::named(ui->profileCombo->currentText()));
+    });
+    connect(ui->rateControlCombo, &QComboBox::currentIndexChanged, this, &SourceSettingsDialog::updateRateControlFields);
+    connect(ui->containerCombo, &QComboBox::currentIndexChanged, this, &SourceSettingsDialog::updateContainerFields);
 }
 
 SourceSettingsDialog::~SourceSettingsDialog()
@@ -31,6 +46,23 @@ void SourceSettingsDialog::setSettings(const SourceSettings &settings)
     ui->segmentSpin->setValue(settings.segmentMinutes);
     ui->modeSegmented->setChecked(settings.segmented);
     ui->modeContinuous->setChecked(!settings.segmented);
+    ui->queueDepthSpin->setValue(settings.queueDepth);
+    ui->overflowCombo->setCurrentIndex(static_cast<int>(settings.overflowPolicy));
+    ui->cfrCheck->setChecked(settings.constantFrameRate);
+    ui->colorFormatCombo->setCurrentIndex(static_cast<int>(settings.colorFormat));
+    ui->slicesSpin->setValue(settings.conversionSlices);
+    ui->audioCombo->setCurrentIndex(static_cast<int>(settings.audioCodec));
+    ui->previewFpsSpin->setValue(settings.previewFps);
+    ui->prioritySpin->setValue(settings.priority);
+    ui->preRollSpin->setValue(settings.preRollSeconds);
+    ui->replaySpin->setValue(settings.replaySeconds);
+    ui->ringMbSpin->setValue(settings.ringMaxMb);
+    ui->proxyHeightSpin->setValue(settings.renditions.isEmpty() ? 0 : settings.renditions.first().height);
+    ui->proxyBitrateSpin->setValue(settings.renditions.isEmpty() ? 0 : settings.renditions.first().bitrateKbps);
+    ui->containerCombo->setCurrentIndex(static_cast<int>(settings.container));
+    ui->fragmentSpin->setValue(settings.fragmentSeconds);
+    updateContainerFields();
+    showEncoderProfile(settings.encoder);
 }
 
 SourceSettings SourceSettingsDialog::settings() const
@@ -41,9 +73,78 @@ SourceSettings SourceSettingsDialog::settings() const
     s.label = ui->labelEdit->text();
     s.segmentMinutes = ui->segmentSpin->value();
     s.segmented = ui->modeSegmented->isChecked();
+    s.queueDepth = ui->queueDepthSpin->value();
+    s.overflowPolicy = static_cast<OverflowPolicy>(ui->overflowCombo->currentIndex());
+    s.constantFrameRate = ui->cfrCheck->isChecked();
+    s.colorFormat = static_cast<NdiColorFormat>(ui->colorFormatCombo->currentIndex());
+    s.conversionSlices = ui->slicesSpin->value();
+    s.audioCodec = static_cast<AudioCodec>(ui->audioCombo->currentIndex());
+    s.previewFps = ui->previewFpsSpin->value();
+    s.priority = ui->prioritySpin->value();
+    s.preRollSeconds = ui->preRollSpin->value();
+    s.replaySeconds = ui->replaySpin->value();
+    s.ringMaxMb = ui->ringMbSpin->value();
+    if (ui->proxyHeightSpin->value() > 0)
+    {
+        RenditionConfig proxy;
+        proxy.height = ui->proxyHeightSpin->value();
+        proxy.bitrateKbps = ui->proxyBitrateSpin->value();
+        s.renditions.append(proxy);
+    }
+    s.container = static_cast<ContainerMode>(ui->containerCombo->currentIndex());
+    s.fragmentSeconds = ui->fragmentSpin->value();
+    s.encoder = encoderProfile();
     return s;
 }
 
+void SourceSettingsDialog::showEncoderProfile(const EncoderProfile &profile)
+{
+    const QSignalBlocker blocker(ui->profileCombo);
+    const int named = ui->profileCombo->findText(profile.name);
+    const bool isPreset = named >= 0 && profile.sameSettings(EncoderProfile::named(profile.name));
+    ui->profileCombo->setCurrentIndex(isPreset ? named : ui->profileCombo->count() - 1);
+    ui->presetCombo->setCurrentText(profile.preset);
+    ui->tuneCombo->setCurrentIndex(std::max(0, ui->tuneCombo->findData(profile.tune)));
+    ui->rateControlCombo->setCurrentIndex(static_cast<int>(profile.rateControl));
+    ui->crfSpin->setValue(profile.crf);
+    ui->bitrateSpin->setValue(profile.bitrateKbps);
+    ui->gopSpin->setValue(profile.gopSeconds);
+    ui->bFramesSpin->setValue(profile.bFrames);
+    ui->threadsSpin->setValue(profile.threads);
+    ui->threadingCombo->setCurrentIndex(static_cast<int>(profile.threading));
+    updateRateControlFields();
+}
+
+EncoderProfile SourceSettingsDialog::encoderProfile() const
+{
+    EncoderProfile profile;
+    profile.preset = ui->presetCombo->currentText();
+    profile.tune = ui->tuneCombo->currentData().toString();
+    profile.rateControl = static_cast<RateControl>(ui->rateControlCombo->currentIndex());
+    profile.crf = ui->crfSpin->value();
+    profile.bitrateKbps = ui->bitrateSpin->value();
+    profile.gopSeconds = ui->gopSpin->value();
+    profile.bFrames = ui->bFramesSpin->value();
+    profile.threads = ui->threadsSpin->value();
+    profile.threading = static_cast<EncoderThreading>(ui->threadingCombo->currentIndex());
+    // Hand edits that no longer match the selected preset are saved as custom.
+    const EncoderProfile preset = EncoderProfile::named(ui->profileCombo->currentText());
+    profile.name = preset.name == ui->profileCombo->currentText() && profile.sameSettings(preset) ? preset.name : QString("Custom");
+    return profile;
+}
+
+void SourceSettingsDialog::updateRateControlFields()
+{
+    const bool crf = ui->rateControlCombo->currentIndex() == static_cast<int>(RateControl::Crf);
+    ui->crfSpin->setEnabled(crf);
+    ui->bitrateSpin->setEnabled(!crf);
+}
+
+void SourceSettingsDialog::updateContainerFields()
+{
+    ui->fragmentSpin->setEnabled(ui->containerCombo->currentIndex() != static_cast<int>(ContainerMode::Mp4));
+}
+
 void SourceSettingsDialog::refreshNdi()
 {
     ui->ndiCombo->clear();
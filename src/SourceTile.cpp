@@ -2,12 +2,13 @@
 #include "ui_SourceTile.h"
 #include <QDateTime>
 #include <QPixmap>
+#include <QResizeEvent>
 
 SourceTile::SourceTile(QWidget *parent)
     : QWidget(parent), ui(new Ui::SourceTile), m_recorder(nullptr)
 {
     ui->setupUi(this);
-    connect(&m_timer, &QTimer::timeout, this, &SourceTile::updatePreview);
+    connect(&m_timer, &QTimer::timeout, this, &SourceTile::updateStatus);
     m_timer.start(500);
 }
 
@@ -19,20 +20,30 @@ SourceTile::~SourceTile()
 void SourceTile::setRecorder(SourceRecorder *recorder)
 {
     m_recorder = recorder;
+    m_previewSequence = 0;
     if (recorder)
     {
+        recorder->setPreviewSize(ui->previewLabel->contentsRect().width(), ui->previewLabel->contentsRect().height());
         connect(recorder, &SourceRecorder::previewUpdated, this, &SourceTile::updatePreview);
     }
 }
 
+void SourceTile::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if (m_recorder)
+        m_recorder->setPreviewSize(ui->previewLabel->contentsRect().width(), ui->previewLabel->contentsRect().height());
+}
+
 void SourceTile::updatePreview()
 {
-    if (!m_recorder)
+    // Previews arrive already sized for the label; queued signals that find
+    // nothing new return here.
+    if (!m_recorder || !m_recorder->takePreview(m_previewImage, m_previewSequence))
         return;
-    QImage frame = m_recorder->lastFrame();
-    if (!frame.isNull())
+    if (!m_previewImage.isNull())
     {
-        ui->previewLabel->setPixmap(QPixmap::fromImage(frame).scaled(ui->previewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        ui->previewLabel->setPixmap(QPixmap::fromImage(m_previewImage));
         ui->previewLabel->setText(QString());
     }
     else
@@ -40,11 +51,97 @@ void SourceTile::updatePreview()
         ui->previewLabel->clear();
         ui->previewLabel->setText("No preview");
     }
-    ui->statusLabel->setText(m_recorder->status());
-    int secs = m_recorder->elapsedMs() / 1000;
+}
+
+void SourceTile::updateStatus()
+{
+    if (!m_recorder)
+        return;
+    const RecorderStats stats = m_recorder->stats();
+    ui->statusLabel->setText(stats.finalizing ? QString("Finalizing %1%").arg(stats.finalizePercent) : stats.status);
+    updateStats(stats);
+    updateStorage(stats.storage);
+    ui->cpuLabel->setText(m_recorder->cpuAllocation());
+    ui->armButton->setEnabled(!stats.running && !stats.finalizing && m_recorder->settings().preRollSeconds > 0);
+    ui->clipButton->setEnabled(stats.running && !stats.armed && m_recorder->settings().replaySeconds > 0);
+    int secs = stats.elapsedMs / 1000;
     ui->timerLabel->setText(QString("%1:%2").arg(secs / 60, 2, 10, QChar('0')).arg(secs % 60, 2, 10, QChar('0')));
 }
 
+void SourceTile::updateStats(const RecorderStats &stats)
+{
+    if (!stats.running)
+    {
+        ui->statsLabel->clear();
+        ui->statsLabel->setToolTip(QString());
+        return;
+    }
+    QString text = QString("%1 fps, %2 dropped").arg(stats.fpsOut, 0, 'f', 2).arg(stats.droppedTotal());
+    if (stats.queue.duplicated > 0)
+        text += QString(", %1 duplicated").arg(stats.queue.duplicated);
+    if (stats.armed)
+        text += QString(", pre-roll %1 s in %2/%3 MB")
+                    .arg(stats.ring.durationMs / 1000.0, 0, 'f', 1)
+                    .arg(stats.ring.bytes / (1024.0 * 1024.0), 0, 'f', 0)
+                    .arg(stats.ring.maxBytes / (1024 * 1024));
+    ui->statsLabel->setText(text);
+
+    auto stage = [](const char *name, const LatencyHistogram::Snapshot &snapshot) {
+        return QString("%1: p50 %2 ms, p99 %3 ms")
+            .arg(name)
+            .arg(snapshot.percentileNs(0.50) / 1e6, 0, 'f', 2)
+            .arg(snapshot.percentileNs(0.99) / 1e6, 0, 'f', 2);
+    };
+    QStringList lines;
+    lines << QString("Received %1, encoded %2").arg(stats.queue.captured).arg(stats.queue.encoded);
+    lines << QString("Dropped: queue %1, late %2, source %3")
+                 .arg(stats.queue.droppedOldest + stats.queue.droppedNewest)
+                 .arg(stats.queue.droppedLate)
+                 .arg(stats.source.dropped);
+    lines << QString("Source gaps: %1 (%2 frames missing), repeated timestamps %3")
+                 .arg(stats.queue.timestampGaps)
+                 .arg(stats.queue.framesMissing)
+                 .arg(stats.queue.repeatedTimestamps);
+    lines << QString("Queued: %1/%2, at source %3").arg(stats.queue.queued).arg(stats.queue.depth).arg(stats.source.queuedVideo);
+    lines << stage("Capture", stats.latency.capture) << stage("Queue", stats.latency.queue) << stage("Convert", stats.latency.convert)
+          << stage("Encode", stats.latency.encode) << stage("Mux", stats.latency.mux);
+    lines << QString("%1, %2 buffer stalls").arg(stage("Disk write", stats.disk.writeTime)).arg(stats.disk.stalls);
+    if (!stats.armed && stats.ring.maxBytes > 0)
+        lines << QString("Replay: %1 s in %2/%3 MB")
+                     .arg(stats.ring.durationMs / 1000.0, 0, 'f', 1)
+                     .arg(stats.ring.bytes / (1024.0 * 1024.0), 0, 'f', 0)
+                     .arg(stats.ring.maxBytes / (1024 * 1024));
+    ui->statsLabel->setToolTip(lines.join('\n'));
+}
+
+void SourceTile::updateStorage(const StorageStatus &storage)
+{
+    if (storage.volume.isEmpty())
+    {
+        ui->storageLabel->clear();
+        ui->storageLabel->setToolTip(QString());
+        return;
+    }
+    QString text = QString("Disk: %1 GB free").arg(storage.freeBytes / 1e9, 0, 'f', 0);
+    if (storage.secondsToFull >= 0)
+        text += QString(", %1 h %2 min left").arg(storage.secondsToFull / 3600).arg(storage.secondsToFull / 60 % 60);
+    if (storage.level != StorageLevel::Ok)
+        text += QString(" (%1)").arg(StorageMonitor::levelName(storage.level));
+    if (!storage.action.isEmpty())
+        text += " - " + storage.action;
+    ui->storageLabel->setText(text);
+    ui->storageLabel->setToolTip(QString("%1 on %2\nIncoming %3 MB/s, disk writes at %4 MB/s")
+                                     .arg(storage.folder, storage.volume)
+                                     .arg(storage.incomingBytesPerSec / 1e6, 0, 'f', 1)
+                                     .arg(storage.diskBytesPerSec / 1e6, 0, 'f', 1));
+}
+
+void SourceTile::on_armButton_clicked()
+{
+    if (m_recorder)
+        m_recorder->arm();
+}
+
 void SourceTile::on_startButton_clicked()
 {
     if (m_recorder)
@@ -67,6 +164,12 @@ void SourceTile::on_pauseButton_clicked()
         m_recorder->pause();
 }
 
+void SourceTile::on_clipButton_clicked()
+{
+    if (m_recorder)
+        m_recorder->exportClip(m_recorder->settings().replaySeconds);
+}
+
 void SourceTile::on_settingsButton_clicked()
 {
     emit settingsRequested(m_recorder);
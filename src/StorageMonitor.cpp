@@ -0,0 +1,360 @@
+#include "StorageMonitor.h"
+#include <QMutexLocker>
+#include <QStorageInfo>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+QString describeRate(double bytesPerSec)
+{
+    return QString("%1 MB/s").arg(bytesPerSec / 1e6, 0, 'f', 1);
+}
+} // namespace
+
+StorageMonitor &StorageMonitor::instance()
+{
+    static StorageMonitor inst;
+    return inst;
+}
+
+StorageMonitor::~StorageMonitor()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+void StorageMonitor::setOptions(const StorageOptions &options)
+{
+    QMutexLocker locker(&m_mutex);
+    m_options = options;
+}
+
+StorageOptions StorageMonitor::options() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_options;
+}
+
+int StorageMonitor::acquire(const QString &label, const QString &folder, int priority, std::function<DiskWriteStats()> probe)
+{
+    QMutexLocker locker(&m_mutex);
+    const int id = m_nextId++;
+    Lease lease;
+    lease.label = label;
+    lease.folder = folder;
+    lease.priority = priority;
+    lease.probe = std::move(probe);
+    m_leases.insert(id, lease);
+    // New leases read their (default) directive on the next poll.
+    m_generation.fetch_add(1, std::memory_order_release);
+    if (!m_thread)
+    {
+        m_thread = QThread::create([this]() { threadFunc(); });
+        m_thread->start(QThread::LowPriority);
+    }
+    return id;
+}
+
+void StorageMonitor::release(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_leases.remove(id);
+}
+
+StorageMonitor::Directive StorageMonitor::directive(int id) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_leases.value(id).directive;
+}
+
+StorageStatus StorageMonitor::status(int id) const
+{
+    QMutexLocker locker(&m_mutex);
+    StorageStatus status;
+    const auto it = m_leases.constFind(id);
+    if (it == m_leases.constEnd())
+        return status;
+    const Lease &lease = it.value();
+    status.folder = currentFolder(lease);
+    status.bitrateScale = lease.directive.bitrateScale;
+    status.action = lease.action;
+    status.volume = lease.volume;
+    const auto volume = m_volumes.constFind(lease.volume);
+    if (volume != m_volumes.constEnd())
+    {
+        status.level = volume->level;
+        status.freeBytes = volume->freeBytes;
+        status.incomingBytesPerSec = volume->incomingBytesPerSec;
+        status.diskBytesPerSec = volume->diskBytesPerSec;
+        status.secondsToFull = volume->secondsToFull;
+    }
+    return status;
+}
+
+bool StorageMonitor::canStart(const QString &folder, QString &reason) const
+{
+    // A folder that does not exist yet is created by the writer; nothing to check.
+    const QStorageInfo info(folder);
+    if (!info.isValid() || !info.isReady())
+        return true;
+    const StorageOptions current = options();
+    if (info.bytesAvailable() <= current.minFreeBytes)
+    {
+        reason = QString("Only %1 GB free on %2").arg(info.bytesAvailable() / 1e9, 0, 'f', 1).arg(info.rootPath());
+        return false;
+    }
+    if (current.policy != StoragePolicy::StopLowest)
+        return true;
+    // Whatever was stopped stays stopped until the volume is out of the low
+    // range. Nothing may be writing to it any more, so that is judged from
+    // the live free space at the rate it was last written.
+    QMutexLocker locker(&m_mutex);
+    const auto volume = m_volumes.constFind(info.rootPath());
+    if (volume == m_volumes.constEnd() || volume->level == StorageLevel::Ok || volume->incomingBytesPerSec < 1.0)
+        return true;
+    const qint64 room = info.bytesAvailable() - current.minFreeBytes;
+    if (room / volume->incomingBytesPerSec >= current.warnMinutes * 60)
+        return true;
+    reason = QString("%1 is low on space").arg(info.rootPath());
+    return false;
+}
+
+QString StorageMonitor::levelName(StorageLevel level)
+{
+    switch (level)
+    {
+    case StorageLevel::Ok:
+        return "ok";
+    case StorageLevel::Low:
+        return "low";
+    case StorageLevel::Critical:
+        return "critical";
+    }
+    return "ok";
+}
+
+QString StorageMonitor::currentFolder(const Lease &lease) const
+{
+    return lease.directive.folder.isEmpty() ? lease.folder : lease.directive.folder;
+}
+
+void StorageMonitor::threadFunc()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping)
+    {
+        m_wake.wait(&m_mutex, IntervalMs);
+        if (m_stopping || m_leases.isEmpty())
+            continue;
+        locker.unlock();
+        check();
+        locker.relock();
+    }
+}
+
+void StorageMonitor::check()
+{
+    QStringList folders;
+    StorageOptions options;
+    {
+        QMutexLocker locker(&m_mutex);
+        options = m_options;
+        for (const Lease &lease : m_leases)
+            folders.append(currentFolder(lease));
+    }
+    if (!options.fallbackFolder.isEmpty())
+        folders.append(options.fallbackFolder);
+    folders.removeDuplicates();
+
+    // Volume queries can block on network shares, so they run unlocked.
+    QMap<QString, qint64> freeByFolder;
+    QMap<QString, QString> volumeByFolder;
+    for (const QString &folder : folders)
+    {
+        const QStorageInfo info(folder);
+        if (!info.isValid() || !info.isReady())
+            continue;
+        volumeByFolder.insert(folder, info.rootPath());
+        freeByFolder.insert(folder, info.bytesAvailable());
+    }
+
+    QMutexLocker locker(&m_mutex);
+    const qint64 now = LatencyHistogram::now();
+    QMap<QString, Volume> volumes;
+    QMap<QString, quint64> bytesByVolume;
+    QMap<QString, qint64> writeNsByVolume;
+    QMap<QString, quint64> stallsByVolume;
+    for (Lease &lease : m_leases)
+    {
+        const QString folder = currentFolder(lease);
+        lease.volume = volumeByFolder.value(folder);
+        if (lease.volume.isEmpty())
+            continue;
+        Volume &volume = volumes[lease.volume];
+        volume.freeBytes = freeByFolder.value(folder);
+        const DiskWriteStats disk = lease.probe();
+        // The writer's counters restart with each recording; skip that interval.
+        if (lease.sampled && now > lease.lastSampleNs && disk.bytes >= lease.lastBytes)
+        {
+            const double seconds = (now - lease.lastSampleNs) / 1e9;
+            volume.incomingBytesPerSec += (disk.bytes - lease.lastBytes) / seconds;
+            bytesByVolume[lease.volume] += disk.bytes - lease.lastBytes;
+            writeNsByVolume[lease.volume] += disk.writeTime.totalNs - lease.lastWriteNs;
+            stallsByVolume[lease.volume] += disk.stalls - lease.lastStalls;
+        }
+        lease.lastBytes = disk.bytes;
+        lease.lastWriteNs = disk.writeTime.totalNs;
+        lease.lastStalls = disk.stalls;
+        lease.lastSampleNs = now;
+        lease.sampled = true;
+    }
+
+    for (auto it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        const QString &name = it.key();
+        Volume &volume = it.value();
+        const Volume previous = m_volumes.value(name);
+        volume.lastActionNs = previous.lastActionNs;
+        const qint64 writeNs = writeNsByVolume.value(name);
+        volume.diskBytesPerSec = writeNs > 0 ? bytesByVolume.value(name) * 1e9 / writeNs : previous.diskBytesPerSec;
+        const qint64 room = std::max<qint64>(0, volume.freeBytes - options.minFreeBytes);
+        volume.secondsToFull = volume.incomingBytesPerSec >= 1.0 ? static_cast<qint64>(room / volume.incomingBytesPerSec) : -1;
+        const bool stalling = stallsByVolume.value(name) > 0;
+
+        if (room == 0 || stalling || (volume.secondsToFull >= 0 && volume.secondsToFull < options.actMinutes * 60))
+            volume.level = StorageLevel::Critical;
+        else if (volume.secondsToFull >= 0 && volume.secondsToFull < options.warnMinutes * 60)
+            volume.level = StorageLevel::Low;
+        else
+            volume.level = StorageLevel::Ok;
+
+        if (volume.level != previous.level)
+        {
+            const QString state = QString("%1 GB free, %2 incoming, about %3 min to full")
+                                      .arg(volume.freeBytes / 1e9, 0, 'f', 1)
+                                      .arg(describeRate(volume.incomingBytesPerSec))
+                                      .arg(volume.secondsToFull >= 0 ? QString::number(volume.secondsToFull / 60) : QString("-"));
+            if (volume.level == StorageLevel::Ok)
+                Logger::instance().log(QString("Output volume %1 back to normal: %2").arg(name, state));
+            else if (volume.level == StorageLevel::Low)
+                Logger::instance().log(LogLevel::Warning, QString("Output volume %1 is filling up: %2").arg(name, state));
+            else
+                Logger::instance().log(LogLevel::Error, QString("Output volume %1 is %2: %3")
+                                                            .arg(name, stalling ? QString("not keeping up with the writes") : QString("almost full"), state));
+        }
+
+        if (volume.level == StorageLevel::Critical)
+        {
+            applyPolicy(name, volume, options, freeByFolder, volumeByFolder);
+        }
+        else if (volume.level == StorageLevel::Ok && options.policy == StoragePolicy::LowerBitrate)
+        {
+            bool restored = false;
+            for (Lease &lease : m_leases)
+            {
+                if (lease.volume != name || lease.directive.bitrateScale >= 1.0)
+                    continue;
+                lease.directive.bitrateScale = 1.0;
+                lease.action = "Bitrate restored";
+                restored = true;
+                Logger::instance().log(QString("Bitrate for %1 restored").arg(lease.label));
+            }
+            if (restored)
+                m_generation.fetch_add(1, std::memory_order_release);
+        }
+    }
+    // A volume left without recorders keeps its last state for canStart(),
+    // which re-evaluates it from the live free space.
+    for (auto it = m_volumes.constBegin(); it != m_volumes.constEnd(); ++it)
+    {
+        if (it->level != StorageLevel::Ok && !volumes.contains(it.key()))
+            volumes.insert(it.key(), it.value());
+    }
+    m_volumes = volumes;
+}
+
+void StorageMonitor::applyPolicy(const QString &volume, Volume &state, const StorageOptions &options,
+                                 const QMap<QString, qint64> &freeByFolder, const QMap<QString, QString> &volumeByFolder)
+{
+    const qint64 now = LatencyHistogram::now();
+    if (state.lastActionNs != 0 && now - state.lastActionNs < static_cast<qint64>(ActionHoldMs) * 1000000)
+        return;
+
+    bool changed = false;
+    switch (options.policy)
+    {
+    case StoragePolicy::Warn:
+        break;
+    case StoragePolicy::LowerBitrate:
+        for (Lease &lease : m_leases)
+        {
+            if (lease.volume != volume || lease.directive.bitrateScale <= MinBitrateScale)
+                continue;
+            lease.directive.bitrateScale = std::max(MinBitrateScale, lease.directive.bitrateScale * BitrateStep);
+            const int percent = static_cast<int>(std::lround(lease.directive.bitrateScale * 100));
+            lease.action = QString("Bitrate lowered to %1%").arg(percent);
+            changed = true;
+            Logger::instance().log(LogLevel::Warning, QString("Lowering bitrate for %1 to %2% to save space on %3").arg(lease.label).arg(percent).arg(volume));
+        }
+        break;
+    case StoragePolicy::Fallback:
+    {
+        const QString &fallback = options.fallbackFolder;
+        const QString fallbackVolume = volumeByFolder.value(fallback);
+        if (fallback.isEmpty() || fallbackVolume.isEmpty() || fallbackVolume == volume ||
+            freeByFolder.value(fallback) <= options.minFreeBytes)
+        {
+            Logger::instance().log(m_fallbackLog, LogLevel::Error,
+                                   QString("Fallback folder \"%1\" is not usable; recordings stay on %2").arg(fallback, volume));
+            break;
+        }
+        for (Lease &lease : m_leases)
+        {
+            if (lease.volume != volume || lease.directive.folder == fallback)
+                continue;
+            lease.directive.folder = fallback;
+            lease.action = "Moved to fallback folder";
+            changed = true;
+            Logger::instance().log(LogLevel::Warning, QString("Moving %1 to fallback folder %2").arg(lease.label, fallback));
+        }
+        break;
+    }
+    case StoragePolicy::StopLowest:
+    {
+        // Lowest priority first; among equals the most recently started.
+        Lease *victim = nullptr;
+        for (Lease &lease : m_leases)
+        {
+            if (lease.volume != volume || lease.directive.stop)
+                continue;
+            if (!victim || lease.priority <= victim->priority)
+                victim = &lease;
+        }
+        if (victim)
+        {
+            victim->directive.stop = true;
+            victim->action = "Stopped to free disk space";
+            changed = true;
+            Logger::instance().log(LogLevel::Warning,
+                                   QString("Stopping %1 (priority %2) to save space on %3").arg(victim->label).arg(victim->priority).arg(volume));
+        }
+        break;
+    }
+    }
+    if (changed)
+    {
+        state.lastActionNs = now;
+        m_generation.fetch_add(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,183 @@
+#include "SyntheticFrameSource.h"
+#include "Logging.h"
+#include <algorithm>
+#include <cstring>
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+}
+
+namespace
+{
+struct Rgb
+{
+    int r, g, b;
+};
+
+// 75% colour bars.
+const Rgb Bars[] = {{191, 191, 191}, {191, 191, 0}, {0, 191, 191}, {0, 191, 0}, {191, 0, 191}, {191, 0, 0}, {0, 0, 191}, {0, 0, 0}};
+
+// BT.709 limited range.
+void toYuv(int r, int g, int b, uint8_t &y, uint8_t &u, uint8_t &v)
+{
+    y = static_cast<uint8_t>(16 + ((47 * r + 157 * g + 16 * b + 128) >> 8));
+    u = static_cast<uint8_t>(128 + ((-26 * r - 87 * g + 112 * b + 128) >> 8));
+    v = static_cast<uint8_t>(128 + ((112 * r - 102 * g - 10 * b + 128) >> 8));
+}
+} // namespace
+
+SyntheticFrameSource::SyntheticFrameSource(const Options &options)
+    : m_options(options), m_random(options.seed)
+{
+    m_realtime = options.realtime;
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    av_freep(&m_background[0]);
+}
+
+bool SyntheticFrameSource::open()
+{
+    const Format &format = m_options.format;
+    switch (format.format)
+    {
+    case AV_PIX_FMT_UYVY422:
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_YUV420P:
+        break;
+    default:
+        Logger::instance().log("Synthetic source does not support this pixel format");
+        return false;
+    }
+    if (format.width < 16 || format.height < 16 || !allocateFrames(format, 64))
+        return false;
+    if (av_image_alloc(m_background, m_backgroundLinesize, format.width, format.height, format.format, 64) < 0)
+        return false;
+
+    const int barWidth = (format.width / 8) & ~1;
+    for (int i = 0; i < 8; ++i)
+    {
+        const int x = i * barWidth;
+        const int w = i == 7 ? format.width - x : barWidth;
+        fillRect(m_background, m_backgroundLinesize, x, 0, w, format.height, Bars[i].r, Bars[i].g, Bars[i].b);
+    }
+    Logger::instance().log(QString("Synthetic source %1x%2 at %3/%4, jitter %5 ms, drop rate %6%7")
+                               .arg(format.width)
+                               .arg(format.height)
+                               .arg(format.fpsNum)
+                               .arg(format.fpsDen)
+                               .arg(m_options.jitterMs)
+                               .arg(m_options.dropRate)
+                               .arg(m_realtime ? "" : ", unthrottled"));
+    return true;
+}
+
+bool SyntheticFrameSource::renderFrame(qint64 index, VideoFrame &frame)
+{
+    const Format &format = m_options.format;
+    av_image_copy(frame.data, frame.linesize, const_cast<const uint8_t **>(m_background), m_backgroundLinesize, format.format,
+                  format.width, format.height);
+
+    // The box crosses the frame in about four seconds.
+    const int box = std::max(16, format.height / 6) & ~1;
+    const int travel = std::max(2, format.width - box);
+    const int step = std::max<int>(2, static_cast<int>(static_cast<qint64>(travel) * format.fpsDen / (4 * format.fpsNum))) & ~1;
+    const int x = static_cast<int>(index * step % travel) & ~1;
+    const int y = ((format.height - box) / 2) & ~1;
+    fillRect(frame.data, frame.linesize, x, y, std::min(box, format.width - x), box, 255, 255, 255);
+    return true;
+}
+
+bool SyntheticFrameSource::dropFrame(qint64 index)
+{
+    decide(index);
+    return m_drop;
+}
+
+qint64 SyntheticFrameSource::jitterTicks(qint64 index)
+{
+    decide(index);
+    return m_jitter;
+}
+
+// capture() may ask about the same frame again after a timeout, so each
+// frame's fate is drawn once.
+void SyntheticFrameSource::decide(qint64 index)
+{
+    if (index == m_decidedIndex)
+        return;
+    m_decidedIndex = index;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    m_drop = m_options.dropRate > 0.0 && unit(m_random) < m_options.dropRate;
+    m_jitter = m_options.jitterMs > 0.0 ? static_cast<qint64>((unit(m_random) * 2.0 - 1.0) * m_options.jitterMs * 10000.0) : 0;
+}
+
+void SyntheticFrameSource::fillRect(uint8_t *const data[4], const int linesize[4], int x, int y, int w, int h, int r, int g, int b) const
+{
+    x &= ~1;
+    y &= ~1;
+    w &= ~1;
+    h &= ~1;
+    uint8_t cy, cu, cv;
+    toYuv(r, g, b, cy, cu, cv);
+    switch (m_options.format.format)
+    {
+    case AV_PIX_FMT_UYVY422:
+        for (int row = y; row < y + h; ++row)
+        {
+            uint8_t *p = data[0] + static_cast<ptrdiff_t>(row) * linesize[0] + x * 2;
+            for (int i = 0; i < w / 2; ++i, p += 4)
+            {
+                p[0] = cu;
+                p[1] = cy;
+                p[2] = cv;
+                p[3] = cy;
+            }
+        }
+        break;
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+    {
+        const bool bgr = m_options.format.format == AV_PIX_FMT_BGRA || m_options.format.format == AV_PIX_FMT_BGR0;
+        const uint8_t pixel[4] = {static_cast<uint8_t>(bgr ? b : r), static_cast<uint8_t>(g), static_cast<uint8_t>(bgr ? r : b), 255};
+        for (int row = y; row < y + h; ++row)
+        {
+            uint8_t *p = data[0] + static_cast<ptrdiff_t>(row) * linesize[0] + x * 4;
+            for (int i = 0; i < w; ++i, p += 4)
+                std::memcpy(p, pixel, 4);
+        }
+        break;
+    }
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_YUV420P:
+        for (int row = y; row < y + h; ++row)
+            std::memset(data[0] + static_cast<ptrdiff_t>(row) * linesize[0] + x, cy, w);
+        for (int row = y / 2; row < (y + h) / 2; ++row)
+        {
+            if (m_options.format.format == AV_PIX_FMT_NV12)
+            {
+                uint8_t *p = data[1] + static_cast<ptrdiff_t>(row) * linesize[1] + x;
+                for (int i = 0; i < w / 2; ++i, p += 2)
+                {
+                    p[0] = cu;
+                    p[1] = cv;
+                }
+            }
+            else
+            {
+                std::memset(data[1] + static_cast<ptrdiff_t>(row) * linesize[1] + x / 2, cu, w / 2);
+                std::memset(data[2] + static_cast<ptrdiff_t>(row) * linesize[2] + x / 2, cv, w / 2);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
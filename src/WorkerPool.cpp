@@ -0,0 +1,101 @@
+#include "WorkerPool.h"
+#include <QMutexLocker>
+
+WorkerPool &WorkerPool::instance()
+{
+    static WorkerPool inst;
+    return inst;
+}
+
+WorkerPool::WorkerPool()
+{
+    const int workers = QThread::idealThreadCount() - 1;
+    for (int i = 0; i < workers; ++i)
+    {
+        QThread *thread = QThread::create([this]() { workerLoop(); });
+        thread->setObjectName(QString("WorkerPool-%1").arg(i));
+        thread->start();
+        m_workers.append(thread);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_workAvailable.wakeAll();
+    }
+    for (QThread *thread : m_workers)
+    {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void WorkerPool::execute(Batch &batch)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        batch.nextBatch = m_batches;
+        m_batches = &batch;
+        ++batch.users;
+        m_workAvailable.wakeAll();
+    }
+
+    work(batch);
+
+    QMutexLocker locker(&m_mutex);
+    --batch.users;
+    // Wait for every index to finish and for workers to let go of the batch,
+    // which lives on this thread's stack.
+    while (batch.remaining.load(std::memory_order_acquire) > 0 || batch.users > 0)
+        m_batchDone.wait(&m_mutex);
+    for (Batch **link = &m_batches; *link; link = &(*link)->nextBatch)
+    {
+        if (*link == &batch)
+        {
+            *link = batch.nextBatch;
+            break;
+        }
+    }
+}
+
+void WorkerPool::work(Batch &batch)
+{
+    for (;;)
+    {
+        const int index = batch.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= batch.count)
+            return;
+        batch.invoke(batch.context, index);
+        if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            QMutexLocker locker(&m_mutex);
+            m_batchDone.wakeAll();
+        }
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping)
+    {
+        Batch *batch = m_batches;
+        while (batch && batch->next.load(std::memory_order_relaxed) >= batch->count)
+            batch = batch->nextBatch;
+        if (!batch)
+        {
+            m_workAvailable.wait(&m_mutex);
+            continue;
+        }
+
+        ++batch->users;
+        locker.unlock();
+        work(*batch);
+        locker.relock();
+        if (--batch->users == 0)
+            m_batchDone.wakeAll();
+    }
+}
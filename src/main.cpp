@@ -1,12 +1,21 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include "MainWindow.h"
 #include "Logging.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption metricsOption("metrics", "Serve Prometheus metrics on host:port or unix:path.", "address");
+    parser.addOption(metricsOption);
+    parser.process(a);
+
     Logger::instance().log("Application started");
     MainWindow w;
+    if (parser.isSet(metricsOption))
+        w.serveMetrics(parser.value(metricsOption));
     w.show();
     int ret = a.exec();
     Logger::instance().log("Application exit");